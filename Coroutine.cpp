@@ -0,0 +1,42 @@
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+#include "Coroutine.h"
+#include <poll.h>
+
+using namespace OTF;
+
+bool FdAwaiter::poll() {
+  struct pollfd pfd = {fd, events, 0};
+  return ::poll(&pfd, 1, 0) > 0 && (pfd.revents & (events | POLLERR | POLLHUP | POLLNVAL)) != 0;
+}
+
+bool FdAwaiter::await_ready() {
+  ready = poll();
+  return ready;
+}
+
+void FdAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  this->handle = handle;
+  watch.setTask([this]() -> void {
+    ready = watch.getReadyEvents() != 0;
+    // The awaiter is destroyed once the coroutine continues, so it must not be used after this.
+    this->handle.resume();
+  });
+  scheduler.watch(watch, fd, events, timeout);
+}
+
+SleepAwaiter OTF::sleepFor(Scheduler &scheduler, unsigned long delay) {
+  return SleepAwaiter(scheduler, delay);
+}
+
+SleepAwaiter OTF::nextLoop(Scheduler &scheduler) {
+  return SleepAwaiter(scheduler, 0);
+}
+
+FdAwaiter OTF::readable(Scheduler &scheduler, int fd, unsigned long timeout) {
+  return FdAwaiter(scheduler, fd, POLLIN, timeout);
+}
+
+FdAwaiter OTF::writable(Scheduler &scheduler, int fd, unsigned long timeout) {
+  return FdAwaiter(scheduler, fd, POLLOUT, timeout);
+}
+#endif
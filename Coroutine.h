@@ -0,0 +1,214 @@
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+#ifndef OTF_COROUTINE_H
+#define OTF_COROUTINE_H
+
+#if !defined(__cpp_impl_coroutine)
+#error "OTF_ENABLE_COROUTINES requires C++20 coroutine support (compile with -std=c++20)"
+#endif
+
+#include "Request.h"
+#include "Response.h"
+#include "Scheduler.h"
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <utility>
+
+#ifndef COROUTINE_RESPONSE_TIMEOUT
+// The time in milliseconds a coroutine callback may take before a 504 response is sent instead.
+#define COROUTINE_RESPONSE_TIMEOUT DEFERRED_RESPONSE_TIMEOUT
+#endif
+
+namespace OTF {
+  template<typename T>
+  class Task;
+
+  /** The parts of a task's promise that don't depend on its result type. */
+  class TaskPromiseBase {
+    template<typename T>
+    friend class Task;
+
+  private:
+    /** The coroutine awaiting this task, resumed when it finishes. */
+    std::coroutine_handle<> continuation;
+    /** Called when a detached task finishes. */
+    std::function<void()> onComplete;
+    bool detached = false;
+
+    class FinalAwaiter {
+    public:
+      bool await_ready() noexcept { return false; }
+
+      template<typename Promise>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        TaskPromiseBase &promise = handle.promise();
+        if (promise.continuation) {
+          return promise.continuation;
+        }
+
+        if (promise.detached) {
+          // Nothing owns a detached task, so it frees itself once it's done.
+          std::function<void()> onComplete = std::move(promise.onComplete);
+          handle.destroy();
+          if (onComplete) {
+            onComplete();
+          }
+        }
+        return std::noop_coroutine();
+      }
+
+      void await_resume() noexcept {}
+    };
+
+  public:
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    // The library doesn't use exceptions, so treat one escaping a callback like any other crash.
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  template<typename T>
+  class TaskPromise : public TaskPromiseBase {
+  public:
+    T value;
+
+    void return_value(T value) { this->value = std::move(value); }
+  };
+
+  template<>
+  class TaskPromise<void> : public TaskPromiseBase {
+  public:
+    void return_void() {}
+  };
+
+  /**
+   * A lazily started coroutine. Awaiting a task starts it and suspends the awaiting coroutine until the task returns,
+   * so callbacks can be split into smaller coroutines.
+   */
+  template<typename T = void>
+  class Task {
+  public:
+    class promise_type : public TaskPromise<T> {
+    public:
+      Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+  public:
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+      if (handle) {
+        handle.destroy();
+      }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+      handle.promise().continuation = awaiting;
+      return handle;
+    }
+
+    T await_resume() {
+      if constexpr (!std::is_void<T>::value) {
+        return std::move(handle.promise().value);
+      }
+    }
+
+    /**
+     * Starts the task without awaiting it. The task frees itself when it finishes.
+     * @param onComplete Called after the task has finished.
+     */
+    void detach(std::function<void()> onComplete) {
+      std::coroutine_handle<promise_type> started = std::exchange(handle, nullptr);
+      started.promise().onComplete = std::move(onComplete);
+      started.promise().detached = true;
+      started.resume();
+    }
+  };
+
+  /** Suspends a coroutine until a delay has passed. */
+  class SleepAwaiter {
+  private:
+    Scheduler &scheduler;
+    unsigned long delay;
+
+  public:
+    SleepAwaiter(Scheduler &scheduler, unsigned long delay) : scheduler(scheduler), delay(delay) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+      scheduler.setTimeout([handle]() -> void {
+        handle.resume();
+      }, delay);
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  /**
+   * Suspends a coroutine until a file descriptor is ready or a timeout passes. The descriptor is watched by the
+   * scheduler, which checks all of the watched descriptors with a single poll() on each call to loop().
+   */
+  class FdAwaiter {
+  private:
+    Scheduler &scheduler;
+    int fd;
+    short events;
+    unsigned long timeout;
+    bool ready = false;
+    std::coroutine_handle<> handle;
+    FdWatch watch;
+
+    /** Checks the file descriptor without blocking. */
+    bool poll();
+
+  public:
+    FdAwaiter(Scheduler &scheduler, int fd, short events, unsigned long timeout) :
+      scheduler(scheduler), fd(fd), events(events), timeout(timeout) {}
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+
+    /** Returns a boolean indicating if the file descriptor became ready before the timeout. */
+    bool await_resume() const noexcept { return ready; }
+  };
+
+  /**
+   * A callback written as a coroutine. The request and response stay valid until the coroutine returns, and the
+   * response is sent once it does.
+   */
+  typedef Task<void> (*coroutine_callback_t)(const Request &request, Response &response);
+
+  /**
+   * Suspends the calling coroutine for a delay. Other requests are handled in the meantime.
+   * @param scheduler The scheduler of the framework (returned by OpenThingsFramework::getScheduler()).
+   * @param delay Time in milliseconds.
+   */
+  SleepAwaiter sleepFor(Scheduler &scheduler, unsigned long delay);
+
+  /** Suspends the calling coroutine until the next call to loop(). */
+  SleepAwaiter nextLoop(Scheduler &scheduler);
+
+  /**
+   * Suspends the calling coroutine until a file descriptor can be read from without blocking, such as a socket to
+   * another device. The result of the `co_await` is a boolean indicating if the descriptor became readable before the
+   * timeout.
+   * @param timeout Time in milliseconds, or 0 to wait indefinitely.
+   */
+  FdAwaiter readable(Scheduler &scheduler, int fd, unsigned long timeout);
+
+  /** Like readable(), but waits until the file descriptor can be written to without blocking. */
+  FdAwaiter writable(Scheduler &scheduler, int fd, unsigned long timeout);
+}// namespace OTF
+
+#endif
+#endif
@@ -0,0 +1,164 @@
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+#include "Deflate.h"
+#include <string.h>
+
+using namespace OTF;
+
+// The empty stored block that ends every sync flush, which RFC 7692 removes from the end of each message.
+static const char SYNC_FLUSH_TAIL[4] = {0x00, 0x00, (char) 0xff, (char) 0xff};
+
+MessageDeflater::MessageDeflater(int windowBits, int memLevel, bool contextTakeover) : contextTakeover(contextTakeover) {
+  memset(&stream, 0, sizeof(stream));
+  // zlib doesn't support a window of 256 bytes for raw streams, so use the next smallest size.
+  if (windowBits < 9) {
+    windowBits = 9;
+  }
+  // A negative window size produces raw DEFLATE data without a zlib header.
+  initialized = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -windowBits, memLevel, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+MessageDeflater::~MessageDeflater() {
+  if (initialized) {
+    deflateEnd(&stream);
+  }
+}
+
+void MessageDeflater::emit(const char *data, size_t length, const deflate_output_t &output) {
+  // Always hold back the last 4 bytes produced so they can be dropped if the message ends with them.
+  if (heldLength + length <= sizeof(held)) {
+    memcpy(&held[heldLength], data, length);
+    heldLength += length;
+    return;
+  }
+
+  size_t release = heldLength + length - sizeof(held);
+  if (release <= heldLength) {
+    output(held, release);
+    memmove(held, &held[release], heldLength - release);
+    heldLength -= release;
+  } else {
+    output(held, heldLength);
+    output(data, release - heldLength);
+    data += release - heldLength;
+    length -= release - heldLength;
+    heldLength = 0;
+  }
+  memcpy(&held[heldLength], data, length);
+  heldLength += length;
+}
+
+bool MessageDeflater::run(const char *data, size_t length, int flush, const deflate_output_t &output) {
+  if (!initialized) {
+    return false;
+  }
+
+  char chunk[DEFLATE_CHUNK_SIZE];
+  stream.next_in = (Bytef *) data;
+  stream.avail_in = length;
+  do {
+    stream.next_out = (Bytef *) chunk;
+    stream.avail_out = sizeof(chunk);
+    int result = deflate(&stream, flush);
+    if (result != Z_OK && result != Z_BUF_ERROR) {
+      return false;
+    }
+    size_t produced = sizeof(chunk) - stream.avail_out;
+    if (produced > 0) {
+      emit(chunk, produced, output);
+    }
+  } while (stream.avail_in > 0 || stream.avail_out == 0);
+
+  return true;
+}
+
+bool MessageDeflater::write(const char *data, size_t length, const deflate_output_t &output) {
+  return length == 0 || run(data, length, Z_NO_FLUSH, output);
+}
+
+bool MessageDeflater::finish(const deflate_output_t &output) {
+  if (!run(nullptr, 0, Z_SYNC_FLUSH, output)) {
+    return false;
+  }
+
+  bool valid = heldLength == sizeof(held) && memcmp(held, SYNC_FLUSH_TAIL, sizeof(held)) == 0;
+  heldLength = 0;
+
+  if (!contextTakeover) {
+    deflateReset(&stream);
+  }
+  return valid;
+}
+
+bool MessageDeflater::isValid() const {
+  return initialized;
+}
+
+MessageInflater::MessageInflater(int windowBits, bool contextTakeover) : contextTakeover(contextTakeover) {
+  memset(&stream, 0, sizeof(stream));
+  initialized = inflateInit2(&stream, -windowBits) == Z_OK;
+}
+
+MessageInflater::~MessageInflater() {
+  if (initialized) {
+    inflateEnd(&stream);
+  }
+}
+
+char *MessageInflater::inflateMessage(const char *data, size_t length, size_t maxLength, size_t &outLength) {
+  if (!initialized) {
+    return nullptr;
+  }
+
+  size_t capacity = DEFLATE_CHUNK_SIZE;
+  char *buffer = new char[capacity + 1];
+  outLength = 0;
+
+  // Decompress the message, then the sync flush tail that was removed from it.
+  const char *inputs[2] = {data, SYNC_FLUSH_TAIL};
+  size_t inputLengths[2] = {length, sizeof(SYNC_FLUSH_TAIL)};
+  bool ended = false;
+  for (int i = 0; i < 2 && !ended; i++) {
+    stream.next_in = (Bytef *) inputs[i];
+    stream.avail_in = inputLengths[i];
+    do {
+      if (outLength == capacity) {
+        if (capacity >= maxLength) {
+          delete[] buffer;
+          inflateReset(&stream);
+          return nullptr;
+        }
+        capacity = capacity * 2 < maxLength ? capacity * 2 : maxLength;
+        char *grown = new char[capacity + 1];
+        memcpy(grown, buffer, outLength);
+        delete[] buffer;
+        buffer = grown;
+      }
+
+      stream.next_out = (Bytef *) &buffer[outLength];
+      stream.avail_out = capacity - outLength;
+      int result = inflate(&stream, Z_SYNC_FLUSH);
+      outLength = capacity - stream.avail_out;
+      if (result == Z_STREAM_END) {
+        // The peer ended the DEFLATE stream with a final block, so the window can't be used for the next message.
+        ended = true;
+        break;
+      } else if (result != Z_OK && result != Z_BUF_ERROR) {
+        delete[] buffer;
+        inflateReset(&stream);
+        return nullptr;
+      }
+    } while (stream.avail_in > 0 || stream.avail_out == 0);
+  }
+
+  if (ended || !contextTakeover) {
+    inflateReset(&stream);
+  }
+
+  buffer[outLength] = '\0';
+  return buffer;
+}
+
+bool MessageInflater::isValid() const {
+  return initialized;
+}
+#endif
@@ -0,0 +1,80 @@
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+#ifndef OTF_DEFLATE_H
+#define OTF_DEFLATE_H
+
+#include <stddef.h>
+#include <functional>
+#include <zlib.h>
+
+// The size of the buffer compressed and decompressed data is produced in.
+#define DEFLATE_CHUNK_SIZE 512
+
+namespace OTF {
+  typedef std::function<void(const char *data, size_t length)> deflate_output_t;
+
+  /**
+   * Compresses messages into the payload format of the permessage-deflate websocket extension (RFC 7692): raw DEFLATE
+   * data with the trailing empty stored block of the final sync flush removed. Each message is passed to write() in any
+   * number of chunks and completed with finish().
+   */
+  class MessageDeflater {
+  private:
+    z_stream stream;
+    bool initialized = false;
+    bool contextTakeover;
+    /** The last 4 bytes of output, which are withheld in case they are the end of the final sync flush. */
+    char held[4];
+    size_t heldLength = 0;
+
+    bool run(const char *data, size_t length, int flush, const deflate_output_t &output);
+    void emit(const char *data, size_t length, const deflate_output_t &output);
+
+  public:
+    /**
+     * @param windowBits The base 2 logarithm of the LZ77 window size (9 to 15). Smaller windows use less memory.
+     * @param memLevel The amount of memory used for the internal compression state (1 to 9).
+     * @param contextTakeover Indicates if the window is kept between messages. Disabling it lowers the compression
+     * ratio of small messages but means the peer doesn't need to keep its window either.
+     */
+    MessageDeflater(int windowBits, int memLevel, bool contextTakeover);
+    ~MessageDeflater();
+
+    /** Compresses a chunk of the current message, passing any produced output to `output`. */
+    bool write(const char *data, size_t length, const deflate_output_t &output);
+
+    /** Completes the current message, passing the remaining output to `output`. */
+    bool finish(const deflate_output_t &output);
+
+    bool isValid() const;
+  };
+
+  /** Decompresses messages produced in the permessage-deflate payload format. */
+  class MessageInflater {
+  private:
+    z_stream stream;
+    bool initialized = false;
+    bool contextTakeover;
+
+  public:
+    /**
+     * @param windowBits The base 2 logarithm of the largest window size the peer may compress with (9 to 15).
+     * @param contextTakeover Indicates if the peer keeps its window between messages.
+     */
+    MessageInflater(int windowBits, bool contextTakeover);
+    ~MessageInflater();
+
+    /**
+     * Decompresses a complete message.
+     * @param maxLength The maximum size of the decompressed message.
+     * @param outLength Set to the size of the decompressed message.
+     * @return A new buffer containing the decompressed message followed by a null terminator, or nullptr if the message
+     * could not be decompressed or was larger than `maxLength`.
+     */
+    char *inflateMessage(const char *data, size_t length, size_t maxLength, size_t &outLength);
+
+    bool isValid() const;
+  };
+}// namespace OTF
+
+#endif
+#endif
@@ -1,6 +1,9 @@
 #if defined(ESP32)
 #include "Esp32LocalServer.h"
 
+#include <errno.h>
+#include <lwip/sockets.h>
+
 using namespace OTF;
 
 Esp32LocalServer::Esp32LocalServer(uint16_t port) : server(port) {}
@@ -19,6 +22,12 @@ LocalClient *Esp32LocalServer::acceptClient() {
   return activeClient;
 }
 
+LocalClient *Esp32LocalServer::detachClient() {
+  LocalClient *client = activeClient;
+  activeClient = nullptr;
+  return client;
+}
+
 void Esp32LocalServer::begin() {
   server.begin();
 }
@@ -40,6 +49,18 @@ size_t Esp32LocalClient::readBytesUntil(char terminator, char *buffer, size_t le
   return client.readBytesUntil(terminator, buffer, length);
 }
 
+size_t Esp32LocalClient::readAvailable(char *buffer, size_t length) {
+  size_t available = client.available();
+  if (available == 0) {
+    return 0;
+  }
+  return client.read((uint8_t *) buffer, available < length ? available : length);
+}
+
+bool Esp32LocalClient::connected() {
+  return client.connected();
+}
+
 void Esp32LocalClient::print(const char *data) {
   client.print(data);
 }
@@ -52,6 +73,18 @@ size_t Esp32LocalClient::write(const char *buffer, size_t length) {
   return client.write((const uint8_t *)buffer, length);
 }
 
+size_t Esp32LocalClient::writeAvailable(const char *buffer, size_t length) {
+  // write() retries with a timeout while the socket buffer is full, so send directly to the socket without waiting.
+  int result = send(client.fd(), buffer, length, MSG_DONTWAIT);
+  if (result < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      client.stop();
+    }
+    return 0;
+  }
+  return result;
+}
+
 int Esp32LocalClient::peek() {
   return client.peek();
 }
@@ -19,6 +19,12 @@ LocalClient *Esp8266LocalServer::acceptClient() {
   return activeClient;
 }
 
+LocalClient *Esp8266LocalServer::detachClient() {
+  LocalClient *client = activeClient;
+  activeClient = nullptr;
+  return client;
+}
+
 void Esp8266LocalServer::begin() {
   server.begin();
 }
@@ -44,6 +50,27 @@ size_t Esp8266LocalClient::write(const char *buffer, size_t size) {
   return client.write((const uint8_t *)buffer, size);
 }
 
+size_t Esp8266LocalClient::writeAvailable(const char *buffer, size_t size) {
+  // write() waits for the data that doesn't fit in the TCP send buffer to be acknowledged, so only write what fits.
+  size_t available = client.availableForWrite();
+  if (available == 0) {
+    return 0;
+  }
+  return client.write((const uint8_t *) buffer, available < size ? available : size);
+}
+
+size_t Esp8266LocalClient::readAvailable(char *buffer, size_t length) {
+  size_t available = client.available();
+  if (available == 0) {
+    return 0;
+  }
+  return client.read((uint8_t *) buffer, available < length ? available : length);
+}
+
+bool Esp8266LocalClient::connected() {
+  return client.connected();
+}
+
 void Esp8266LocalClient::print(const char *data) {
   client.print(data);
 }
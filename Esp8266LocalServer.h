@@ -19,7 +19,10 @@ namespace OTF {
     bool dataAvailable();
     size_t readBytes(char *buffer, size_t length);
     size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    size_t readAvailable(char *buffer, size_t length);
+    bool connected();
     size_t write(const char *buffer, size_t length);
+    size_t writeAvailable(const char *buffer, size_t length);
     void print(const char *data);
     void print(const __FlashStringHelper *data);
     int peek();
@@ -38,6 +41,7 @@ namespace OTF {
     Esp8266LocalServer(uint16_t port);
 
     LocalClient *acceptClient();
+    LocalClient *detachClient();
     void begin();
   };
 }// namespace OTF
@@ -0,0 +1,111 @@
+#if !defined(ARDUINO)
+#include "EthernetTcpClient.h"
+#include <string.h>
+
+using namespace OTF;
+
+EthernetTcpClient::EthernetTcpClient() : client(new EthernetClient()) {}
+
+EthernetTcpClient::~EthernetTcpClient() {
+  client->stop();
+  delete client;
+}
+
+void EthernetTcpClient::setSecure(bool secure) {
+  if (secure == this->secure) {
+    return;
+  }
+
+  client->stop();
+  delete client;
+  client = secure ? new EthernetClientSsl() : new EthernetClient();
+  this->secure = secure;
+}
+
+bool EthernetTcpClient::connect(const websockets::WSString &host, const int port) {
+  client->stop();
+  bufferStart = bufferEnd = 0;
+  return client->connect(host.c_str(), port) == 1;
+}
+
+bool EthernetTcpClient::poll() {
+  return bufferStart < bufferEnd || (client->connected() && client->available(0));
+}
+
+bool EthernetTcpClient::available() {
+  return client->connected();
+}
+
+void EthernetTcpClient::send(const websockets::WSString &data) {
+  send((const uint8_t *) data.data(), data.size());
+}
+
+void EthernetTcpClient::send(const websockets::WSString &&data) {
+  send((const uint8_t *) data.data(), data.size());
+}
+
+void EthernetTcpClient::send(const uint8_t *data, const uint32_t len) {
+  uint32_t sent = 0;
+  while (sent < len) {
+    size_t result = client->write(&data[sent], len - sent);
+    if (result == 0 || result == (size_t) -1) {
+      close();
+      return;
+    }
+    sent += result;
+  }
+}
+
+bool EthernetTcpClient::fill() {
+  bufferStart = bufferEnd = 0;
+  if (!client->connected()) {
+    return false;
+  }
+
+  int result = client->read((uint8_t *) buffer, sizeof(buffer));
+  if (result <= 0) {
+    /* Reads wait a few seconds for data and return 0 if none arrives, without marking plain connections as closed.
+     * A server that stops sending in the middle of the handshake or a frame is treated as gone, as TLS reads already do,
+     * so the connect thread and the reconnect backoff aren't stuck waiting for it forever.
+     */
+    close();
+    return false;
+  }
+  bufferEnd = result;
+  return true;
+}
+
+websockets::WSString EthernetTcpClient::readLine() {
+  websockets::WSString line;
+  while (bufferStart < bufferEnd || fill()) {
+    char *end = (char *) memchr(&buffer[bufferStart], '\n', bufferEnd - bufferStart);
+    size_t length = end != nullptr ? end - &buffer[bufferStart] + 1 : bufferEnd - bufferStart;
+    line.append(&buffer[bufferStart], length);
+    bufferStart += length;
+    if (end != nullptr) {
+      break;
+    }
+  }
+  return line;
+}
+
+uint32_t EthernetTcpClient::read(uint8_t *data, const uint32_t len) {
+  if (bufferStart == bufferEnd && !fill()) {
+    return 0;
+  }
+
+  uint32_t length = bufferEnd - bufferStart < len ? bufferEnd - bufferStart : len;
+  memcpy(data, &buffer[bufferStart], length);
+  bufferStart += length;
+  return length;
+}
+
+void EthernetTcpClient::close() {
+  client->stop();
+  bufferStart = bufferEnd = 0;
+}
+
+int EthernetTcpClient::getSocket() const {
+  return client->GetSocket();
+}
+#endif
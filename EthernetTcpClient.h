@@ -0,0 +1,48 @@
+#if !defined(ARDUINO)
+#ifndef OTF_ETHERNETTCPCLIENT_H
+#define OTF_ETHERNETTCPCLIENT_H
+
+#include "etherport.h"
+#include <tiny_websockets/network/tcp_client.hpp>
+
+// The size of the buffer incoming data is read through.
+#define TCP_CLIENT_BUFFER_SIZE 1024
+
+namespace OTF {
+  /**
+   * Connects tiny_websockets through etherport, so websocket connections use the shared resolver and can be made over
+   * TLS with session resumption.
+   */
+  class EthernetTcpClient : public websockets::network::TcpClient {
+  private:
+    EthernetClient *client;
+    bool secure = false;
+    char buffer[TCP_CLIENT_BUFFER_SIZE];
+    size_t bufferStart = 0;
+    size_t bufferEnd = 0;
+
+    /** Reads available data into the empty buffer, closing the connection if none arrives before the read times out. */
+    bool fill();
+
+  public:
+    EthernetTcpClient();
+    ~EthernetTcpClient();
+
+    /** Sets if the next connection should use TLS. */
+    void setSecure(bool secure);
+
+    bool connect(const websockets::WSString &host, const int port);
+    bool poll();
+    bool available();
+    void send(const websockets::WSString &data);
+    void send(const websockets::WSString &&data);
+    void send(const uint8_t *data, const uint32_t len);
+    websockets::WSString readLine();
+    uint32_t read(uint8_t *buffer, const uint32_t len);
+    void close();
+    int getSocket() const;
+  };
+}// namespace OTF
+
+#endif
+#endif
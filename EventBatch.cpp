@@ -0,0 +1,129 @@
+#include "EventBatch.h"
+#include <string.h>
+
+using namespace OTF;
+
+EventBatch::~EventBatch() {
+  clear();
+}
+
+EventBatch::AddResult EventBatch::add(const char *topic, const char *payload, size_t length, EventPriority priority) {
+  size_t topicLength = strlen(topic);
+  if (topicLength == 0 || topicLength > PUBLISH_MAX_TOPIC_LENGTH ||
+      PUBLISH_MESSAGE_OVERHEAD + PUBLISH_EVENT_OVERHEAD + topicLength + length > PUBLISH_MAX_BATCH_BYTES) {
+    return EVENT_TOO_LARGE;
+  }
+  if (!isValidTopic(topic)) {
+    return EVENT_INVALID_TOPIC;
+  }
+
+  Event *event = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(events[i].topic, topic) == 0) {
+      event = &events[i];
+      break;
+    }
+  }
+
+  size_t previousLength = event != nullptr ? PUBLISH_EVENT_OVERHEAD + topicLength + event->length : 0;
+  if ((event == nullptr && count >= PUBLISH_MAX_TOPICS) ||
+      encodedLength - previousLength + PUBLISH_EVENT_OVERHEAD + topicLength + length > PUBLISH_MAX_BATCH_BYTES) {
+    return EVENT_BATCH_FULL;
+  }
+
+  char *copy = new char[length > 0 ? length : 1];
+  memcpy(copy, payload, length);
+
+  AddResult result = EVENT_COALESCED;
+  if (event == nullptr) {
+    event = &events[count++];
+    strcpy(event->topic, topic);
+    event->payload = nullptr;
+    event->priority = priority;
+    result = EVENT_ADDED;
+  } else if (priority > event->priority) {
+    event->priority = priority;
+  }
+
+  delete[] event->payload;
+  event->payload = copy;
+  event->length = length;
+  encodedLength += PUBLISH_EVENT_OVERHEAD + topicLength + length - previousLength;
+  return result;
+}
+
+bool EventBatch::isValidTopic(const char *topic) {
+  for (const char *c = topic; *c != 0; c++) {
+    if ((unsigned char) *c <= ' ' || *c == 0x7f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void EventBatch::encode(StringBuilder &builder, uint8_t frameType) const {
+  encodeStart(builder, frameType);
+  for (size_t i = 0; i < count; i++) {
+    encodeEvent(builder, frameType, events[i].topic, events[i].payload, events[i].length);
+  }
+}
+
+void EventBatch::encodeStart(StringBuilder &builder, uint8_t frameType) {
+  if (frameType == 0) {
+    builder.bprintf((char *) "EVT:\r\n");
+  } else {
+    char type = (char) frameType;
+    builder.write(&type, 1);
+  }
+}
+
+void EventBatch::encodeEvent(StringBuilder &builder, uint8_t frameType, const char *topic, const char *payload, size_t length) {
+  if (frameType == 0) {
+    builder.bprintf((char *) "%s %u\r\n", topic, (unsigned int) length);
+    builder.write(payload, length);
+    builder.bprintf((char *) "\r\n");
+  } else {
+    char topicLength = (char) strlen(topic);
+    builder.write(&topicLength, 1);
+    builder.write(topic, topicLength);
+    char payloadLength[2] = {(char) (length >> 8), (char) length};
+    builder.write(payloadLength, 2);
+    builder.write(payload, length);
+  }
+}
+
+void EventBatch::clear() {
+  for (size_t i = 0; i < count; i++) {
+    delete[] events[i].payload;
+  }
+  count = 0;
+  encodedLength = PUBLISH_MESSAGE_OVERHEAD;
+}
+
+size_t EventBatch::getCount() const {
+  return count;
+}
+
+bool EventBatch::isEmpty() const {
+  return count == 0;
+}
+
+size_t EventBatch::getEncodedLength() const {
+  return encodedLength;
+}
+
+const char *EventBatch::getTopic(size_t index) const {
+  return events[index].topic;
+}
+
+const char *EventBatch::getPayload(size_t index) const {
+  return events[index].payload;
+}
+
+size_t EventBatch::getPayloadLength(size_t index) const {
+  return events[index].length;
+}
+
+EventPriority EventBatch::getPriority(size_t index) const {
+  return events[index].priority;
+}
@@ -0,0 +1,131 @@
+#ifndef OTF_EVENTBATCH_H
+#define OTF_EVENTBATCH_H
+
+#include "StringBuilder.hpp"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#ifndef PUBLISH_BATCH_WINDOW
+// The time in milliseconds events are held so that events published shortly after each other are sent in one message.
+#define PUBLISH_BATCH_WINDOW 50
+#endif
+#ifndef PUBLISH_MAX_TOPICS
+// The maximum number of topics with a pending event. Publishing to another topic sends the pending events first.
+#define PUBLISH_MAX_TOPICS 16
+#endif
+#ifndef PUBLISH_MAX_BATCH_BYTES
+// The maximum size in bytes of the events in one message.
+#define PUBLISH_MAX_BATCH_BYTES 2048
+#endif
+// The maximum length of a topic.
+#define PUBLISH_MAX_TOPIC_LENGTH 64
+// The space needed to encode an event besides its topic and payload, in either framing.
+#define PUBLISH_EVENT_OVERHEAD 10
+// The space needed for the start of a message, in either framing.
+#define PUBLISH_MESSAGE_OVERHEAD 6
+
+namespace OTF {
+  /** How important an event is. When the outbound queue is full, events with the lowest priority are dropped first. */
+  enum EventPriority {
+    EVENT_PRIORITY_LOW,
+    EVENT_PRIORITY_NORMAL,
+    EVENT_PRIORITY_HIGH
+  };
+
+  /**
+   * The events published by the device that are waiting to be sent. Only the latest event of each topic is kept, so a
+   * value that changes several times within the batch window is only sent once.
+   */
+  class EventBatch {
+  public:
+    enum AddResult {
+      /** The event was added to the batch. */
+      EVENT_ADDED,
+      /** The event replaced the pending event of the same topic. */
+      EVENT_COALESCED,
+      /** The batch has no room for the event, so it must be sent first. */
+      EVENT_BATCH_FULL,
+      /** The event can never fit in a message, or its topic is too long. */
+      EVENT_TOO_LARGE,
+      /** The topic contains a character that would break the text framing. */
+      EVENT_INVALID_TOPIC
+    };
+
+  private:
+    struct Event {
+      char topic[PUBLISH_MAX_TOPIC_LENGTH + 1];
+      char *payload;
+      size_t length;
+      EventPriority priority;
+    };
+
+    /** The pending events, in the order their topics were first published. */
+    Event events[PUBLISH_MAX_TOPICS];
+    size_t count = 0;
+    /** The size of the encoded message, including its start. */
+    size_t encodedLength = PUBLISH_MESSAGE_OVERHEAD;
+
+  public:
+    EventBatch() {}
+    ~EventBatch();
+
+    EventBatch(const EventBatch &) = delete;
+    EventBatch &operator=(const EventBatch &) = delete;
+
+    /**
+     * Adds an event, replacing the pending event of the same topic. The replacement keeps the higher of the two
+     * priorities.
+     * @param topic A null-terminated topic of up to PUBLISH_MAX_TOPIC_LENGTH characters, without spaces or control
+     *              characters (see isValidTopic()).
+     * @param payload The payload, which may contain any bytes.
+     * @param length The length of the payload.
+     * @param priority
+     */
+    AddResult add(const char *topic, const char *payload, size_t length, EventPriority priority = EVENT_PRIORITY_NORMAL);
+
+    /**
+     * Returns a boolean indicating if a topic can be published. The text framing separates the topic from the payload
+     * length with a space and ends the line with CRLF, so topics can't contain spaces or control characters.
+     */
+    static bool isValidTopic(const char *topic);
+
+    /**
+     * Encodes the pending events into a single message.
+     *
+     * Text:   "EVT:\r\n", then for each event: topic, ' ', decimal payload length, "\r\n", payload, "\r\n"
+     * Binary: CLOUD_FRAME_EVENTS, then for each event: 1 byte length, topic, 2 byte length, payload
+     *
+     * @param builder A builder with room for getEncodedLength() bytes.
+     * @param frameType The first byte of a binary message, or 0 to use the text encoding.
+     */
+    void encode(StringBuilder &builder, uint8_t frameType) const;
+
+    /** Writes the start of a message. See encode(). */
+    static void encodeStart(StringBuilder &builder, uint8_t frameType);
+
+    /** Writes a single event of a message. See encode(). */
+    static void encodeEvent(StringBuilder &builder, uint8_t frameType, const char *topic, const char *payload, size_t length);
+
+    /** Removes all pending events. */
+    void clear();
+
+    size_t getCount() const;
+    bool isEmpty() const;
+
+    /** Returns the maximum size of the encoded message. */
+    size_t getEncodedLength() const;
+
+    /** Returns the topic of a pending event, in the order the topics were first published. */
+    const char *getTopic(size_t index) const;
+    const char *getPayload(size_t index) const;
+    size_t getPayloadLength(size_t index) const;
+    EventPriority getPriority(size_t index) const;
+  };
+}// namespace OTF
+
+#endif
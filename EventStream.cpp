@@ -0,0 +1,232 @@
+#include "EventStream.h"
+#include "Trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sent to idle streams. Lines starting with a colon are comments, which clients ignore.
+#define EVENT_STREAM_KEEPALIVE ": keep-alive\n\n"
+
+using namespace OTF;
+
+EventStream::EventStream(Scheduler &scheduler) : scheduler(scheduler) {
+  keepAliveTimer.setTask([this]() {
+    keepAlive();
+  });
+  scheduler.start(keepAliveTimer, EVENT_STREAM_KEEPALIVE_INTERVAL, EVENT_STREAM_KEEPALIVE_INTERVAL);
+}
+
+EventStream::~EventStream() {
+  scheduler.stop(keepAliveTimer);
+  connectionCallback = nullptr;
+  for (size_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    if (clients[i] != nullptr) {
+      remove(i);
+    }
+  }
+  for (size_t i = 0; i < historyCount; i++) {
+    history[(historyHead + i) % EVENT_STREAM_HISTORY_EVENTS].event->release();
+  }
+}
+
+void EventStream::accept(const Request &request, LocalClient *client) {
+  if (clientCount >= EVENT_STREAM_MAX_CLIENTS) {
+    client->print(F("HTTP/1.1 503 Too many connections\r\nContent-Length: 0\r\n\r\n"));
+    client->flush();
+    client->stop();
+    delete client;
+    return;
+  }
+
+  client->print(F("HTTP/1.1 200 OK\r\ncontent-type: text/event-stream\r\ncache-control: no-cache\r\nconnection: keep-alive\r\n\r\n"));
+  char retry[24];
+  snprintf(retry, sizeof(retry), "retry: %d\n\n", EVENT_STREAM_RETRY);
+  client->print(retry);
+
+  Client *streamClient = new Client();
+  streamClient->id = nextClientId++;
+  streamClient->client = client;
+  for (size_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    if (clients[i] == nullptr) {
+      clients[i] = streamClient;
+      break;
+    }
+  }
+  clientCount++;
+
+  char *lastId = request.getHeader(F("last-event-id"));
+  if (lastId != nullptr) {
+    replay(*streamClient, strtoul(lastId, nullptr, 10));
+  }
+  OTF_TRACE(EVENT_STREAM_OPENED, streamClient->id, streamClient->queue.getCount());
+  if (connectionCallback) {
+    connectionCallback(streamClient->id, true);
+  }
+}
+
+void EventStream::loop() {
+  for (size_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    Client *client = clients[i];
+    if (client == nullptr) {
+      continue;
+    }
+
+    // Clients don't send anything after the request, but reading notices when they close the connection.
+    char discard[32];
+    client->client->readAvailable(discard, sizeof(discard));
+    if (!client->closed && !client->queue.write(client->client)) {
+      client->closed = true;
+    }
+    if (client->closed || !client->client->connected()) {
+      remove(i);
+    }
+  }
+}
+
+SharedBuffer *EventStream::encodeEvent(uint32_t id, const char *event, const char *data) {
+  char idField[24];
+  size_t idLength = id != 0 ? snprintf(idField, sizeof(idField), "id: %lu\n", (unsigned long) id) : 0;
+
+  // The first pass measures the encoded event, and the second writes it into a buffer of that size.
+  SharedBuffer *buffer = nullptr;
+  for (int pass = 0; pass < 2; pass++) {
+    size_t length = 0;
+    auto append = [&buffer, &length](const char *text, size_t size) {
+      if (buffer != nullptr) {
+        memcpy(&buffer->data[length], text, size);
+      }
+      length += size;
+    };
+
+    append(idField, idLength);
+    if (event != nullptr) {
+      append("event: ", 7);
+      append(event, strlen(event));
+      append("\n", 1);
+    }
+    // Clients treat CRLF, CR and LF as line breaks, and join the data fields of an event with LF.
+    const char *line = data;
+    while (true) {
+      size_t lineLength = strcspn(line, "\r\n");
+      append("data: ", 6);
+      append(line, lineLength);
+      append("\n", 1);
+      line += lineLength;
+      if (*line == 0) {
+        break;
+      }
+      line += line[0] == '\r' && line[1] == '\n' ? 2 : 1;
+    }
+    append("\n", 1);
+
+    if (buffer == nullptr) {
+      buffer = SharedBuffer::create(length);
+    }
+  }
+  return buffer;
+}
+
+void EventStream::enqueue(Client &client, SharedBuffer *event) {
+  // Many events may be pushed within a single call to loop(), so make room by writing them now if possible.
+  if (client.queue.isFull() && !client.queue.write(client.client)) {
+    client.closed = true;
+    return;
+  }
+  if (!client.queue.push(event)) {
+    // The client isn't keeping up, so disconnect it. It resumes from the history when it reconnects.
+    client.closed = true;
+  }
+}
+
+void EventStream::broadcast(SharedBuffer *event) {
+  for (size_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    if (clients[i] != nullptr && !clients[i]->closed) {
+      enqueue(*clients[i], event);
+    }
+  }
+  sentSinceKeepAlive = true;
+}
+
+void EventStream::replay(Client &client, uint32_t lastId) {
+  // IDs start from 1 again when the device restarts, so an ID newer than the last event was sent before the restart
+  // and the whole history is new to the client.
+  bool known = lastId <= lastEventId;
+  for (size_t i = 0; i < historyCount; i++) {
+    const HistoryEntry &entry = history[(historyHead + i) % EVENT_STREAM_HISTORY_EVENTS];
+    if (!known || entry.id > lastId) {
+      enqueue(client, entry.event);
+    }
+  }
+}
+
+uint32_t EventStream::push(const char *event, const char *data) {
+  uint32_t id = ++lastEventId;
+  SharedBuffer *encoded = encodeEvent(id, event, data);
+
+  if (historyCount == EVENT_STREAM_HISTORY_EVENTS) {
+    history[historyHead].event->release();
+    historyHead = (historyHead + 1) % EVENT_STREAM_HISTORY_EVENTS;
+    historyCount--;
+  }
+  // The history keeps the reference returned by encodeEvent().
+  history[(historyHead + historyCount) % EVENT_STREAM_HISTORY_EVENTS] = {id, encoded};
+  historyCount++;
+
+  broadcast(encoded);
+  OTF_TRACE(EVENT_STREAM_PUSHED, id, clientCount);
+  return id;
+}
+
+uint32_t EventStream::push(const char *data) {
+  return push(nullptr, data);
+}
+
+bool EventStream::send(uint32_t client, const char *event, const char *data) {
+  for (size_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    Client *target = clients[i];
+    if (target != nullptr && target->id == client && !target->closed) {
+      SharedBuffer *encoded = encodeEvent(0, event, data);
+      enqueue(*target, encoded);
+      encoded->release();
+      return !target->closed;
+    }
+  }
+  return false;
+}
+
+void EventStream::remove(size_t index) {
+  Client *client = clients[index];
+  clients[index] = nullptr;
+  clientCount--;
+
+  client->client->stop();
+  delete client->client;
+  uint32_t id = client->id;
+  delete client;
+  OTF_TRACE(EVENT_STREAM_CLOSED, id, clientCount);
+  if (connectionCallback) {
+    connectionCallback(id, false);
+  }
+}
+
+void EventStream::keepAlive() {
+  if (!sentSinceKeepAlive && clientCount > 0) {
+    SharedBuffer *comment = SharedBuffer::create(strlen(EVENT_STREAM_KEEPALIVE));
+    memcpy(comment->data, EVENT_STREAM_KEEPALIVE, comment->length);
+    broadcast(comment);
+    comment->release();
+  }
+  sentSinceKeepAlive = false;
+}
+
+void EventStream::onConnection(event_stream_connection_callback_t callback) {
+  connectionCallback = callback;
+}
+
+size_t EventStream::getClientCount() const {
+  return clientCount;
+}
+
+uint32_t EventStream::getLastEventId() const {
+  return lastEventId;
+}
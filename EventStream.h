@@ -0,0 +1,149 @@
+#ifndef OTF_EVENTSTREAM_H
+#define OTF_EVENTSTREAM_H
+
+#include "LocalServer.h"
+#include "Request.h"
+#include "Scheduler.h"
+#include "SendQueue.h"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#ifndef EVENT_STREAM_MAX_CLIENTS
+// The maximum number of clients connected to each event stream. Additional requests are rejected with a 503.
+#define EVENT_STREAM_MAX_CLIENTS 4
+#endif
+#ifndef EVENT_STREAM_HISTORY_EVENTS
+// The number of recent events each stream keeps, so clients that reconnect with a Last-Event-ID receive what they missed.
+#define EVENT_STREAM_HISTORY_EVENTS 16
+#endif
+#ifndef EVENT_STREAM_QUEUE_EVENTS
+// The maximum number of events waiting to be sent to each client. Clients that fall further behind are disconnected.
+#define EVENT_STREAM_QUEUE_EVENTS 32
+#endif
+#ifndef EVENT_STREAM_KEEPALIVE_INTERVAL
+/* The time in milliseconds between comments sent to idle streams, so proxies don't time out the connection and clients
+ * that went away are noticed.
+ */
+#define EVENT_STREAM_KEEPALIVE_INTERVAL 15000
+#endif
+#ifndef EVENT_STREAM_RETRY
+// The time in milliseconds clients are asked to wait before reconnecting after the connection is lost.
+#define EVENT_STREAM_RETRY 2000
+#endif
+
+#if EVENT_STREAM_QUEUE_EVENTS <= EVENT_STREAM_HISTORY_EVENTS
+#error "EVENT_STREAM_QUEUE_EVENTS must be larger than EVENT_STREAM_HISTORY_EVENTS to replay the history to reconnecting clients"
+#endif
+
+namespace OTF {
+  /** Called when a client connects to an event stream (`connected` is true) or disconnects. */
+  typedef std::function<void(uint32_t client, bool connected)> event_stream_connection_callback_t;
+
+  /**
+   * Sends events to browsers over Server-Sent Events (`text/event-stream`) responses, which are kept open after the
+   * request has been handled. Each pushed event is encoded once and shared by the send queues of every client, and the
+   * queues are written from loop() with LocalClient::writeAvailable(), which never waits for a connection, so a slow
+   * client doesn't hold up the others. Clients whose queue fills up are disconnected.
+   *
+   * Every event gets an increasing ID and is kept in a ring of the last EVENT_STREAM_HISTORY_EVENTS events. Browsers
+   * send the ID of the last event they received when they reconnect, and the events after it that are still in the
+   * history are sent before any new events. If the client missed more events than the history holds, the IDs of the
+   * events it receives are not consecutive, so it can tell that it should reload the full state.
+   *
+   * All functions must be called from the thread calling OpenThingsFramework::loop().
+   */
+  class EventStream {
+  private:
+    struct Client {
+      uint32_t id;
+      LocalClient *client;
+      SendQueue queue{EVENT_STREAM_QUEUE_EVENTS};
+      /** Indicates if the connection should be closed. */
+      bool closed = false;
+    };
+
+    struct HistoryEntry {
+      uint32_t id;
+      SharedBuffer *event;
+    };
+
+    Scheduler &scheduler;
+    Client *clients[EVENT_STREAM_MAX_CLIENTS] = {};
+    size_t clientCount = 0;
+    uint32_t nextClientId = 1;
+    HistoryEntry history[EVENT_STREAM_HISTORY_EVENTS];
+    /** The index of the oldest event in the history. */
+    size_t historyHead = 0;
+    size_t historyCount = 0;
+    uint32_t lastEventId = 0;
+    Timer keepAliveTimer;
+    /** Indicates if an event was sent since the last keep-alive. */
+    bool sentSinceKeepAlive = false;
+    event_stream_connection_callback_t connectionCallback = nullptr;
+
+    /**
+     * Encodes an event in the text/event-stream format. Each line of the data is sent as a separate data field.
+     * @param id The ID of the event, or 0 to send it without an ID.
+     */
+    static SharedBuffer *encodeEvent(uint32_t id, const char *event, const char *data);
+    /**
+     * Adds an event to a client's queue, writing what the connection accepts first if the queue is full. The client is
+     * disconnected if there is still no room.
+     */
+    void enqueue(Client &client, SharedBuffer *event);
+    void broadcast(SharedBuffer *event);
+    /** Queues the events in the history after the specified ID. */
+    void replay(Client &client, uint32_t lastId);
+    void remove(size_t index);
+    void keepAlive();
+
+  public:
+    EventStream(Scheduler &scheduler);
+    ~EventStream();
+
+    EventStream(const EventStream &) = delete;
+    EventStream &operator=(const EventStream &) = delete;
+
+    /**
+     * Sends the headers of the stream and the events the client missed, and keeps the connection open, or responds with
+     * a 503 if EVENT_STREAM_MAX_CLIENTS are already connected. Takes ownership of the client either way.
+     */
+    void accept(const Request &request, LocalClient *client);
+
+    /** Writes the clients' send queues and closes the connections that were closed by the clients. */
+    void loop();
+
+    /**
+     * Sends an event to every client and adds it to the history.
+     * @param event The event type, which browsers dispatch to listeners registered for it, or nullptr for the default
+     * "message" type. Must not contain line breaks.
+     * @param data A null-terminated payload, which may contain line breaks.
+     * @return The ID of the event.
+     */
+    uint32_t push(const char *event, const char *data);
+
+    /** Sends an event of the default "message" type. See push(const char *, const char *). */
+    uint32_t push(const char *data);
+
+    /**
+     * Sends an event to a single client without adding it to the history, such as the current state when it connects.
+     * The event has no ID, so it doesn't change the ID the client resumes from.
+     * @return A boolean indicating if the event was queued.
+     */
+    bool send(uint32_t client, const char *event, const char *data);
+
+    void onConnection(event_stream_connection_callback_t callback);
+
+    size_t getClientCount() const;
+
+    /** Returns the ID of the last event that was pushed, or 0 if no event has been pushed. */
+    uint32_t getLastEventId() const;
+  };
+}// namespace OTF
+
+#endif
@@ -18,6 +18,10 @@ namespace OTF {
 
     friend class Response;
 
+    friend class ResponseCache;
+
+    friend class Request;
+
   private:
     LinkedMapNode<T> *head = nullptr;
     LinkedMapNode<T> *tail = nullptr;
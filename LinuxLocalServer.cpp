@@ -18,8 +18,8 @@ LocalClient *LinuxLocalServer::acceptClient() {
     delete activeClient;
   }
 
-  EthernetClient client = server.available();
-  if (client) {
+  EthernetClient *client = server.accept();
+  if (client != nullptr) {
     activeClient = new LinuxLocalClient(client);
   } else {
     activeClient = nullptr;
@@ -28,48 +28,82 @@ LocalClient *LinuxLocalServer::acceptClient() {
 }
 
 
+LocalClient *LinuxLocalServer::detachClient() {
+  LocalClient *client = activeClient;
+  activeClient = nullptr;
+  return client;
+}
+
 void LinuxLocalServer::begin() {
   server.begin();
 }
 
+bool LinuxLocalServer::enableTls(const char *certFile, const char *keyFile) {
+  return server.enableTls(certFile, keyFile);
+}
+
+SslStats LinuxLocalServer::getTlsStats() {
+  return server.getTlsStats();
+}
+
 
-LinuxLocalClient::LinuxLocalClient(EthernetClient client) {
+LinuxLocalClient::LinuxLocalClient(EthernetClient *client) {
   this->client = client;
 }
 
+LinuxLocalClient::~LinuxLocalClient() {
+  delete client;
+}
+
 bool LinuxLocalClient::dataAvailable() {
-  return client.available();
+  return client->available();
 }
 
 size_t LinuxLocalClient::readBytes(char *buffer, size_t length) {
-  return client.read((uint8_t*) buffer, length);
+  return client->read((uint8_t*) buffer, length);
 }
 
 size_t LinuxLocalClient::readBytesUntil(char terminator, char *buffer, size_t length) {
-    return client.readBytesUntil(terminator, buffer, length);
+    return client->readBytesUntil(terminator, buffer, length);
+}
+
+size_t LinuxLocalClient::readAvailable(char *buffer, size_t length) {
+  if (!client->available(0)) {
+    return 0;
+  }
+  int read = client->read((uint8_t*) buffer, length);
+  return read > 0 ? read : 0;
+}
+
+bool LinuxLocalClient::connected() {
+  return client->connected();
 }
 
 void LinuxLocalClient::print(const char *data) {
-  client.write((uint8_t*)data, strlen(data));
+  client->write((uint8_t*)data, strlen(data));
 }
 
 size_t LinuxLocalClient::write(const char *buffer, size_t size) {
-  return client.write((uint8_t*)buffer, size);
+  return client->write((uint8_t*)buffer, size);
+}
+
+size_t LinuxLocalClient::writeAvailable(const char *buffer, size_t size) {
+  return client->writeNonBlocking((const uint8_t*) buffer, size);
 }
 
 /*int LinuxLocalClient::peek() {
-  return client.peek();
+  return client->peek();
 }*/
 
 void LinuxLocalClient::setTimeout(int timeout) {
-  client.setTimeout(timeout);
+  client->setTimeout(timeout);
 }
 
 void LinuxLocalClient::flush() {
-	client.flush();
+	client->flush();
 }
 
 void LinuxLocalClient::stop() {
-	client.stop();
+	client->stop();
 }
 #endif
\ No newline at end of file
@@ -10,16 +10,20 @@ namespace OTF {
     friend class LinuxLocalServer;
 
   private:
-    EthernetClient client;
-    LinuxLocalClient(EthernetClient client);
+    EthernetClient *client;
+    LinuxLocalClient(EthernetClient *client);
     
   public:
+    ~LinuxLocalClient();
     bool dataAvailable();
     size_t readBytes(char *buffer, size_t length);
     size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    size_t readAvailable(char *buffer, size_t length);
+    bool connected();
     void print(const char *data);
     //int peek();
     size_t write(const char *buffer, size_t size);
+    size_t writeAvailable(const char *buffer, size_t size);
     void setTimeout(int timeout);
     void flush();
     void stop();
@@ -36,7 +40,19 @@ namespace OTF {
     ~LinuxLocalServer();
 
     LocalClient *acceptClient();
+    LocalClient *detachClient();
     void begin();
+
+    /**
+     * Serves connections over TLS instead of plain HTTP.
+     * @param certFile Path of the PEM encoded certificate chain.
+     * @param keyFile Path of the PEM encoded private key.
+     * @return A boolean indicating if the certificate and key were loaded.
+     */
+    bool enableTls(const char *certFile, const char *keyFile);
+
+    /** Returns the number of completed, resumed and failed TLS handshakes. */
+    SslStats getTlsStats();
   };
 }// namespace OTF
 
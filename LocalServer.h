@@ -12,6 +12,8 @@
 namespace OTF {
   class LocalClient {
   public:
+    virtual ~LocalClient() {}
+
     /** Returns a boolean indicating if data is currently available from this client. */
     virtual bool dataAvailable() = 0;
 
@@ -27,6 +29,15 @@ namespace OTF {
      */
     virtual size_t readBytesUntil(char terminator, char *buffer, size_t length) = 0;
 
+    /**
+     * Reads up to `length` bytes that have already been received, without waiting for more data like readBytes().
+     * @return The number of bytes read, which may be 0.
+     */
+    virtual size_t readAvailable(char *buffer, size_t length) = 0;
+
+    /** Returns a boolean indicating if the connection is still open. */
+    virtual bool connected() = 0;
+
     /** Prints a null-terminated string to the response stream. This method may be called multiple times before the stream is closed. */
     virtual void print(const char *data) = 0;
 
@@ -38,6 +49,13 @@ namespace OTF {
     /** Writes `size` bytes from `buffer` to the response stream. */
     virtual size_t write(const char *buffer, size_t size) = 0;
 
+    /**
+     * Writes up to `size` bytes that the connection can accept immediately, without waiting for room like write().
+     * If it returns 0 because the connection is busy, the next call must pass the same data again.
+     * @return The number of bytes written, which may be 0. Check connected() to tell if the connection failed.
+     */
+    virtual size_t writeAvailable(const char *buffer, size_t size) = 0;
+
     // /** Returns the next character in the request stream (without advancing the stream), or returns -1 if no character is available. */
     // virtual int peek() = 0;
 
@@ -50,12 +68,21 @@ namespace OTF {
 
   class LocalServer {
   public:
+    virtual ~LocalServer() {}
+
     /**
      * Closes the active client (if one is active) and accepts a new client (if one is available).
      * @return The newly accepted client, or `nullptr` if none was available.
      */
     virtual LocalClient *acceptClient() = 0;
 
+    /**
+     * Releases the active client so it isn't closed by the next call to acceptClient(), such as to respond to its
+     * request later. The caller becomes responsible for stopping and deleting the client.
+     * @return The active client, or `nullptr` if there is none.
+     */
+    virtual LocalClient *detachClient() = 0;
+
     /** Starts listening for connections. */
     virtual void begin() = 0;
   };
@@ -0,0 +1,116 @@
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+#include "LoopWatchdog.h"
+#include <string.h>
+
+using namespace OTF;
+
+static const char *const PHASE_NAMES[LOOP_PHASES] = {"accept", "read", "parse", "handler", "send", "websocket", "timers"};
+
+LoopWatchdog::LoopWatchdog() {
+  reset();
+}
+
+void LoopWatchdog::beginLoop() {
+  for (int i = 0; i < LOOP_PHASES; i++) {
+    current.phases[i] = 0;
+  }
+  current.path[0] = 0;
+  current.method = HTTP_ANY;
+  current.handlerDuration = 0;
+  loopStart = micros();
+  phaseStart = loopStart;
+}
+
+void LoopWatchdog::lap(LoopPhase phase) {
+  unsigned long now = micros();
+  current.phases[phase] += now - phaseStart;
+  phaseStart = now;
+}
+
+void LoopWatchdog::lapHandler(const Request &request) {
+  unsigned long now = micros();
+  unsigned long duration = now - phaseStart;
+  current.phases[LOOP_HANDLER] += duration;
+  phaseStart = now;
+
+  // Only copy the path of the slowest request, since most calls don't overrun.
+  if (duration >= current.handlerDuration) {
+    const char *path = request.getPath();
+    strncpy(current.path, path != nullptr ? path : "", LOOP_WATCHDOG_PATH_LENGTH);
+    current.path[LOOP_WATCHDOG_PATH_LENGTH] = 0;
+    current.method = request.httpMethod;
+    current.handlerDuration = duration;
+  }
+}
+
+bool LoopWatchdog::endLoop() {
+  unsigned long duration = micros() - loopStart;
+  loopCount++;
+  if (duration > loopMax) {
+    loopMax = duration;
+  }
+  for (int i = 0; i < LOOP_PHASES; i++) {
+    if (current.phases[i] > phaseMax[i]) {
+      phaseMax[i] = current.phases[i];
+    }
+  }
+
+  if (budget == 0 || duration <= budget) {
+    return false;
+  }
+
+  current.duration = duration;
+  current.timestamp = millis();
+  lastOverrun = current;
+  overrunCount++;
+  if (overrunCallback != nullptr) {
+    overrunCallback(lastOverrun);
+  }
+  return true;
+}
+
+void LoopWatchdog::setBudget(unsigned long budget) {
+  this->budget = budget;
+}
+
+unsigned long LoopWatchdog::getBudget() const {
+  return budget;
+}
+
+void LoopWatchdog::onOverrun(loop_overrun_callback_t callback) {
+  overrunCallback = callback;
+}
+
+unsigned long LoopWatchdog::getPhaseMax(LoopPhase phase) const {
+  return phaseMax[phase];
+}
+
+unsigned long LoopWatchdog::getLoopMax() const {
+  return loopMax;
+}
+
+uint32_t LoopWatchdog::getLoopCount() const {
+  return loopCount;
+}
+
+uint32_t LoopWatchdog::getOverrunCount() const {
+  return overrunCount;
+}
+
+const LoopOverrun &LoopWatchdog::getLastOverrun() const {
+  return lastOverrun;
+}
+
+void LoopWatchdog::reset() {
+  for (int i = 0; i < LOOP_PHASES; i++) {
+    phaseMax[i] = 0;
+  }
+  loopMax = 0;
+  loopCount = 0;
+  overrunCount = 0;
+}
+
+const char *LoopWatchdog::getPhaseName(LoopPhase phase) {
+  return phase < LOOP_PHASES ? PHASE_NAMES[phase] : "unknown";
+}
+#endif
@@ -0,0 +1,131 @@
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+#ifndef OTF_LOOPWATCHDOG_H
+#define OTF_LOOPWATCHDOG_H
+
+#include "Request.h"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+unsigned long millis();
+unsigned long micros();
+#endif
+
+#ifndef LOOP_WATCHDOG_BUDGET
+// The default time in microseconds a call to loop() may take before it is reported as an overrun.
+#define LOOP_WATCHDOG_BUDGET 50000
+#endif
+// The maximum length of the path recorded for an overrun. Longer paths are truncated.
+#define LOOP_WATCHDOG_PATH_LENGTH 48
+
+namespace OTF {
+  enum LoopPhase {
+    /** Accepting local clients and closing finished ones. */
+    LOOP_ACCEPT,
+    /** Waiting for and reading the headers and body of local requests. */
+    LOOP_READ,
+    /** Parsing local and cloud requests. */
+    LOOP_PARSE,
+    /** Routing requests and running the callbacks. Large responses are partly sent during this phase. */
+    LOOP_HANDLER,
+    /** Sending the remainder of responses, including deferred responses and event streams. */
+    LOOP_SEND,
+    /** Polling the cloud websocket (receiving and queueing forwarded requests) and the local websocket subscribers. */
+    LOOP_WEBSOCKET,
+    /** Running timers, deferred tasks and tasks posted from other threads. */
+    LOOP_TIMERS,
+    LOOP_PHASES
+  };
+
+  /** A call to loop() that took longer than the budget. */
+  struct LoopOverrun {
+    /** The value of millis() when the call finished. */
+    unsigned long timestamp;
+    /** The duration of the call in microseconds. */
+    unsigned long duration;
+    /** The time spent in each phase during the call, in microseconds. */
+    unsigned long phases[LOOP_PHASES];
+    /** The path of the slowest request handled during the call, or an empty string if no request was handled. */
+    char path[LOOP_WATCHDOG_PATH_LENGTH + 1];
+    HTTPMethod method;
+    /** The time spent in the callback of the slowest request, in microseconds. */
+    unsigned long handlerDuration;
+  };
+
+  typedef void (*loop_overrun_callback_t)(const LoopOverrun &overrun);
+
+  /**
+   * Measures how long each call to loop() takes and which phases the time was spent in. Every request is handled from
+   * loop(), so a slow callback delays the websocket heartbeat and the rest of the firmware; calls that take longer than
+   * the budget are recorded along with the slowest request handled during the call.
+   */
+  class LoopWatchdog {
+  private:
+    unsigned long budget = LOOP_WATCHDOG_BUDGET;
+    loop_overrun_callback_t overrunCallback = nullptr;
+    unsigned long loopStart = 0;
+    unsigned long phaseStart = 0;
+    /** The phases of the current call. */
+    LoopOverrun current;
+    LoopOverrun lastOverrun;
+    unsigned long phaseMax[LOOP_PHASES];
+    unsigned long loopMax;
+    uint32_t loopCount;
+    uint32_t overrunCount;
+
+  public:
+    LoopWatchdog();
+
+    /** Starts timing a call to loop(). */
+    void beginLoop();
+
+    /** Adds the time since the previous lap to the specified phase. */
+    void lap(LoopPhase phase);
+
+    /**
+     * Adds the time since the previous lap to the handler phase, and records the request if its callback is the slowest
+     * one during the current call.
+     */
+    void lapHandler(const Request &request);
+
+    /**
+     * Finishes timing a call to loop(), updating the maximums and recording an overrun if the call took longer than the
+     * budget.
+     * @return A boolean indicating if the call overran the budget.
+     */
+    bool endLoop();
+
+    /**
+     * Sets the time in microseconds a call to loop() may take before it is recorded as an overrun.
+     * @param budget The budget, or 0 to only track the maximums.
+     */
+    void setBudget(unsigned long budget);
+    unsigned long getBudget() const;
+
+    /** Sets a function to call after each overrun, or nullptr to stop reporting them. */
+    void onOverrun(loop_overrun_callback_t callback);
+
+    /** Returns the longest time in microseconds a single call to loop() spent in the specified phase. */
+    unsigned long getPhaseMax(LoopPhase phase) const;
+
+    /** Returns the longest duration of a call to loop() in microseconds. */
+    unsigned long getLoopMax() const;
+
+    uint32_t getLoopCount() const;
+    uint32_t getOverrunCount() const;
+
+    /** Returns the most recent overrun. Only valid if getOverrunCount() is greater than 0. */
+    const LoopOverrun &getLastOverrun() const;
+
+    /** Resets the maximums and counters, such as after the firmware finishes starting up. */
+    void reset();
+
+    /** Returns a short name for the phase, such as "handler". */
+    static const char *getPhaseName(LoopPhase phase);
+  };
+}// namespace OTF
+
+#endif
+#endif
@@ -0,0 +1,248 @@
+#if !defined(ARDUINO)
+#include "LoopbackLocalServer.h"
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+using namespace OTF;
+
+LoopbackConnection::LoopbackConnection(size_t chunkSize, unsigned long latency, unsigned long chunkInterval)
+    : chunkSize(chunkSize), latency(latency), chunkInterval(chunkInterval) {}
+
+void LoopbackConnection::write(const char *data, size_t length) {
+  std::lock_guard<std::mutex> lock(mutex);
+  unsigned long readableAt = micros() + latency;
+  if (!inbound.empty() && (long) (lastReadableAt - readableAt) > 0) {
+    readableAt = lastReadableAt;
+  }
+
+  while (length > 0) {
+    size_t size = chunkSize > 0 && chunkSize < length ? chunkSize : length;
+    inbound.push_back({std::string(data, size), readableAt});
+    lastReadableAt = readableAt;
+    data += size;
+    length -= size;
+    readableAt += chunkInterval;
+  }
+}
+
+void LoopbackConnection::write(const char *data) {
+  write(data, strlen(data));
+}
+
+size_t LoopbackConnection::read(char *buffer, size_t length) {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t size = outbound.size() < length ? outbound.size() : length;
+  memcpy(buffer, outbound.data(), size);
+  outbound.erase(0, size);
+  return size;
+}
+
+std::string LoopbackConnection::readAll() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::string data;
+  data.swap(outbound);
+  return data;
+}
+
+bool LoopbackConnection::isClosed() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return closed;
+}
+
+void LoopbackConnection::close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  clientClosed = true;
+}
+
+size_t LoopbackConnection::readable(unsigned long now) const {
+  size_t size = 0;
+  size_t offset = inboundOffset;
+  for (const Segment &segment : inbound) {
+    if ((long) (segment.readableAt - now) > 0) {
+      break;
+    }
+    size += segment.data.size() - offset;
+    offset = 0;
+  }
+  return size;
+}
+
+long LoopbackConnection::waitTime(unsigned long now) const {
+  if (inbound.empty()) {
+    return -1;
+  }
+  long wait = (long) (inbound.front().readableAt - now);
+  return wait > 0 ? wait : 0;
+}
+
+size_t LoopbackConnection::readNow(char *buffer, size_t length, unsigned long now, int terminator, bool &terminated) {
+  size_t read = 0;
+  terminated = false;
+  while (read < length && !inbound.empty() && (long) (inbound.front().readableAt - now) <= 0) {
+    Segment &segment = inbound.front();
+    const char *start = segment.data.data() + inboundOffset;
+    size_t available = segment.data.size() - inboundOffset;
+    size_t size = length - read < available ? length - read : available;
+
+    // Like Arduino streams, the terminator is consumed but not copied into the buffer.
+    const char *end = terminator >= 0 ? (const char *) memchr(start, terminator, size) : nullptr;
+    size_t consumed = size;
+    if (end != nullptr) {
+      size = end - start;
+      consumed = size + 1;
+      terminated = true;
+    }
+
+    memcpy(&buffer[read], start, size);
+    read += size;
+    inboundOffset += consumed;
+    if (inboundOffset == segment.data.size()) {
+      inbound.pop_front();
+      inboundOffset = 0;
+    }
+    if (terminated) {
+      break;
+    }
+  }
+  return read;
+}
+
+LoopbackLocalClient::LoopbackLocalClient(std::shared_ptr<LoopbackConnection> connection) : connection(connection) {}
+
+LoopbackLocalClient::~LoopbackLocalClient() {
+  stop();
+}
+
+bool LoopbackLocalClient::waitForData(unsigned long timeoutMillis) {
+  unsigned long start = micros();
+  while (true) {
+    long wait;
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      unsigned long now = micros();
+      if (connection->readable(now) > 0) {
+        return true;
+      }
+      wait = connection->waitTime(now);
+      long remaining = (long) (timeoutMillis * 1000) - (long) (now - start);
+      if (wait < 0 || wait > remaining) {
+        // No data will become readable before the timeout.
+        return false;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(wait));
+  }
+}
+
+bool LoopbackLocalClient::dataAvailable() {
+  return waitForData(LOOPBACK_AVAILABLE_WAIT);
+}
+
+size_t LoopbackLocalClient::readBytes(char *buffer, size_t length) {
+  size_t read = 0;
+  while (read < length && waitForData(timeout)) {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    bool terminated;
+    read += connection->readNow(&buffer[read], length - read, micros(), -1, terminated);
+  }
+  return read;
+}
+
+size_t LoopbackLocalClient::readBytesUntil(char terminator, char *buffer, size_t length) {
+  size_t read = 0;
+  bool terminated = false;
+  while (read < length && !terminated && waitForData(timeout)) {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    read += connection->readNow(&buffer[read], length - read, micros(), (unsigned char) terminator, terminated);
+  }
+  return read;
+}
+
+size_t LoopbackLocalClient::readAvailable(char *buffer, size_t length) {
+  std::lock_guard<std::mutex> lock(connection->mutex);
+  bool terminated;
+  return connection->readNow(buffer, length, micros(), -1, terminated);
+}
+
+bool LoopbackLocalClient::connected() {
+  std::lock_guard<std::mutex> lock(connection->mutex);
+  // Like a socket, the connection stays readable until the data written before it was closed has been read.
+  return !connection->closed && (!connection->clientClosed || connection->readable(micros()) > 0);
+}
+
+void LoopbackLocalClient::print(const char *data) {
+  write(data, strlen(data));
+}
+
+size_t LoopbackLocalClient::write(const char *buffer, size_t size) {
+  std::lock_guard<std::mutex> lock(connection->mutex);
+  if (connection->closed) {
+    return 0;
+  }
+  connection->outbound.append(buffer, size);
+  return size;
+}
+
+size_t LoopbackLocalClient::writeAvailable(const char *buffer, size_t size) {
+  // Writes never wait, since the outbound data is buffered without a limit.
+  return write(buffer, size);
+}
+
+void LoopbackLocalClient::setTimeout(int timeout) {
+  this->timeout = timeout;
+}
+
+void LoopbackLocalClient::flush() {
+  // Writes are delivered immediately.
+}
+
+void LoopbackLocalClient::stop() {
+  std::lock_guard<std::mutex> lock(connection->mutex);
+  connection->closed = true;
+}
+
+LoopbackLocalServer::~LoopbackLocalServer() {
+  delete activeClient;
+}
+
+LocalClient *LoopbackLocalServer::acceptClient() {
+  delete activeClient;
+  activeClient = nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!pending.empty()) {
+    activeClient = new LoopbackLocalClient(pending.front());
+    pending.pop_front();
+  }
+  return activeClient;
+}
+
+LocalClient *LoopbackLocalServer::detachClient() {
+  LocalClient *client = activeClient;
+  activeClient = nullptr;
+  return client;
+}
+
+void LoopbackLocalServer::begin() {
+  // There is nothing to listen on.
+}
+
+std::shared_ptr<LoopbackConnection> LoopbackLocalServer::connect() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<LoopbackConnection> connection(new LoopbackConnection(chunkSize, latency, chunkInterval));
+  pending.push_back(connection);
+  return connection;
+}
+
+void LoopbackLocalServer::setChunking(size_t chunkSize, unsigned long chunkInterval) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->chunkSize = chunkSize;
+  this->chunkInterval = chunkInterval;
+}
+
+void LoopbackLocalServer::setLatency(unsigned long latency) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->latency = latency;
+}
+#endif
@@ -0,0 +1,153 @@
+#if !defined(ARDUINO)
+#ifndef OTF_LOOPBACKLOCALSERVER_H
+#define OTF_LOOPBACKLOCALSERVER_H
+
+#include "LocalServer.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+unsigned long micros();
+
+// The maximum time in milliseconds dataAvailable() waits for data, matching EthernetClient::available().
+#define LOOPBACK_AVAILABLE_WAIT 5
+// The default time in milliseconds reads wait for data, matching the default timeout of Arduino streams.
+#define LOOPBACK_READ_TIMEOUT 1000
+
+namespace OTF {
+  class LoopbackLocalServer;
+  class LoopbackLocalClient;
+
+  /**
+   * The client end of an in-memory connection. Requests written to the connection are delivered to the server in chunks
+   * that become readable after a configurable delay, so slow and fragmented clients can be simulated deterministically.
+   * All methods may be called from a different thread than the one running the server.
+   */
+  class LoopbackConnection {
+    friend class LoopbackLocalServer;
+    friend class LoopbackLocalClient;
+
+  private:
+    struct Segment {
+      std::string data;
+      /** The value of micros() at which the segment becomes readable by the server. */
+      unsigned long readableAt;
+    };
+
+    mutable std::mutex mutex;
+    std::deque<Segment> inbound;
+    size_t inboundOffset = 0;
+    std::string outbound;
+    size_t chunkSize;
+    unsigned long latency;
+    unsigned long chunkInterval;
+    /** The time the last segment becomes readable, so chunks of consecutive writes stay in order. */
+    unsigned long lastReadableAt = 0;
+    bool closed = false;
+    /** Indicates if the client end closed the connection with close(). */
+    bool clientClosed = false;
+
+    LoopbackConnection(size_t chunkSize, unsigned long latency, unsigned long chunkInterval);
+
+    /** Returns the number of bytes the server can read without waiting. Must be called with the mutex held. */
+    size_t readable(unsigned long now) const;
+
+    /**
+     * Returns the time in microseconds until the next segment becomes readable, or 0 if it already is. Returns -1 if
+     * there is no pending data. Must be called with the mutex held.
+     */
+    long waitTime(unsigned long now) const;
+
+    /** Reads up to `length` bytes that are readable now. Must be called with the mutex held. */
+    size_t readNow(char *buffer, size_t length, unsigned long now, int terminator, bool &terminated);
+
+  public:
+    /** Sends data to the server. The data is split into chunks according to the server's chunking settings. */
+    void write(const char *data, size_t length);
+    void write(const char *data);
+
+    /**
+     * Reads data the server wrote to the connection.
+     * @return The number of bytes read.
+     */
+    size_t read(char *buffer, size_t length);
+
+    /** Removes and returns all of the data the server has written so far. */
+    std::string readAll();
+
+    /** Returns a boolean indicating if the server has closed the connection. */
+    bool isClosed() const;
+
+    /** Closes the connection from the client end. The server can still read the data that was already written. */
+    void close();
+  };
+
+  class LoopbackLocalClient : public LocalClient {
+    friend class LoopbackLocalServer;
+
+  private:
+    std::shared_ptr<LoopbackConnection> connection;
+    int timeout = LOOPBACK_READ_TIMEOUT;
+
+    LoopbackLocalClient(std::shared_ptr<LoopbackConnection> connection);
+
+    /** Waits up to `timeoutMillis` for data to become readable. */
+    bool waitForData(unsigned long timeoutMillis);
+
+  public:
+    ~LoopbackLocalClient();
+    bool dataAvailable();
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    size_t readAvailable(char *buffer, size_t length);
+    bool connected();
+    void print(const char *data);
+    size_t write(const char *buffer, size_t size);
+    size_t writeAvailable(const char *buffer, size_t size);
+    void setTimeout(int timeout);
+    void flush();
+    void stop();
+  };
+
+  /**
+   * A LocalServer that accepts in-memory connections instead of sockets, so the framework can be driven by a load
+   * generator in the same process without any kernel networking. Pass it to the OpenThingsFramework constructor that
+   * takes a LocalServer, then open connections with connect().
+   */
+  class LoopbackLocalServer : public LocalServer {
+  private:
+    std::mutex mutex;
+    std::deque<std::shared_ptr<LoopbackConnection>> pending;
+    LoopbackLocalClient *activeClient = nullptr;
+    size_t chunkSize = 0;
+    unsigned long latency = 0;
+    unsigned long chunkInterval = 0;
+
+  public:
+    ~LoopbackLocalServer();
+
+    LocalClient *acceptClient();
+    LocalClient *detachClient();
+    void begin();
+
+    /**
+     * Opens a new connection, which is accepted by the next call to acceptClient() after any connections opened
+     * before it.
+     */
+    std::shared_ptr<LoopbackConnection> connect();
+
+    /**
+     * Sets how data written by new connections is delivered to the server.
+     * @param chunkSize The maximum size of each chunk, or 0 to deliver each write in one chunk.
+     * @param chunkInterval Time in microseconds between chunks of the same write becoming readable.
+     */
+    void setChunking(size_t chunkSize, unsigned long chunkInterval = 0);
+
+    /** Sets the time in microseconds before data written by new connections becomes readable by the server. */
+    void setLatency(unsigned long latency);
+  };
+}// namespace OTF
+
+#endif
+#endif
@@ -0,0 +1,253 @@
+#if defined(OTF_ENABLE_METRICS)
+#include "Metrics.h"
+#include <stdlib.h>
+
+#if defined(ARDUINO)
+#define METRICS_ADD(counter, value) ((counter) += (value))
+#define METRICS_LOAD(counter) (counter)
+#else
+#define METRICS_ADD(counter, value) ((counter).fetch_add((value), std::memory_order_relaxed))
+#define METRICS_LOAD(counter) ((counter).load(std::memory_order_relaxed))
+#endif
+
+using namespace OTF;
+
+static const char *const METHOD_NAMES[] = {"ANY", "GET", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"};
+static const char *const ORIGIN_NAMES[METRICS_ORIGINS] = {"local", "cloud"};
+static const char *const PHASE_NAMES[METRICS_PHASES] = {"parse", "handler", "send"};
+
+void MetricsTimer::begin(size_t bytesIn) {
+  this->bytesIn = bytesIn;
+  route = nullptr;
+  for (int i = 0; i < METRICS_PHASES; i++) {
+    phases[i] = 0;
+  }
+  phaseStart = micros();
+}
+
+void MetricsTimer::lap(MetricsPhase phase) {
+  unsigned long now = micros();
+  phases[phase] = now - phaseStart;
+  phaseStart = now;
+}
+
+Metrics::Metrics() {
+  unmatched.key = nullptr;
+  unmatched.next = nullptr;
+  routeCount = 1;
+}
+
+Metrics::~Metrics() {
+  MetricsRoute *entry = head;
+  while (entry != nullptr) {
+    MetricsRoute *next = entry->next;
+    delete entry;
+    entry = next;
+  }
+}
+
+MetricsRoute *Metrics::findRoute(const char *key) const {
+  for (MetricsRoute *entry = head; entry != nullptr; entry = entry->next) {
+    if (entry->key == key) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+const MetricsRoute *Metrics::getEntry(size_t index) const {
+  if (index == 0) {
+    return &unmatched;
+  }
+
+  const MetricsRoute *entry = head;
+  for (size_t i = 1; entry != nullptr && i < index; i++) {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+MetricsRoute *Metrics::addRoute(const char *key) {
+  MetricsRoute *existing = findRoute(key);
+  if (existing != nullptr) {
+    return existing;
+  }
+
+  // Value-initialize the entry so all of the counters start at 0.
+  MetricsRoute *entry = new MetricsRoute();
+  entry->key = key;
+  if (tail == nullptr) {
+    head = entry;
+  } else {
+    tail->next = entry;
+  }
+  tail = entry;
+  routeCount++;
+  return entry;
+}
+
+uint8_t Metrics::bucketFor(unsigned long duration) {
+  uint8_t bucket = 0;
+  unsigned long bound = METRICS_HISTOGRAM_MIN;
+  while (bucket < METRICS_HISTOGRAM_BUCKETS - 1 && duration > bound) {
+    bound <<= 2;
+    bucket++;
+  }
+  return bucket;
+}
+
+unsigned long Metrics::getBucketBound(uint8_t bucket) {
+  if (bucket >= METRICS_HISTOGRAM_BUCKETS - 1) {
+    return 0;
+  }
+  return (unsigned long) METRICS_HISTOGRAM_MIN << (2 * bucket);
+}
+
+void Metrics::record(const MetricsTimer &timer, MetricsOrigin origin, uint16_t statusCode, size_t bytesOut) {
+  OriginMetrics &metrics = (timer.route != nullptr ? timer.route : &unmatched)->origins[origin];
+
+  METRICS_ADD(metrics.requests, 1);
+  if (statusCode >= 100 && statusCode < 600) {
+    METRICS_ADD(metrics.statusClasses[statusCode / 100 - 1], 1);
+  }
+  METRICS_ADD(metrics.bytesIn, timer.bytesIn);
+  METRICS_ADD(metrics.bytesOut, bytesOut);
+  for (int phase = 0; phase < METRICS_PHASES; phase++) {
+    METRICS_ADD(metrics.latency[phase][bucketFor(timer.phases[phase])], 1);
+    METRICS_ADD(metrics.latencySum[phase], timer.phases[phase]);
+  }
+}
+
+size_t Metrics::getRouteCount() const {
+  return routeCount;
+}
+
+bool Metrics::getSnapshot(size_t index, RouteMetricsSnapshot &out) const {
+  const MetricsRoute *entry = getEntry(index);
+  if (entry == nullptr) {
+    return false;
+  }
+
+  if (entry->key != nullptr) {
+    char *path;
+    out.method = (HTTPMethod) strtol(entry->key, &path, 10);
+    out.path = path;
+  } else {
+    out.method = HTTP_ANY;
+    out.path = nullptr;
+  }
+
+  for (int origin = 0; origin < METRICS_ORIGINS; origin++) {
+    const OriginMetrics &metrics = entry->origins[origin];
+    OriginMetricsSnapshot &copy = out.origins[origin];
+    copy.requests = METRICS_LOAD(metrics.requests);
+    for (int i = 0; i < 5; i++) {
+      copy.statusClasses[i] = METRICS_LOAD(metrics.statusClasses[i]);
+    }
+    copy.bytesIn = METRICS_LOAD(metrics.bytesIn);
+    copy.bytesOut = METRICS_LOAD(metrics.bytesOut);
+    for (int phase = 0; phase < METRICS_PHASES; phase++) {
+      for (int bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++) {
+        copy.latency[phase][bucket] = METRICS_LOAD(metrics.latency[phase][bucket]);
+      }
+      copy.latencySum[phase] = METRICS_LOAD(metrics.latencySum[phase]);
+    }
+  }
+  return true;
+}
+
+/** Writes the labels that identify a route and origin, without the surrounding braces. */
+static void writeLabels(Response &res, const RouteMetricsSnapshot &route, MetricsOrigin origin) {
+  if (route.path != nullptr) {
+    res.bprintf(F("route=\"%s\",method=\"%s\",origin=\"%s\""), route.path, METHOD_NAMES[route.method], ORIGIN_NAMES[origin]);
+  } else {
+    res.bprintf(F("route=\"" METRICS_UNMATCHED_ROUTE "\",method=\"ANY\",origin=\"%s\""), ORIGIN_NAMES[origin]);
+  }
+}
+
+/** Writes a duration in microseconds as seconds, without relying on floating point or 64-bit printf support. */
+static void writeSeconds(Response &res, uint64_t micros) {
+  res.bprintf(F("%lu.%06lu"), (unsigned long) (micros / 1000000), (unsigned long) (micros % 1000000));
+}
+
+void Metrics::writePrometheus(Response &res) const {
+  // Each metric family must be written as one group, so the routes are walked once per family.
+  res.bprintf(F("# HELP otf_requests_total Requests handled by route and origin.\n# TYPE otf_requests_total counter\n"));
+  RouteMetricsSnapshot route;
+  for (size_t i = 0; getSnapshot(i, route); i++) {
+    for (int origin = 0; origin < METRICS_ORIGINS; origin++) {
+      res.bprintf(F("otf_requests_total{"));
+      writeLabels(res, route, (MetricsOrigin) origin);
+      res.bprintf(F("} %lu\n"), (unsigned long) route.origins[origin].requests);
+    }
+  }
+
+  res.bprintf(F("# HELP otf_responses_total Responses by route, origin and status class.\n# TYPE otf_responses_total counter\n"));
+  for (size_t i = 0; getSnapshot(i, route); i++) {
+    for (int origin = 0; origin < METRICS_ORIGINS; origin++) {
+      for (int statusClass = 0; statusClass < 5; statusClass++) {
+        if (route.origins[origin].statusClasses[statusClass] == 0) {
+          continue;
+        }
+        res.bprintf(F("otf_responses_total{"));
+        writeLabels(res, route, (MetricsOrigin) origin);
+        res.bprintf(F(",code=\"%dxx\"} %lu\n"), statusClass + 1, (unsigned long) route.origins[origin].statusClasses[statusClass]);
+      }
+    }
+  }
+
+  res.bprintf(F("# HELP otf_request_bytes_total Bytes received in requests.\n# TYPE otf_request_bytes_total counter\n"));
+  for (size_t i = 0; getSnapshot(i, route); i++) {
+    for (int origin = 0; origin < METRICS_ORIGINS; origin++) {
+      res.bprintf(F("otf_request_bytes_total{"));
+      writeLabels(res, route, (MetricsOrigin) origin);
+      res.bprintf(F("} %lu\n"), (unsigned long) route.origins[origin].bytesIn);
+    }
+  }
+
+  res.bprintf(F("# HELP otf_response_bytes_total Bytes sent in responses.\n# TYPE otf_response_bytes_total counter\n"));
+  for (size_t i = 0; getSnapshot(i, route); i++) {
+    for (int origin = 0; origin < METRICS_ORIGINS; origin++) {
+      res.bprintf(F("otf_response_bytes_total{"));
+      writeLabels(res, route, (MetricsOrigin) origin);
+      res.bprintf(F("} %lu\n"), (unsigned long) route.origins[origin].bytesOut);
+    }
+  }
+
+  res.bprintf(F("# HELP otf_request_phase_seconds Time spent in each phase of handling a request.\n# TYPE otf_request_phase_seconds histogram\n"));
+  for (size_t i = 0; getSnapshot(i, route); i++) {
+    for (int origin = 0; origin < METRICS_ORIGINS; origin++) {
+      const OriginMetricsSnapshot &metrics = route.origins[origin];
+      // Skip the histograms of unused routes since they make up most of the output.
+      if (metrics.requests == 0) {
+        continue;
+      }
+
+      for (int phase = 0; phase < METRICS_PHASES; phase++) {
+        unsigned long cumulative = 0;
+        for (uint8_t bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++) {
+          cumulative += metrics.latency[phase][bucket];
+          res.bprintf(F("otf_request_phase_seconds_bucket{"));
+          writeLabels(res, route, (MetricsOrigin) origin);
+          res.bprintf(F(",phase=\"%s\",le=\""), PHASE_NAMES[phase]);
+          unsigned long bound = getBucketBound(bucket);
+          if (bound > 0) {
+            writeSeconds(res, bound);
+          } else {
+            res.bprintf(F("+Inf"));
+          }
+          res.bprintf(F("\"} %lu\n"), cumulative);
+        }
+
+        res.bprintf(F("otf_request_phase_seconds_sum{"));
+        writeLabels(res, route, (MetricsOrigin) origin);
+        res.bprintf(F(",phase=\"%s\"} "), PHASE_NAMES[phase]);
+        writeSeconds(res, metrics.latencySum[phase]);
+        res.bprintf(F("\notf_request_phase_seconds_count{"));
+        writeLabels(res, route, (MetricsOrigin) origin);
+        res.bprintf(F(",phase=\"%s\"} %lu\n"), PHASE_NAMES[phase], cumulative);
+      }
+    }
+  }
+}
+#endif
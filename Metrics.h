@@ -0,0 +1,162 @@
+#if defined(OTF_ENABLE_METRICS)
+#ifndef OTF_METRICS_H
+#define OTF_METRICS_H
+
+#include "Request.h"
+#include "Response.h"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+unsigned long micros();
+#endif
+
+// The number of latency histogram buckets, including the final bucket for durations longer than all the others.
+#define METRICS_HISTOGRAM_BUCKETS 10
+// The upper bound in microseconds of the first latency histogram bucket. Each following bucket is 4 times as wide.
+#define METRICS_HISTOGRAM_MIN 64
+// The route label used for requests that did not match a registered path.
+#define METRICS_UNMATCHED_ROUTE "unmatched"
+
+namespace OTF {
+#if defined(ARDUINO)
+  // Requests are only handled from loop(), so plain integers are enough.
+  typedef uint32_t metrics_counter_t;
+  typedef uint64_t metrics_total_t;
+#else
+  // Atomic so the metrics can be read from another thread while requests are being handled.
+  typedef std::atomic<uint32_t> metrics_counter_t;
+  typedef std::atomic<uint64_t> metrics_total_t;
+#endif
+
+  enum MetricsOrigin {
+    METRICS_LOCAL,
+    METRICS_CLOUD,
+    METRICS_ORIGINS
+  };
+
+  enum MetricsPhase {
+    /** Parsing the request, including reading the body of local requests. */
+    METRICS_PARSE,
+    /** Routing the request and running the callback. Responses larger than the response buffer are partly sent during this phase. */
+    METRICS_HANDLER,
+    /** Sending the remainder of the response. */
+    METRICS_SEND,
+    METRICS_PHASES
+  };
+
+  /** The metrics of a route for requests from one origin. */
+  template<typename Counter, typename Total>
+  struct BasicOriginMetrics {
+    Counter requests;
+    /** Responses by status class, from 1xx to 5xx. Responses without a status are only counted in `requests`. */
+    Counter statusClasses[5];
+    Total bytesIn;
+    Total bytesOut;
+    /** The number of requests in each latency bucket of each phase (not cumulative). */
+    Counter latency[METRICS_PHASES][METRICS_HISTOGRAM_BUCKETS];
+    /** The total duration of each phase in microseconds. */
+    Total latencySum[METRICS_PHASES];
+  };
+
+  typedef BasicOriginMetrics<metrics_counter_t, metrics_total_t> OriginMetrics;
+  typedef BasicOriginMetrics<uint32_t, uint64_t> OriginMetricsSnapshot;
+
+  /** A copy of the metrics of a route. */
+  struct RouteMetricsSnapshot {
+    /** The path of the route, or nullptr for requests that did not match a registered path. */
+    const char *path;
+    HTTPMethod method;
+    OriginMetricsSnapshot origins[METRICS_ORIGINS];
+  };
+
+  /** The metrics of a registered route. */
+  struct MetricsRoute {
+    /** The route's map key, or nullptr for requests that did not match a registered path. */
+    const char *key;
+    OriginMetrics origins[METRICS_ORIGINS];
+    MetricsRoute *next;
+  };
+
+  /** Measures the phases of the request currently being handled. */
+  class MetricsTimer {
+  private:
+    unsigned long phaseStart = 0;
+
+  public:
+    unsigned long phases[METRICS_PHASES];
+    /** The metrics of the route the request matched, or nullptr if it did not match a registered path. */
+    MetricsRoute *route = nullptr;
+    size_t bytesIn = 0;
+
+    /** Starts timing a new request. */
+    void begin(size_t bytesIn);
+
+    /** Records the time since the previous phase ended as the duration of `phase`. */
+    void lap(MetricsPhase phase);
+  };
+
+  /**
+   * Counts requests, response status classes and bytes transferred per route, and keeps a log-scale histogram of the
+   * duration of each phase of handling a request. Local and cloud requests are counted separately. Recording a request
+   * only increments counters; routes are registered up front and the router passes the matched route's metrics in the
+   * timer, so no allocation or lookup is needed.
+   */
+  class Metrics {
+  private:
+    MetricsRoute *head = nullptr;
+    MetricsRoute *tail = nullptr;
+    /** Requests that did not match a registered path. */
+    MetricsRoute unmatched = MetricsRoute();
+    size_t routeCount = 0;
+
+    MetricsRoute *findRoute(const char *key) const;
+    const MetricsRoute *getEntry(size_t index) const;
+    static uint8_t bucketFor(unsigned long duration);
+
+  public:
+    Metrics();
+    ~Metrics();
+
+    /**
+     * Registers a route so its requests are counted separately. Routes should be registered before the metrics are read
+     * from another thread.
+     * @param key The route's map key, which must remain valid for the lifetime of the metrics. Keys are compared by
+     * address, so each route must always be referred to with the same pointer.
+     * @return The metrics of the route, which are set as the `route` of the timer of requests that match it. Registering
+     * a route again returns the same metrics.
+     */
+    MetricsRoute *addRoute(const char *key);
+
+    /**
+     * Records a completed request.
+     * @param timer The timer of the request, whose `route` is the route the request is counted for.
+     * @param origin
+     * @param statusCode The status code of the response, or 0 if no status was written.
+     * @param bytesOut The size of the response.
+     */
+    void record(const MetricsTimer &timer, MetricsOrigin origin, uint16_t statusCode, size_t bytesOut);
+
+    /** Returns the number of routes, including the route for unmatched requests. */
+    size_t getRouteCount() const;
+
+    /**
+     * Copies the current metrics of a route.
+     * @param index The index of the route, from 0 to getRouteCount() - 1.
+     * @return A boolean indicating if the index was valid.
+     */
+    bool getSnapshot(size_t index, RouteMetricsSnapshot &out) const;
+
+    /** Writes all metrics to a response in the Prometheus text exposition format. */
+    void writePrometheus(Response &res) const;
+
+    /** Returns the upper bound in microseconds of a latency histogram bucket, or 0 for the last bucket which has no bound. */
+    static unsigned long getBucketBound(uint8_t bucket);
+  };
+}// namespace OTF
+
+#endif
+#endif
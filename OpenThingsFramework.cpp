@@ -4,14 +4,102 @@
 
 // The timeout for reading and parsing incoming requests.
 #define WIFI_CONNECTION_TIMEOUT 1500
-/* How often to try to reconnect to the websocket if the connection is lost. Each reconnect attempt is blocking and has
- * a 5 second timeout.
+/* How long to wait before trying to reconnect to the websocket if the connection is lost. The delay doubles after each
+ * failed attempt up to WEBSOCKET_RECONNECT_MAX_INTERVAL.
  */
 #define WEBSOCKET_RECONNECT_INTERVAL 5000
 
+#define CLOUD_PREFIX_LENGTH 5
+// Length of the prefix, request ID, carriage return, and line feed.
+#define CLOUD_HEADER_LENGTH (CLOUD_PREFIX_LENGTH + CLOUD_ID_LENGTH + 2)
+
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+#define LOOP_LAP(phase) loopWatchdog.lap(phase)
+#define LOOP_LAP_HANDLER(request) loopWatchdog.lapHandler(request)
+#else
+#define LOOP_LAP(phase)
+#define LOOP_LAP_HANDLER(request)
+#endif
+
 using namespace OTF;
 
-OpenThingsFramework::OpenThingsFramework(uint16_t webServerPort, char *hdBuffer, int hdBufferSize) : localServer(webServerPort) {
+OpenThingsFramework::OpenThingsFramework(uint16_t webServerPort, char *hdBuffer, int hdBufferSize) {
+  defaultLocalServer = new LOCAL_SERVER_CLASS(webServerPort);
+  localServer = defaultLocalServer;
+  init(hdBuffer, hdBufferSize);
+}
+
+OpenThingsFramework::OpenThingsFramework(LocalServer &localServer, char *hdBuffer, int hdBufferSize) {
+  this->localServer = &localServer;
+  init(hdBuffer, hdBufferSize);
+}
+
+OpenThingsFramework::~OpenThingsFramework() {
+  // Close the cloud connection first, since it may still deliver events to the framework.
+  delete webSocket;
+  clearCloudQueue();
+  clearCloudPaths();
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+  delete cloudDeflater;
+  delete cloudInflater;
+#endif
+
+  // Release the deferred responses that haven't been sent. Callers may still hold handles to them.
+  while (parkedHead != nullptr) {
+    DeferredResponse *deferred = parkedHead;
+    scheduler.stop(deferred->timeoutTimer);
+    if (deferred->localClient != nullptr) {
+      deferred->localClient->stop();
+      delete deferred->localClient;
+      deferred->localClient = nullptr;
+    }
+    finishDeferredResponse(*deferred);
+    deferred->framework = nullptr;
+    if (!deferred->completed) {
+      deferred->self.reset();
+    }
+  }
+  while (completedHead != nullptr) {
+    DeferredResponse *deferred = completedHead;
+    completedHead = deferred->next;
+    deferred->framework = nullptr;
+    deferred->filler = nullptr;
+    deferred->self.reset();
+  }
+
+  delete websocketEndpoint;
+  for (LinkedMapNode<Route<EventStream *>> *node = eventStreams.head; node != nullptr; node = node->next) {
+    delete node->value.handler;
+  }
+  delete responseCache;
+
+  // The maps don't own their keys.
+  for (LinkedMapNode<Route<callback_t>> *node = callbacks.head; node != nullptr; node = node->next) {
+    delete[] node->key;
+  }
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+  for (LinkedMapNode<Route<coroutine_callback_t>> *node = coroutineCallbacks.head; node != nullptr; node = node->next) {
+    delete[] node->key;
+  }
+#endif
+  for (LinkedMapNode<Route<EventStream *>> *node = eventStreams.head; node != nullptr; node = node->next) {
+    delete[] node->key;
+  }
+#if defined(OTF_ENABLE_METRICS)
+  delete[] metricsRouteKey;
+#endif
+#if defined(OTF_ENABLE_TRACE)
+  delete[] traceRouteKey;
+#endif
+  delete[] websocketRouteKey;
+
+  if (ownsHeaderBuffer) {
+    delete[] headerBuffer;
+  }
+  delete defaultLocalServer;
+}
+
+void OpenThingsFramework::init(char *hdBuffer, int hdBufferSize) {
   OTF_DEBUG("Instantiating OTF...\n");
   if(hdBuffer != NULL) { // if header buffer is externally provided, use it directly
     headerBuffer = hdBuffer;
@@ -19,10 +107,20 @@ OpenThingsFramework::OpenThingsFramework(uint16_t webServerPort, char *hdBuffer,
   } else { // otherwise allocate one
     headerBuffer = new char[HEADERS_BUFFER_SIZE];
     headerBufferSize = HEADERS_BUFFER_SIZE;
+    ownsHeaderBuffer = true;
   }
   missingPageCallback = defaultMissingPageCallback;
-  localServer.begin();
-};
+  localClientTimer.setTask([this]() {
+    localClientTimedOut = true;
+  });
+  publishTimer.setTask([this]() {
+    flushEvents();
+  });
+  replayTimer.setTask([this]() {
+    replayEvents();
+  });
+  localServer->begin();
+}
 
 #if defined(ARDUINO)
 OpenThingsFramework::OpenThingsFramework(uint16_t webServerPort, const String &webSocketHost, uint16_t webSocketPort,
@@ -32,8 +130,13 @@ OpenThingsFramework::OpenThingsFramework(uint16_t webServerPort, const char* web
                                          const char* deviceKey, bool useSsl, char *hdBuffer, int hdBufferSize) : OpenThingsFramework(webServerPort, hdBuffer, hdBufferSize) {
 #endif
   setCloudStatus(UNABLE_TO_CONNECT);
+  resetCloudCompression();
   OTF_DEBUG(F("Initializing websocket...\n"));
+  #if defined(ARDUINO)
   webSocket = new WebsocketClient();
+  #else
+  webSocket = new WebsocketClient(scheduler);
+  #endif
 
   // Wrap the member function in a static function.
   webSocket->onEvent([this](WSEvent_t type, uint8_t *payload, size_t length) -> void {
@@ -43,18 +146,18 @@ OpenThingsFramework::OpenThingsFramework(uint16_t webServerPort, const char* web
 
   if (useSsl) {
     OTF_DEBUG(F("Connecting to websocket with SSL\n"));
-    // #if defined(ARDUINO)
+    #if defined(ARDUINO)
     // webSocket->connectSecure(webSocketHost, webSocketPort, "/socket/v1?deviceKey=" + deviceKey);
-    // #else
-    // std::string path = std::string("/socket/v1?deviceKey=") + deviceKey;
-    // webSocket->connectSecure(std::string(webSocketHost), webSocketPort, path);
-    // #endif
+    #else
+    std::string path = std::string("/socket/v1?deviceKey=") + deviceKey + CLOUD_BINARY_FRAMING_PARAM CLOUD_DEFLATE_PARAM;
+    webSocket->connectSecure(std::string(webSocketHost), webSocketPort, path);
+    #endif
   } else {
     OTF_DEBUG(F("Connecting to websocket without SSL\n"));
     #if defined(ARDUINO)
-    webSocket->connect(webSocketHost, webSocketPort, "/socket/v1?deviceKey=" + deviceKey);
+    webSocket->connect(webSocketHost, webSocketPort, "/socket/v1?deviceKey=" + deviceKey + CLOUD_BINARY_FRAMING_PARAM CLOUD_DEFLATE_PARAM);
     #else
-    std::string path = std::string("/socket/v1?deviceKey=") + deviceKey;
+    std::string path = std::string("/socket/v1?deviceKey=") + deviceKey + CLOUD_BINARY_FRAMING_PARAM CLOUD_DEFLATE_PARAM;
     webSocket->connect(std::string(webSocketHost), webSocketPort, path);
     #endif
   }
@@ -71,13 +174,58 @@ char *makeMapKey(StringBuilder *sb, HTTPMethod method, const char *path) {
   return sb->toString();
 }
 
+/** Allocates the map key of a route that is kept until the framework is destroyed. */
+static char *newMapKey(HTTPMethod method, const char *path) {
+  StringBuilder keyBuilder(KEY_MAX_LENGTH);
+  char *key = makeMapKey(&keyBuilder, method, path);
+  char *copy = new char[strlen(key) + 1];
+  strcpy(copy, key);
+  return copy;
+}
+
+void OpenThingsFramework::addRoute(char *key, callback_t callback) {
+  LinkedMapNode<Route<callback_t>> *existing = callbacks._findNode(key);
+  if (existing != nullptr) {
+    // Keep the original key, which the route's metrics refer to.
+    existing->value.handler = callback;
+    delete[] key;
+    return;
+  }
+
+  Route<callback_t> route;
+  route.handler = callback;
+#if defined(OTF_ENABLE_METRICS)
+  route.metrics = metrics.addRoute(key);
+#endif
+  callbacks.add(key, route);
+}
+
 void OpenThingsFramework::on(const char *path, callback_t callback, HTTPMethod method) {
-  callbacks.add(makeMapKey(new StringBuilder(KEY_MAX_LENGTH), method, path), callback);
+  addRoute(newMapKey(method, path), callback);
 }
 
 #if defined(ARDUINO)
 void OpenThingsFramework::on(const __FlashStringHelper *path, callback_t callback, HTTPMethod method) {
-  callbacks.add(makeMapKey(new StringBuilder(KEY_MAX_LENGTH), method, (char *) path), callback);
+  addRoute(newMapKey(method, (char *) path), callback);
+}
+#endif
+
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+void OpenThingsFramework::on(const char *path, coroutine_callback_t callback, HTTPMethod method) {
+  char *key = newMapKey(method, path);
+  LinkedMapNode<Route<coroutine_callback_t>> *existing = coroutineCallbacks._findNode(key);
+  if (existing != nullptr) {
+    existing->value.handler = callback;
+    delete[] key;
+    return;
+  }
+
+  Route<coroutine_callback_t> route;
+  route.handler = callback;
+#if defined(OTF_ENABLE_METRICS)
+  route.metrics = metrics.addRoute(key);
+#endif
+  coroutineCallbacks.add(key, route);
 }
 #endif
 
@@ -85,31 +233,39 @@ void OpenThingsFramework::onMissingPage(callback_t callback) {
   missingPageCallback = callback;
 }
 
-void OpenThingsFramework::localServerLoop() {
+void OpenThingsFramework::waitForLocalClient() {
+  waitingForLocalClient = true;
+  localClientTimedOut = false;
+  scheduler.start(localClientTimer, WIFI_CONNECTION_TIMEOUT);
+}
 
-  static unsigned long wait_to = 0; // timeout to wait for client data
-  if (!wait_to) {
-    localClient = localServer.acceptClient();
+void OpenThingsFramework::localServerLoop() {
+  if (!waitingForLocalClient) {
+    localClient = localServer->acceptClient();
+    LOOP_LAP(LOOP_ACCEPT);
     // If a client wasn't available from the server, exit the local server loop.
     if (!localClient) {
       return;
     }
+    OTF_TRACE(LOCAL_CLIENT_ACCEPTED, 0, 0);
     // set a timeout to wait for client data
-    wait_to = millis()+WIFI_CONNECTION_TIMEOUT;
+    waitForLocalClient();
   }
   if (!localClient->dataAvailable()) {
     // If data isn't available from the client yet, exit the local server loop and check again next iteration.
-    // but if we reached timeout, then reset wait_to to 0 and flush localClient so we can accept new client
-    if(millis()>wait_to) {
-      wait_to=0;
+    // but if the timer expired, then stop waiting and flush localClient so we can accept new client
+    if (localClientTimedOut) {
+      waitingForLocalClient = false;
       OTF_DEBUG(F("client wait timeout\n"));
+      OTF_TRACE(LOCAL_CLIENT_TIMEOUT, 0, 0);
       localClient->flush();
       localClient->stop();
     }
     return;
   }
-  // got new client data, reset wait_to to 0
-  wait_to = 0;
+  // got new client data, stop waiting
+  waitingForLocalClient = false;
+  scheduler.stop(localClientTimer);
 
 
   // Update the timeout for each data read to ensure that the total timeout is WIFI_CONNECTION_TIMEOUT.
@@ -124,9 +280,10 @@ void OpenThingsFramework::localServerLoop() {
   size_t length = 0;
   while (localClient->dataAvailable()&&millis()<timeout) {
     if (length >= headerBufferSize) {
+      OTF_TRACE(LOCAL_REQUEST_TOO_LARGE, length, 0);
       localClient->print(F("HTTP/1.1 413 Request too large\r\n\r\nThe request was too large"));
       // Get a new client to indicate that the previous client is no longer needed.
-      localClient = localServer.acceptClient();
+      localClient = localServer->acceptClient();
       return;
     }
 
@@ -150,12 +307,26 @@ void OpenThingsFramework::localServerLoop() {
   // Make sure that the headers were fully read into the buffer.
   if (strncmp_P(&buffer[length - 4], (char *) F("\r\n\r\n"), 4) != 0) {
     OTF_DEBUG(F("The request headers were not fully read into the buffer.\n"));
+    OTF_TRACE(LOCAL_REQUEST_TOO_LARGE, length, 0);
     localClient->print(F("HTTP/1.1 413 Request too large\r\n\r\nThe request was too large"));
     return;
   }
 
   OTF_DEBUG(F("Parsing request"));
+#if defined(OTF_ENABLE_METRICS)
+  requestTimer.begin(length);
+#endif
+  LOOP_LAP(LOOP_READ);
   Request request(buffer, length, false);
+  OTF_TRACE(REQUEST_PARSED, request.getType(), request.httpMethod);
+  LOOP_LAP(LOOP_PARSE);
+
+  if (request.getType() > INVALID && handOverLocalClient(request)) {
+    // The connection is kept open by its new owner, so the next client can be accepted immediately.
+    LOOP_LAP(LOOP_SEND);
+    acceptNextLocalClient();
+    return;
+  }
 
   char *bodyBuffer = NULL;
   // If the request was valid, read the body and add it to the Request object.
@@ -171,7 +342,7 @@ void OpenThingsFramework::localServerLoop() {
       // If the header specifies a length of 0 or could not be parsed, the message has no body.
       if (contentLength > 0) {
         // Read the body from the client.
-        bodyBuffer = new char[contentLength];
+        bodyBuffer = new char[contentLength + 1];
         size_t bodyLength = 0;
         timeout = millis()+WIFI_CONNECTION_TIMEOUT;
         while (localClient->dataAvailable() && millis()<timeout) {
@@ -188,50 +359,405 @@ void OpenThingsFramework::localServerLoop() {
         bodyBuffer[bodyLength] = 0;
         request.body = bodyBuffer;
         request.bodyLength = bodyLength;
+        OTF_TRACE(LOCAL_REQUEST_READ, length, bodyLength);
+#if defined(OTF_ENABLE_METRICS)
+        requestTimer.bytesIn += bodyLength;
+#endif
       }
     }
   }
+#if defined(OTF_ENABLE_METRICS)
+  requestTimer.lap(METRICS_PARSE);
+#endif
+  LOOP_LAP(LOOP_READ);
 
-  // Make response stream to client
   Response res = Response();
-  res.enableStream([this](const char *buffer, size_t length, bool first_message) -> void {
-    localClient->write(buffer, length);
-  }, [this]() -> void {
-    localClient->flush();
-  }, [this]() -> void {
-    localClient->flush();
-  });
+  startLocalResponse(res, localClient);
   fillResponse(request, res);
+#if defined(OTF_ENABLE_METRICS)
+  requestTimer.lap(METRICS_HANDLER);
+#endif
+  LOOP_LAP_HANDLER(request);
+
+  if (deferredRequest != nullptr) {
+    // The callback will respond later, so keep the connection open without sending anything.
+    if (responseCache != nullptr) {
+      responseCache->endCapture(false);
+    }
+    if(bodyBuffer) delete[] bodyBuffer;
+#if defined(OTF_ENABLE_METRICS)
+    metrics.record(requestTimer, METRICS_LOCAL, 0, 0);
+#endif
+    parkDeferredRequest(localServer->detachClient(), nullptr, TEXT_FRAMING);
+    acceptNextLocalClient();
+    return;
+  }
 
   // Make sure to end the stream if it was enabled.
   res.end();
+  if (responseCache != nullptr) {
+    responseCache->endCapture(res.isValid());
+  }
 
   if(bodyBuffer) delete[] bodyBuffer;
+  OTF_TRACE(RESPONSE_SENT, res.getTotalLength(), res.isValid());
   if (res.isValid()) {
     OTF_DEBUG("Sent response, %d bytes\n", res.getTotalLength());
   } else {
     localClient->print(F("HTTP/1.1 500 OTF error\r\nResponse string could not be built\r\n"));
     OTF_DEBUG(F("An error occurred while building the response string.\n"));
   }
+#if defined(OTF_ENABLE_METRICS)
+  requestTimer.lap(METRICS_SEND);
+  metrics.record(requestTimer, METRICS_LOCAL, res.isValid() ? res.statusCode : 500, res.getTotalLength());
+#endif
 
   // Properly close the client connection.
   localClient->flush();
   localClient->stop();
+  LOOP_LAP(LOOP_SEND);
+
+  acceptNextLocalClient();
+  OTF_DEBUG(F("Finished handling request\n"));
+}
 
+bool OpenThingsFramework::handOverLocalClient(const Request &request) {
+  if ((websocketEndpoint == nullptr && eventStreams.head == nullptr) || request.httpMethod != HTTP_GET) {
+    return false;
+  }
+
+  StringBuilder keyBuilder(KEY_MAX_LENGTH);
+  char *key = makeMapKey(&keyBuilder, HTTP_GET, request.getPath());
+  if (websocketEndpoint != nullptr && strcmp(key, websocketRouteKey) == 0 && WebsocketEndpoint::isUpgradeRequest(request)) {
+    OTF_TRACE(REQUEST_ROUTED, true, false);
+    websocketEndpoint->accept(request, localServer->detachClient());
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.route = websocketRouteMetrics;
+    metrics.record(requestTimer, METRICS_LOCAL, 101, 0);
+#endif
+    return true;
+  }
+
+  LinkedMapNode<Route<EventStream *>> *stream = eventStreams._findNode(key);
+  if (stream != nullptr) {
+    OTF_TRACE(REQUEST_ROUTED, true, false);
+    stream->value.handler->accept(request, localServer->detachClient());
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.route = stream->value.metrics;
+    metrics.record(requestTimer, METRICS_LOCAL, 200, 0);
+#endif
+    return true;
+  }
+  return false;
+}
+
+void OpenThingsFramework::acceptNextLocalClient() {
   // Get a new client to indicate that the previous client is no longer needed.
-  localClient = localServer.acceptClient();
+  localClient = localServer->acceptClient();
+  LOOP_LAP(LOOP_ACCEPT);
   if (localClient) {
     OTF_DEBUG(F("Accepted new client\n"));
-    wait_to = millis()+WIFI_CONNECTION_TIMEOUT;
+    OTF_TRACE(LOCAL_CLIENT_ACCEPTED, 0, 0);
+    waitForLocalClient();
   }
+}
 
-  OTF_DEBUG(F("Finished handling request\n"));
+void OpenThingsFramework::startLocalResponse(Response &res, LocalClient *client) {
+  // Make response stream to client
+  res.enableStream([this, client](const char *buffer, size_t length, bool first_message) -> void {
+    if (responseCache != nullptr) {
+      responseCache->capture(buffer, length);
+    }
+    client->write(buffer, length);
+  }, [client]() -> void {
+    client->flush();
+  }, [client]() -> void {
+    client->flush();
+  });
+}
+
+#if !defined(ARDUINO)
+bool OpenThingsFramework::enableLocalTls(const char *certFile, const char *keyFile) {
+  return defaultLocalServer != nullptr && defaultLocalServer->enableTls(certFile, keyFile);
 }
+#endif
 
 void OpenThingsFramework::loop() {
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+  loopWatchdog.beginLoop();
+#endif
   localServerLoop();
+  // Attribute the time after the last lap, such as waiting for a client that has not sent its request yet.
+  LOOP_LAP(LOOP_READ);
   if (webSocket != nullptr) {
     webSocket->poll();
+    LOOP_LAP(LOOP_WEBSOCKET);
+    cloudRequestLoop();
+  }
+#if !defined(ARDUINO)
+  taskQueue.drain();
+  LOOP_LAP(LOOP_TIMERS);
+#endif
+  deferredResponseLoop();
+  LOOP_LAP(LOOP_SEND);
+  if (websocketEndpoint != nullptr) {
+    websocketEndpoint->loop();
+    LOOP_LAP(LOOP_WEBSOCKET);
+  }
+  for (LinkedMapNode<Route<EventStream *>> *node = eventStreams.head; node != nullptr; node = node->next) {
+    node->value.handler->loop();
+  }
+  LOOP_LAP(LOOP_SEND);
+  scheduler.run();
+  LOOP_LAP(LOOP_TIMERS);
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+  if (loopWatchdog.endLoop()) {
+    const LoopOverrun &overrun = loopWatchdog.getLastOverrun();
+    OTF_TRACE(LOOP_BUDGET_EXCEEDED, overrun.duration, overrun.handlerDuration);
+    OTF_DEBUG((char *) F("loop() took %lu us, longest handler was %lu us for '%s'\n"), overrun.duration,
+              overrun.handlerDuration, overrun.path);
+  }
+#endif
+}
+
+void OpenThingsFramework::queueCloudRequest(const char *requestId, const char *data, size_t length, CloudFraming framing) {
+  if (cloudQueueLength >= CLOUD_QUEUE_MAX_REQUESTS || cloudQueueBytes + length > CLOUD_QUEUE_MAX_BYTES) {
+    // Reject the request immediately instead of letting it time out in the cloud.
+    OTF_DEBUG(F("Cloud request queue is full\n"));
+    OTF_TRACE(CLOUD_REQUEST_REJECTED, cloudQueueLength, length);
+    StringBuilder builder(100);
+    if (framing == TEXT_FRAMING) {
+      builder.bprintf(F("RES: "));
+      builder.write(requestId, CLOUD_ID_LENGTH);
+      builder.bprintf(F("\r\n"));
+    } else {
+      char frameType = (char) CLOUD_FRAME_RESPONSE;
+      builder.write(&frameType, 1);
+      builder.write(requestId, CLOUD_ID_LENGTH);
+    }
+    builder.bprintf(F("HTTP/1.1 503 Service Unavailable\r\nretry-after: 1\r\n\r\nToo many pending requests"));
+    if (builder.isValid()) {
+      if (framing == TEXT_FRAMING) {
+        webSocket->send(builder.toString(), builder.getLength());
+      } else {
+        webSocket->sendBinary(builder.toString(), builder.getLength());
+      }
+    }
+    return;
+  }
+
+  // The payload is only valid for the duration of the event callback, so the request must be copied.
+  CloudRequest *request = new CloudRequest();
+  memcpy(request->id, requestId, CLOUD_ID_LENGTH);
+  request->id[CLOUD_ID_LENGTH] = '\0';
+  // Allocate an extra byte so the parser never reads past the end of the buffer.
+  request->data = new char[length + 1];
+  memcpy(request->data, data, length);
+  request->data[length] = '\0';
+  request->length = length;
+  request->framing = framing;
+
+  if (cloudQueueTail == nullptr) {
+    cloudQueueHead = request;
+  } else {
+    cloudQueueTail->next = request;
+  }
+  cloudQueueTail = request;
+  cloudQueueLength++;
+  cloudQueueBytes += length;
+  OTF_DEBUG((char *) F("Queued cloud request %s (%d pending)\n"), request->id, (int) cloudQueueLength);
+  OTF_TRACE(CLOUD_REQUEST_QUEUED, framing, length);
+}
+
+void OpenThingsFramework::defineCloudPath(const uint8_t *payload, size_t length) {
+  if (length < 4) {
+    return;
+  }
+
+  uint16_t pathId = (payload[0] << 8) | payload[1];
+  size_t pathLength = (payload[2] << 8) | payload[3];
+  if (pathId == 0 || pathId > CLOUD_MAX_PATHS || 4 + pathLength != length || memchr(&payload[4], '\0', pathLength) != nullptr) {
+    OTF_DEBUG(F("Invalid path definition\n"));
+    return;
+  }
+
+  char *path = new char[pathLength + 1];
+  memcpy(path, &payload[4], pathLength);
+  path[pathLength] = '\0';
+  delete[] cloudPaths[pathId - 1];
+  cloudPaths[pathId - 1] = path;
+  OTF_DEBUG((char *) F("Defined path %d as '%s'\n"), pathId, path);
+}
+
+void OpenThingsFramework::clearCloudPaths() {
+  for (size_t i = 0; i < CLOUD_MAX_PATHS; i++) {
+    delete[] cloudPaths[i];
+    cloudPaths[i] = nullptr;
+  }
+}
+
+void OpenThingsFramework::resetCloudCompression() {
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+  delete cloudDeflater;
+  delete cloudInflater;
+  cloudDeflater = new MessageDeflater(CLOUD_DEFLATE_CLIENT_WINDOW_BITS, CLOUD_DEFLATE_MEM_LEVEL, CLOUD_DEFLATE_CLIENT_CONTEXT_TAKEOVER);
+  cloudInflater = new MessageInflater(CLOUD_DEFLATE_SERVER_WINDOW_BITS, CLOUD_DEFLATE_SERVER_CONTEXT_TAKEOVER);
+#endif
+}
+
+void OpenThingsFramework::clearCloudQueue() {
+  while (cloudQueueHead != nullptr) {
+    CloudRequest *next = cloudQueueHead->next;
+    delete[] cloudQueueHead->data;
+    delete cloudQueueHead;
+    cloudQueueHead = next;
+  }
+  cloudQueueTail = nullptr;
+  cloudQueueLength = 0;
+  cloudQueueBytes = 0;
+}
+
+void OpenThingsFramework::cloudRequestLoop() {
+  // Only handle a limited number of requests per iteration so local requests and the websocket keep being serviced.
+  for (int i = 0; i < CLOUD_REQUESTS_PER_LOOP && cloudQueueHead != nullptr; i++) {
+    CloudRequest *request = cloudQueueHead;
+    cloudQueueHead = request->next;
+    if (cloudQueueHead == nullptr) {
+      cloudQueueTail = nullptr;
+    }
+    cloudQueueLength--;
+    cloudQueueBytes -= request->length;
+    OTF_TRACE(CLOUD_REQUEST_STARTED, request->framing, cloudQueueLength);
+
+    handleCloudRequest(request->id, request->data, request->length, request->framing);
+
+    delete[] request->data;
+    delete request;
+  }
+}
+
+void OpenThingsFramework::handleCloudRequest(const char *requestId, char *data, size_t length, CloudFraming framing) {
+#if defined(OTF_ENABLE_METRICS)
+  requestTimer.begin(length);
+#endif
+  if (framing == TEXT_FRAMING) {
+    Request request(data, length, true);
+    OTF_TRACE(REQUEST_PARSED, request.getType(), request.httpMethod);
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.lap(METRICS_PARSE);
+#endif
+    LOOP_LAP(LOOP_PARSE);
+    respondToCloudRequest(requestId, request, framing);
+  } else {
+    Request request(data, length, cloudPaths, CLOUD_MAX_PATHS);
+    OTF_TRACE(REQUEST_PARSED, request.getType(), request.httpMethod);
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.lap(METRICS_PARSE);
+#endif
+    LOOP_LAP(LOOP_PARSE);
+    respondToCloudRequest(requestId, request, framing);
+  }
+}
+
+void OpenThingsFramework::respondToCloudRequest(const char *requestId, const Request &request, CloudFraming framing) {
+  Response res = Response();
+  startCloudResponse(res, requestId, framing);
+  fillResponse(request, res);
+#if defined(OTF_ENABLE_METRICS)
+  requestTimer.lap(METRICS_HANDLER);
+#endif
+  LOOP_LAP_HANDLER(request);
+
+  if (deferredRequest != nullptr) {
+    // Nothing has been sent yet, since the response buffer is larger than the prefix.
+    if (responseCache != nullptr) {
+      responseCache->endCapture(false);
+    }
+#if defined(OTF_ENABLE_METRICS)
+    metrics.record(requestTimer, METRICS_CLOUD, 0, 0);
+#endif
+    parkDeferredRequest(nullptr, requestId, framing);
+    return;
+  }
+
+  // Make sure to end the stream if it was enabled.
+  res.end();
+  if (responseCache != nullptr) {
+    responseCache->endCapture(res.isValid());
+  }
+  LOOP_LAP(LOOP_SEND);
+#if defined(OTF_ENABLE_METRICS)
+  requestTimer.lap(METRICS_SEND);
+  metrics.record(requestTimer, METRICS_CLOUD, res.statusCode, res.getTotalLength());
+#endif
+
+  OTF_TRACE(RESPONSE_SENT, res.getTotalLength(), res.isValid());
+  if (res.isValid()) {
+    OTF_DEBUG("Sent response, %d bytes\n", res.getTotalLength());
+  } else {
+    OTF_DEBUG(F("An error occurred building response string\n"));
+  }
+}
+
+void OpenThingsFramework::startCloudResponse(Response &res, const char *requestId, CloudFraming framing) {
+  // Make response stream to websocket. Each response is sent as a single message tagged with its request ID.
+  res.enableStream([this, framing] (const char *buffer, size_t length, bool first_message) -> void {
+    if (responseCache != nullptr) {
+      responseCache->capture(buffer, length);
+    }
+
+    // If the websocket is not already streaming, start streaming.
+    if (first_message) {
+      WS_DEBUG("Starting stream\n");
+      webSocket->stream(framing != TEXT_FRAMING);
+
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+      if (framing == DEFLATE_FRAMING) {
+        // The frame type and request ID are not compressed.
+        webSocket->send(buffer, 1 + CLOUD_ID_LENGTH);
+        buffer += 1 + CLOUD_ID_LENGTH;
+        length -= 1 + CLOUD_ID_LENGTH;
+      }
+#endif
+    }
+
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+    if (framing == DEFLATE_FRAMING) {
+      cloudDeflater->write(buffer, length, [this](const char *data, size_t length) -> void {
+        webSocket->send(data, length);
+      });
+      return;
+    }
+#endif
+
+    // Send the buffer to the websocket stream.
+    webSocket->send(buffer, length);
+  }, [] () -> void {
+    // Partial frames are sent when the stream ends, so the last frame of the message isn't empty.
+  },
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+  [this, framing] () -> void {
+    if (framing == DEFLATE_FRAMING) {
+      cloudDeflater->finish([this](const char *data, size_t length) -> void {
+        webSocket->send(data, length);
+      });
+    }
+#else
+  [this] () -> void {
+#endif
+    // End the websocket stream.
+    webSocket->end();
+  });
+
+  // Request IDs are opaque and may contain null bytes, so they are written by length.
+  if (framing == TEXT_FRAMING) {
+    res.bprintf(F("RES: "));
+    res.write(requestId, CLOUD_ID_LENGTH);
+    res.bprintf(F("\r\n"));
+  } else {
+    char frameType = (char) (framing == DEFLATE_FRAMING ? CLOUD_FRAME_RESPONSE_DEFLATE : CLOUD_FRAME_RESPONSE);
+    res.write(&frameType, 1);
+    res.write(requestId, CLOUD_ID_LENGTH);
   }
 }
 
@@ -239,18 +765,35 @@ void OpenThingsFramework::webSocketEventCallback(WSEvent_t type, uint8_t *payloa
   switch (type) {
     case WSEvent_DISCONNECTED: {
       OTF_DEBUG(F("Websocket connection closed\n"));
+      OTF_TRACE(WEBSOCKET_DISCONNECTED, 0, 0);
       if (cloudStatus == CONNECTED) {
         // Make sure the cloud status is only set to disconnected if it was previously connected.
         setCloudStatus(DISCONNECTED);
         this->webSocket->resetStreaming();
       }
+      // Responses to queued and deferred requests can't be delivered over a new connection.
+      clearCloudQueue();
+      dropCloudDeferredResponses();
+      clearCloudPaths();
+      cloudBinaryFraming = false;
+      scheduler.stop(replayTimer);
       break;
     }
 
     case WSEvent_CONNECTED: {
       OTF_DEBUG(F("Websocket connection opened\n"));
+      OTF_TRACE(WEBSOCKET_CONNECTED, 0, 0);
       setCloudStatus(CONNECTED);
       this->webSocket->resetStreaming();
+      clearCloudQueue();
+      dropCloudDeferredResponses();
+      clearCloudPaths();
+      cloudBinaryFraming = false;
+      resetCloudCompression();
+      if (!outboundQueue.isEmpty()) {
+        // Give the server a moment to send anything it needs to before the backlog.
+        scheduler.start(replayTimer, OUTBOUND_REPLAY_INTERVAL, OUTBOUND_REPLAY_INTERVAL);
+      }
       break;
     }
 
@@ -265,62 +808,44 @@ void OpenThingsFramework::webSocketEventCallback(WSEvent_t type, uint8_t *payloa
     }
 
     case WSEvent_TEXT: {
-      #define PREFIX_LENGTH 5
-      #define ID_LENGTH 4
-      // Length of the prefix, request ID, carriage return, and line feed.
-      #define HEADER_LENGTH PREFIX_LENGTH + ID_LENGTH + 2
-
       char *message_data = (char*) payload;
 
-      if (strncmp_P(message_data, (char *) F("FWD: "), PREFIX_LENGTH) == 0) {
+      if (length >= CLOUD_HEADER_LENGTH && strncmp_P(message_data, (char *) F("FWD: "), CLOUD_PREFIX_LENGTH) == 0) {
         OTF_DEBUG(F("Message is a forwarded request.\n"));
-        char *requestId = &message_data[PREFIX_LENGTH];
-        // Replace the assumed carriage return with a null character to terminate the ID string.
-        requestId[ID_LENGTH] = '\0';
-
-        Request request(&message_data[HEADER_LENGTH], length - HEADER_LENGTH, true);
-        Response res = Response();
-        // Make response stream to websocket
-        res.enableStream([this] (const char *buffer, size_t length, bool first_message) -> void {
-          // If the websocket is not already streaming, start streaming.
-          if (first_message) {
-            WS_DEBUG("Starting stream\n");
-            webSocket->stream();
-          }
-
-          // Send the buffer to the websocket stream.
-          webSocket->send(buffer, length);
-        }, [this] () -> void {
-          // Flush the websocket stream.
-          webSocket->send("", 0);
-        }, [this] () -> void {
-          // End the websocket stream.
-          webSocket->end();
-        });
-
-        res.bprintf(F("RES: %s\r\n"), requestId);
-        fillResponse(request, res);
-        // Make sure to end the stream if it was enabled.
-        res.end();
-
-        if (res.isValid()) {
-          OTF_DEBUG("Sent response, %d bytes\n", res.getTotalLength());
-        } else {
-          OTF_DEBUG(F("An error occurred building response string\n"));
-          StringBuilder builder(100);
-          builder.bprintf(F("RES: %s\r\n%s"), requestId,
-                          F("HTTP/1.1 500 Internal Error\r\n\r\nAn internal error occurred"));
-          if (!builder.isValid()) {
-            OTF_DEBUG(F("Builder is not valid\n"));
-            return;
-          }
-        }
+        queueCloudRequest(&message_data[CLOUD_PREFIX_LENGTH], &message_data[CLOUD_HEADER_LENGTH], length - CLOUD_HEADER_LENGTH, TEXT_FRAMING);
       } else {
         OTF_DEBUG(F("Websocket message does not start with the correct prefix.\n"));
       }
       break;
     }
     
+    case WSEvent_BIN: {
+      cloudBinaryFraming = true;
+      if (length >= 1 + CLOUD_ID_LENGTH && payload[0] == CLOUD_FRAME_REQUEST) {
+        OTF_DEBUG(F("Message is a binary forwarded request.\n"));
+        queueCloudRequest((char *) &payload[1], (char *) &payload[1 + CLOUD_ID_LENGTH], length - 1 - CLOUD_ID_LENGTH, BINARY_FRAMING);
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+      } else if (length >= 1 + CLOUD_ID_LENGTH && payload[0] == CLOUD_FRAME_REQUEST_DEFLATE) {
+        OTF_DEBUG(F("Message is a compressed binary forwarded request.\n"));
+        // Compressed requests must be decompressed in the order they were received since the window carries over.
+        size_t inflatedLength;
+        char *inflated = cloudInflater->inflateMessage((char *) &payload[1 + CLOUD_ID_LENGTH], length - 1 - CLOUD_ID_LENGTH,
+                                                       CLOUD_QUEUE_MAX_BYTES, inflatedLength);
+        if (inflated != nullptr) {
+          queueCloudRequest((char *) &payload[1], inflated, inflatedLength, DEFLATE_FRAMING);
+          delete[] inflated;
+        } else {
+          OTF_DEBUG(F("Could not decompress request\n"));
+        }
+#endif
+      } else if (length >= 1 && payload[0] == CLOUD_FRAME_DEFINE_PATH) {
+        defineCloudPath(&payload[1], length - 1);
+      } else {
+        OTF_DEBUG(F("Binary websocket message has an unknown frame type.\n"));
+      }
+      break;
+    }
+
     default: {
       OTF_DEBUG((char *) F("Received unsupported websocket event of type %d\n"), type);
       break;
@@ -340,27 +865,564 @@ void OpenThingsFramework::fillResponse(const Request &req, Response &res) {
   OTF_DEBUG((char *) F("Attempting to route request to path '%s'\n"), req.getPath());
   StringBuilder *sb = new StringBuilder(KEY_MAX_LENGTH);
   char *key = makeMapKey(sb, req.httpMethod, req.getPath());
-  callback_t callback = callbacks.find(key);
+
+#if defined(OTF_ENABLE_METRICS)
+  if (metricsRouteKey != nullptr && strcmp(key, metricsRouteKey) == 0) {
+    delete sb;
+    requestTimer.route = metricsRouteMetrics;
+    res.writeStatus(200, F("OK"));
+    res.writeHeader(F("content-type"), F("text/plain; version=0.0.4"));
+    res.writeBodyData("", 0);
+    metrics.writePrometheus(res);
+    return;
+  }
+#endif
+#if defined(OTF_ENABLE_TRACE)
+  if (traceRouteKey != nullptr && strcmp(key, traceRouteKey) == 0) {
+    delete sb;
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.route = traceRouteMetrics;
+#endif
+    res.writeStatus(200, F("OK"));
+    res.writeHeader(F("content-type"), F("application/octet-stream"));
+    res.writeBodyData("", 0);
+    Trace::dump(res);
+    return;
+  }
+#endif
+
+  if (websocketRouteKey != nullptr && strcmp(key, websocketRouteKey) == 0) {
+    // Upgrade requests from local clients are handled before routing, so this request can't be upgraded.
+    delete sb;
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.route = websocketRouteMetrics;
+#endif
+    res.writeStatus(426, F("Upgrade Required"));
+    res.writeHeader(F("upgrade"), F("websocket"));
+    res.writeHeader(F("content-type"), F("text/plain"));
+    res.writeBodyChunk(F("This path only accepts websocket connections from the local network"));
+    return;
+  }
+
+  LinkedMapNode<Route<EventStream *>> *stream = eventStreams._findNode(key);
+  if (stream != nullptr) {
+    // Local requests for event streams are handled before routing, so this request was forwarded from the cloud.
+    delete sb;
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.route = stream->value.metrics;
+#endif
+    res.writeStatus(501, F("Not Implemented"));
+    res.writeHeader(F("content-type"), F("text/plain"));
+    res.writeBodyChunk(F("Event streams are only available from the local network"));
+    return;
+  }
+
+  LinkedMapNode<Route<callback_t>> *route = callbacks._findNode(key);
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+  LinkedMapNode<Route<coroutine_callback_t>> *coroutineRoute = route == nullptr ? coroutineCallbacks._findNode(key) : nullptr;
+#endif
 
   // If there isn't a callback for the specific method, check if there's one for any method.
-  if (callback == nullptr) {
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+  if (route == nullptr && coroutineRoute == nullptr) {
+#else
+  if (route == nullptr) {
+#endif
     delete sb;
     sb = new StringBuilder(KEY_MAX_LENGTH);
 
-    callback = callbacks.find(makeMapKey(sb, HTTP_ANY, req.getPath()));
+    key = makeMapKey(sb, HTTP_ANY, req.getPath());
+    route = callbacks._findNode(key);
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+    if (route == nullptr) {
+      coroutineRoute = coroutineCallbacks._findNode(key);
+    }
+#endif
   }
 
   delete sb;
 
-  if (callback != nullptr) {
+  // Let the callback park the request with Response::defer().
+  res.deferHandler = [this](unsigned long timeout) -> std::shared_ptr<DeferredResponse> {
+    return deferRequest(timeout);
+  };
+
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+  if (coroutineRoute != nullptr) {
+    OTF_DEBUG(F("Found coroutine callback\n"));
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.route = coroutineRoute->value.metrics;
+#endif
+    OTF_TRACE(REQUEST_ROUTED, true, false);
+    startCoroutine(coroutineRoute->value.handler, req, res);
+    return;
+  }
+#endif
+
+  if (route != nullptr) {
     OTF_DEBUG(F("Found callback\n"));
-    callback(req, res);
+#if defined(OTF_ENABLE_METRICS)
+    requestTimer.route = route->value.metrics;
+#endif
+    unsigned long ttl = (responseCache != nullptr && req.httpMethod == HTTP_GET) ? responseCache->getTtl(req.getPath()) : 0;
+    if (ttl > 0) {
+      StringBuilder keyBuilder(CACHE_KEY_MAX_LENGTH);
+      if (ResponseCache::makeKey(keyBuilder, req)) {
+        const ResponseCache::Entry *entry = responseCache->find(keyBuilder.toString());
+        if (entry != nullptr) {
+          OTF_DEBUG(F("Serving cached response\n"));
+          OTF_TRACE(REQUEST_ROUTED, true, true);
+          res.write(entry->data, entry->length);
+          // Only complete responses are cached, so the entry starts with the status line ("HTTP/1.1 200 ...").
+          if (entry->length > 12) {
+            res.statusCode = atoi(&entry->data[9]);
+          }
+          return;
+        }
+
+        // Anything already written to the response (such as the cloud response prefix) is not part of the cached response.
+        responseCache->beginCapture(keyBuilder.toString(), ttl, res.getTotalLength());
+      }
+    }
+
+    OTF_TRACE(REQUEST_ROUTED, true, false);
+    route->value.handler(req, res);
   } else {
     // Run the missing page callback if none of the registered paths matched.
+    OTF_TRACE(REQUEST_ROUTED, false, false);
     missingPageCallback(req, res);
   }
 }
 
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+void OpenThingsFramework::startCoroutine(coroutine_callback_t callback, const Request &req, Response &res) {
+  /* The coroutine may outlive the request and response passed to the callback, so it gets its own copy of the request
+   * and a buffered response that is copied into the real one when it finishes.
+   */
+  struct CoroutineState {
+    Request *request;
+    Response response;
+    std::shared_ptr<DeferredResponse> deferred;
+    bool finished = false;
+
+    ~CoroutineState() {
+      delete request;
+    }
+  };
+
+  std::shared_ptr<CoroutineState> state(new CoroutineState());
+  state->request = req.copy();
+  if (state->request == nullptr) {
+    res.writeStatus(500, F("Internal Server Error"));
+    res.writeHeader(F("content-type"), F("text/plain"));
+    res.writeBodyChunk(F("Request could not be copied"));
+    return;
+  }
+
+  auto copyResponse = [state](Response &res) -> void {
+    res.write(state->response.toString(), state->response.getLength());
+    res.statusCode = state->response.statusCode;
+    if (!state->response.isValid()) {
+      res.valid = false;
+    }
+  };
+
+  callback(*state->request, state->response).detach([state, copyResponse]() -> void {
+    state->finished = true;
+    if (state->deferred != nullptr) {
+      // The coroutine is resumed from loop(), so the response doesn't have to be posted.
+      state->deferred->queueCompletion(copyResponse);
+    }
+  });
+
+  if (state->finished) {
+    // The coroutine finished without suspending, so there is nothing to wait for.
+    copyResponse(res);
+    return;
+  }
+
+  state->deferred = res.defer(COROUTINE_RESPONSE_TIMEOUT);
+  if (state->deferred == nullptr) {
+    // The coroutine keeps running, but its response is discarded.
+    res.writeStatus(503, F("Service Unavailable"));
+    res.writeHeader(F("content-type"), F("text/plain"));
+    res.writeBodyChunk(F("Too many pending requests"));
+  }
+}
+#endif
+
+std::shared_ptr<DeferredResponse> OpenThingsFramework::deferRequest(unsigned long timeout) {
+  if (deferredCount >= DEFERRED_RESPONSE_MAX) {
+    OTF_DEBUG(F("Too many deferred responses\n"));
+    return nullptr;
+  }
+
+  std::shared_ptr<DeferredResponse> deferred(new DeferredResponse(this, timeout));
+  // The framework keeps the response alive until it has been sent, even if the callback drops its handle.
+  deferred->self = deferred;
+  deferredRequest = deferred.get();
+  deferredCount++;
+  return deferred;
+}
+
+void OpenThingsFramework::parkDeferredRequest(LocalClient *client, const char *requestId, CloudFraming framing) {
+  DeferredResponse *deferred = deferredRequest;
+  deferredRequest = nullptr;
+  deferred->localClient = client;
+  if (requestId != nullptr) {
+    memcpy(deferred->cloudRequestId, requestId, CLOUD_ID_LENGTH);
+  }
+  deferred->framing = framing;
+  deferred->parkedNext = parkedHead;
+  parkedHead = deferred;
+  OTF_DEBUG(F("Deferred response\n"));
+  OTF_TRACE(RESPONSE_DEFERRED, deferred->timeout, requestId != nullptr);
+  scheduler.start(deferred->timeoutTimer, deferred->timeout);
+}
+
+void OpenThingsFramework::deferredResponseLoop() {
+  DeferredResponse *deferred = completedHead;
+  completedHead = nullptr;
+  completedTail = &completedHead;
+
+  while (deferred != nullptr) {
+    DeferredResponse *next = deferred->next;
+    scheduler.stop(deferred->timeoutTimer);
+    // Responses to forwarded requests are dropped if the connection was lost after they were completed.
+    if (!deferred->finished) {
+      sendDeferredResponse(*deferred, deferred->filler);
+    }
+    // Release the handle last, since it may be the last reference to the response.
+    deferred->filler = nullptr;
+    deferred->self.reset();
+    deferred = next;
+  }
+}
+
+void OpenThingsFramework::timeoutDeferredResponse(DeferredResponse &deferred) {
+  // A response that was completed just before the timeout is sent by deferredResponseLoop().
+  if (deferred.completed) {
+    return;
+  }
+
+  OTF_DEBUG(F("Deferred response timed out\n"));
+  sendDeferredResponse(deferred, [](Response &res) -> void {
+    res.writeStatus(504, F("Gateway Timeout"));
+    res.writeHeader(F("content-type"), F("text/plain"));
+    res.writeBodyChunk(F("The response was not completed in time"));
+  });
+
+  // This is running from the response's own timer, so release it once the timer is done.
+  std::shared_ptr<DeferredResponse> self = deferred.self;
+  deferred.self.reset();
+  scheduler.defer([self]() -> void {});
+}
+
+void OpenThingsFramework::sendDeferredResponse(DeferredResponse &deferred, const response_filler_t &filler) {
+  // Finish the response first, so it isn't dropped if sending it closes the cloud connection.
+  finishDeferredResponse(deferred);
+  Response res = Response();
+  if (deferred.localClient != nullptr) {
+    startLocalResponse(res, deferred.localClient);
+  } else {
+    startCloudResponse(res, deferred.cloudRequestId, deferred.framing);
+  }
+  filler(res);
+  res.end();
+
+  if (deferred.localClient != nullptr) {
+    if (!res.isValid()) {
+      deferred.localClient->print(F("HTTP/1.1 500 OTF error\r\nResponse string could not be built\r\n"));
+    }
+    deferred.localClient->flush();
+    deferred.localClient->stop();
+    delete deferred.localClient;
+    deferred.localClient = nullptr;
+  }
+
+  OTF_TRACE(DEFERRED_RESPONSE_SENT, res.statusCode, res.getTotalLength());
+  OTF_DEBUG("Sent deferred response, %d bytes\n", res.getTotalLength());
+}
+
+void OpenThingsFramework::finishDeferredResponse(DeferredResponse &deferred) {
+  DeferredResponse **link = &parkedHead;
+  while (*link != nullptr && *link != &deferred) {
+    link = &(*link)->parkedNext;
+  }
+  if (*link != nullptr) {
+    *link = deferred.parkedNext;
+  }
+  deferred.parkedNext = nullptr;
+  deferred.finished = true;
+  deferredCount--;
+}
+
+void OpenThingsFramework::dropCloudDeferredResponses() {
+  DeferredResponse *deferred = parkedHead;
+  while (deferred != nullptr) {
+    DeferredResponse *next = deferred->parkedNext;
+    if (deferred->localClient == nullptr) {
+      OTF_DEBUG(F("Dropping deferred response to a forwarded request\n"));
+      scheduler.stop(deferred->timeoutTimer);
+      finishDeferredResponse(*deferred);
+      // Completed responses are released by deferredResponseLoop(), since they are still in the completed list.
+      if (!deferred->completed) {
+        deferred->self.reset();
+      }
+    }
+    deferred = next;
+  }
+}
+
+DeferredResponse::DeferredResponse(OpenThingsFramework *framework, unsigned long timeout) : framework(framework), timeout(timeout) {
+  memset(cloudRequestId, 0, CLOUD_ID_LENGTH);
+  timeoutTimer.setTask([this]() -> void {
+    this->framework->timeoutDeferredResponse(*this);
+  });
+}
+
+bool DeferredResponse::complete(response_filler_t filler) {
+  if (framework == nullptr) {
+    return false;
+  }
+#if !defined(ARDUINO)
+  // Keep the response alive until the task runs, even if the caller drops its handle.
+  std::shared_ptr<DeferredResponse> deferred = shared_from_this();
+  return framework->post([deferred, filler]() -> void {
+    deferred->queueCompletion(filler);
+  });
+#else
+  queueCompletion(filler);
+  return true;
+#endif
+}
+
+void DeferredResponse::queueCompletion(response_filler_t filler) {
+  if (completed || finished) {
+    return;
+  }
+
+  completed = true;
+  this->filler = filler;
+  *framework->completedTail = this;
+  framework->completedTail = &next;
+}
+
+bool DeferredResponse::isFinished() const {
+  return finished;
+}
+
+void OpenThingsFramework::enableResponseCache(size_t maxBytes) {
+  if (responseCache == nullptr) {
+    responseCache = new ResponseCache(maxBytes);
+  }
+}
+
+void OpenThingsFramework::setCacheTtl(const char *path, unsigned long ttl) {
+  enableResponseCache();
+  responseCache->setTtl(path, ttl);
+}
+
+void OpenThingsFramework::invalidateCache(const char *path) {
+  if (responseCache != nullptr) {
+    responseCache->invalidate(path);
+  }
+}
+
+void OpenThingsFramework::invalidateCache() {
+  if (responseCache != nullptr) {
+    responseCache->invalidateAll();
+  }
+}
+
+#if defined(OTF_ENABLE_METRICS)
+void OpenThingsFramework::enableMetricsEndpoint(const char *path) {
+  if (metricsRouteKey == nullptr) {
+    metricsRouteKey = newMapKey(HTTP_GET, path);
+    metricsRouteMetrics = metrics.addRoute(metricsRouteKey);
+  }
+}
+
+const Metrics &OpenThingsFramework::getMetrics() const {
+  return metrics;
+}
+#endif
+
+#if defined(OTF_ENABLE_TRACE)
+void OpenThingsFramework::enableTraceEndpoint(const char *path) {
+  if (traceRouteKey == nullptr) {
+    traceRouteKey = newMapKey(HTTP_GET, path);
+#if defined(OTF_ENABLE_METRICS)
+    traceRouteMetrics = metrics.addRoute(traceRouteKey);
+#endif
+  }
+}
+#endif
+
+bool OpenThingsFramework::publish(const char *topic, const char *payload, EventPriority priority) {
+  return publish(topic, payload, strlen(payload), priority);
+}
+
+bool OpenThingsFramework::publish(const char *topic, const char *payload, size_t length, EventPriority priority) {
+  if (webSocket == nullptr) {
+    return false;
+  }
+
+  EventBatch::AddResult result = eventBatch.add(topic, payload, length, priority);
+  if (result == EventBatch::EVENT_BATCH_FULL) {
+    flushEvents();
+    result = eventBatch.add(topic, payload, length, priority);
+  }
+  if (result == EventBatch::EVENT_TOO_LARGE) {
+    OTF_DEBUG(F("Event is too large to publish\n"));
+    return false;
+  }
+  if (result == EventBatch::EVENT_INVALID_TOPIC) {
+    OTF_DEBUG(F("Event topic contains a space or control character\n"));
+    return false;
+  }
+
+  if (!publishTimer.isScheduled()) {
+    scheduler.start(publishTimer, PUBLISH_BATCH_WINDOW);
+  }
+  return true;
+}
+
+void OpenThingsFramework::flushEvents() {
+  scheduler.stop(publishTimer);
+  if (eventBatch.isEmpty()) {
+    return;
+  }
+
+  /* Queue the events behind any that haven't been replayed yet, so they are delivered in order. While a callback is
+   * streaming its response to a forwarded request, sending them would mix them into the response, so they are queued
+   * and replayed from loop() once the response has been sent.
+   */
+  if (cloudStatus != CONNECTED || !outboundQueue.isEmpty() || webSocket->streaming()) {
+    OTF_DEBUG(F("Queueing events until they can be sent\n"));
+    for (size_t i = 0; i < eventBatch.getCount(); i++) {
+      if (!outboundQueue.push(eventBatch.getTopic(i), eventBatch.getPayload(i), eventBatch.getPayloadLength(i),
+                              eventBatch.getPriority(i))) {
+        OTF_TRACE(EVENTS_DROPPED, 1, eventBatch.getPriority(i));
+      }
+    }
+    OTF_TRACE(EVENTS_QUEUED, eventBatch.getCount(), outboundQueue.getCount());
+    eventBatch.clear();
+    if (cloudStatus == CONNECTED && !replayTimer.isScheduled()) {
+      scheduler.start(replayTimer, 0, OUTBOUND_REPLAY_INTERVAL);
+    }
+    return;
+  }
+
+  StringBuilder builder(eventBatch.getEncodedLength() + 1);
+  eventBatch.encode(builder, cloudBinaryFraming ? CLOUD_FRAME_EVENTS : 0);
+  if (builder.isValid()) {
+    if (cloudBinaryFraming) {
+      webSocket->sendBinary(builder.toString(), builder.getLength());
+    } else {
+      webSocket->send(builder.toString(), builder.getLength());
+    }
+    OTF_TRACE(EVENTS_SENT, eventBatch.getCount(), builder.getLength());
+  } else {
+    OTF_DEBUG(F("An error occurred while encoding events\n"));
+  }
+  eventBatch.clear();
+}
+
+void OpenThingsFramework::replayEvents() {
+  if (cloudStatus != CONNECTED || outboundQueue.isEmpty()) {
+    scheduler.stop(replayTimer);
+    return;
+  }
+  if (webSocket->streaming()) {
+    // Try again once the response that is being streamed has been sent.
+    return;
+  }
+
+  StringBuilder builder(PUBLISH_MAX_BATCH_BYTES + 1);
+  size_t count = outboundQueue.encode(builder, cloudBinaryFraming ? CLOUD_FRAME_EVENTS : 0, PUBLISH_MAX_BATCH_BYTES);
+  if (!builder.isValid()) {
+    // This can't happen since queued events were small enough to publish, but don't get stuck on a bad event.
+    OTF_DEBUG(F("An error occurred while encoding queued events\n"));
+    outboundQueue.pop(count);
+    return;
+  }
+
+  bool sent = cloudBinaryFraming ? webSocket->sendBinary(builder.toString(), builder.getLength())
+                                 : webSocket->send(builder.toString(), builder.getLength());
+  if (sent) {
+    // Events are only removed once they have been sent, so a disconnect during the replay doesn't lose them.
+    outboundQueue.pop(count);
+    OTF_TRACE(EVENTS_REPLAYED, count, outboundQueue.getCount());
+  }
+  if (outboundQueue.isEmpty()) {
+    scheduler.stop(replayTimer);
+  }
+}
+
+size_t OpenThingsFramework::getQueuedEventCount() const {
+  return outboundQueue.getCount();
+}
+
+uint32_t OpenThingsFramework::getDroppedEventCount() const {
+  return outboundQueue.getDroppedCount();
+}
+
+WebsocketEndpoint &OpenThingsFramework::enableWebsocketEndpoint(const char *path) {
+  if (websocketEndpoint == nullptr) {
+    websocketEndpoint = new WebsocketEndpoint(scheduler);
+    websocketRouteKey = newMapKey(HTTP_GET, path);
+#if defined(OTF_ENABLE_METRICS)
+    websocketRouteMetrics = metrics.addRoute(websocketRouteKey);
+#endif
+  }
+  return *websocketEndpoint;
+}
+
+WebsocketEndpoint *OpenThingsFramework::getWebsocketEndpoint() {
+  return websocketEndpoint;
+}
+
+EventStream &OpenThingsFramework::enableEventStream(const char *path) {
+  EventStream *stream = getEventStream(path);
+  if (stream == nullptr) {
+    char *key = newMapKey(HTTP_GET, path);
+    Route<EventStream *> route;
+    route.handler = stream = new EventStream(scheduler);
+#if defined(OTF_ENABLE_METRICS)
+    route.metrics = metrics.addRoute(key);
+#endif
+    eventStreams.add(key, route);
+  }
+  return *stream;
+}
+
+EventStream *OpenThingsFramework::getEventStream(const char *path) {
+  StringBuilder keyBuilder(KEY_MAX_LENGTH);
+  LinkedMapNode<Route<EventStream *>> *node = eventStreams._findNode(makeMapKey(&keyBuilder, HTTP_GET, path));
+  return node != nullptr ? node->value.handler : nullptr;
+}
+
+Scheduler &OpenThingsFramework::getScheduler() {
+  return scheduler;
+}
+
+#if !defined(ARDUINO)
+bool OpenThingsFramework::post(task_t task) {
+  return taskQueue.push(task);
+}
+
+int OpenThingsFramework::getWakeupFd() const {
+  return taskQueue.getWakeupFd();
+}
+#endif
+
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+LoopWatchdog &OpenThingsFramework::getLoopWatchdog() {
+  return loopWatchdog;
+}
+#endif
+
 void OpenThingsFramework::defaultMissingPageCallback(const Request &req, Response &res) {
   res.writeStatus(404, F("Not found"));
   res.writeHeader(F("content-type"), F("text/plain"));
@@ -3,6 +3,16 @@
 
 #include "Request.h"
 #include "Response.h"
+#include "ResponseCache.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "LoopWatchdog.h"
+#include "Scheduler.h"
+#include "EventBatch.h"
+#include "OutboundQueue.h"
+#include "WebsocketEndpoint.h"
+#include "EventStream.h"
+#include "Coroutine.h"
 
 #if defined(ARDUINO)
 #include <Arduino.h>
@@ -17,6 +27,8 @@
 #else
 #include <stdint.h>
 #include "LinuxLocalServer.h"
+#include "TaskQueue.h"
+#include "LoopbackLocalServer.h"
 #define LOCAL_SERVER_CLASS LinuxLocalServer
 #endif
 
@@ -35,13 +47,114 @@
 #endif
 
 #include "Websocket.h"
+#include "Deflate.h"
 
 // The size of the buffer to store the incoming request line and headers (does not include body). Larger requests will be discarded.
 #define HEADERS_BUFFER_SIZE 1536
+// The length of the ID the cloud tags each forwarded request with.
+#define CLOUD_ID_LENGTH 4
+/*
+ * Servers that understand the binary framing parameter appended to the websocket path may forward requests as binary
+ * messages instead of text HTTP requests. Each response uses the same framing as its request, so servers that ignore
+ * the parameter keep using the text protocol. All integers are big-endian.
+ *
+ * Request:     CLOUD_FRAME_REQUEST, 4 byte request ID, 1 byte HTTPMethod, 2 byte path ID, [2 byte length, path if the
+ *              path ID is 0], 2 byte length, query (without the '?'), 1 byte header count, [1 byte length, lowercase
+ *              header name, 2 byte length, header value] for each header, 4 byte length, body
+ * Define path: CLOUD_FRAME_DEFINE_PATH, 2 byte path ID (1 to CLOUD_MAX_PATHS), 2 byte length, path
+ * Response:    CLOUD_FRAME_RESPONSE, 4 byte request ID, HTTP response
+ * Events:      CLOUD_FRAME_EVENTS, [1 byte length, topic, 2 byte length, payload] for each event
+ *
+ * Events published by the device use the binary framing once the server has sent a binary message on the connection,
+ * and the text framing described in EventBatch::encode() before that.
+ */
+#define CLOUD_BINARY_FRAMING_PARAM "&framing=binary"
+#define CLOUD_FRAME_REQUEST 0x01
+#define CLOUD_FRAME_DEFINE_PATH 0x02
+#define CLOUD_FRAME_REQUEST_DEFLATE 0x03
+#define CLOUD_FRAME_RESPONSE 0x81
+#define CLOUD_FRAME_RESPONSE_DEFLATE 0x83
+#define CLOUD_FRAME_EVENTS 0x84
+
+/*
+ * When built with OTF_ENABLE_DEFLATE (Linux only, requires zlib), the device also offers to compress the binary framing
+ * using the parameters of the permessage-deflate websocket extension (RFC 7692). Neither websocket library exposes
+ * extension negotiation or the RSV1 bit, so compressed messages are marked with their frame type instead:
+ *
+ * Compressed request:  CLOUD_FRAME_REQUEST_DEFLATE, 4 byte request ID, compressed request (from the method byte on)
+ * Compressed response: CLOUD_FRAME_RESPONSE_DEFLATE, 4 byte request ID, compressed HTTP response
+ *
+ * Each direction is a separate compression context. Responses to compressed requests are compressed, except for
+ * responses that reject the request before it is processed. The server must not compress with a larger window than
+ * CLOUD_DEFLATE_SERVER_WINDOW_BITS.
+ */
+#ifndef CLOUD_DEFLATE_CLIENT_WINDOW_BITS
+// The window size (9 to 15) the device compresses responses with. Smaller windows use less RAM.
+#define CLOUD_DEFLATE_CLIENT_WINDOW_BITS 15
+#endif
+#ifndef CLOUD_DEFLATE_SERVER_WINDOW_BITS
+// The largest window size (9 to 15) the server may compress requests with.
+#define CLOUD_DEFLATE_SERVER_WINDOW_BITS 15
+#endif
+#ifndef CLOUD_DEFLATE_MEM_LEVEL
+// The amount of memory (1 to 9) used for the compression state of responses.
+#define CLOUD_DEFLATE_MEM_LEVEL 8
+#endif
+#ifndef CLOUD_DEFLATE_CLIENT_CONTEXT_TAKEOVER
+// Set to 0 to reset the compression window of responses after each message.
+#define CLOUD_DEFLATE_CLIENT_CONTEXT_TAKEOVER 1
+#endif
+#ifndef CLOUD_DEFLATE_SERVER_CONTEXT_TAKEOVER
+// Set to 0 to ask the server to reset the compression window of requests after each message.
+#define CLOUD_DEFLATE_SERVER_CONTEXT_TAKEOVER 1
+#endif
+
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+#define OTF_STRINGIFY_(x) #x
+#define OTF_STRINGIFY(x) OTF_STRINGIFY_(x)
+#if CLOUD_DEFLATE_CLIENT_CONTEXT_TAKEOVER
+#define CLOUD_DEFLATE_CLIENT_CONTEXT_PARAM ""
+#else
+#define CLOUD_DEFLATE_CLIENT_CONTEXT_PARAM "&client_no_context_takeover"
+#endif
+#if CLOUD_DEFLATE_SERVER_CONTEXT_TAKEOVER
+#define CLOUD_DEFLATE_SERVER_CONTEXT_PARAM ""
+#else
+#define CLOUD_DEFLATE_SERVER_CONTEXT_PARAM "&server_no_context_takeover"
+#endif
+#define CLOUD_DEFLATE_PARAM "&deflate=1"                                                               \
+                            "&client_max_window_bits=" OTF_STRINGIFY(CLOUD_DEFLATE_CLIENT_WINDOW_BITS) \
+                            "&server_max_window_bits=" OTF_STRINGIFY(CLOUD_DEFLATE_SERVER_WINDOW_BITS) \
+                            CLOUD_DEFLATE_CLIENT_CONTEXT_PARAM CLOUD_DEFLATE_SERVER_CONTEXT_PARAM
+#else
+#define CLOUD_DEFLATE_PARAM ""
+#endif
+// The maximum number of paths the server may intern for the binary framing.
+#define CLOUD_MAX_PATHS 32
+// The maximum number of forwarded requests that may wait to be processed. Additional requests are rejected with a 503.
+#define CLOUD_QUEUE_MAX_REQUESTS 8
+// The maximum combined size in bytes of the forwarded requests waiting to be processed.
+#define CLOUD_QUEUE_MAX_BYTES 8192
+// The maximum number of queued forwarded requests to process in each call to loop().
+#define CLOUD_REQUESTS_PER_LOOP 1
+#ifndef DEFERRED_RESPONSE_MAX
+// The maximum number of responses that may be deferred at once. Response::defer() returns nullptr beyond this.
+#define DEFERRED_RESPONSE_MAX 4
+#endif
 
 namespace OTF {
   typedef void (*callback_t)(const Request &request, Response &response);
 
+  /** The handler of a route in a route map. */
+  template<typename Handler>
+  struct Route {
+    Handler handler;
+#if defined(OTF_ENABLE_METRICS)
+    /** The metrics of the route, looked up when the route is added so requests can be recorded without a lookup. */
+    MetricsRoute *metrics;
+#endif
+  };
+
   enum CLOUD_STATUS {
     /** Indicates that an OTC token was not specified on initialization. */
     NOT_ENABLED,
@@ -53,22 +166,224 @@ namespace OTF {
     CONNECTED
   };
 
+  /** The framing a forwarded request was received with. Each response is sent with the framing of its request. */
+  enum CloudFraming {
+    TEXT_FRAMING,
+    BINARY_FRAMING,
+    /** Binary framing compressed with the permessage-deflate payload format. */
+    DEFLATE_FRAMING
+  };
+
+  class OpenThingsFramework;
+
+  typedef std::function<void(Response &res)> response_filler_t;
+
+  /**
+   * A response that was deferred by its callback with Response::defer(). The connection (or the forwarded request) is
+   * kept open until complete() is called, or until the timeout passes and a 504 response is sent instead. Other requests
+   * are handled normally in the meantime.
+   */
+  class DeferredResponse : public std::enable_shared_from_this<DeferredResponse> {
+    friend class OpenThingsFramework;
+
+  private:
+    /** The framework that sends the response, or nullptr if it was destroyed before the response was sent. */
+    OpenThingsFramework *framework;
+    /** The local client to respond to, or nullptr if the request was forwarded from the cloud. */
+    LocalClient *localClient = nullptr;
+    /** The ID of the cloud request, which isn't null-terminated since binary IDs may contain null bytes. */
+    char cloudRequestId[CLOUD_ID_LENGTH];
+    CloudFraming framing = TEXT_FRAMING;
+    unsigned long timeout;
+    Timer timeoutTimer;
+    response_filler_t filler;
+    /** Keeps the response alive until it has been sent, even if the callback doesn't keep its handle. */
+    std::shared_ptr<DeferredResponse> self;
+    /** Indicates if complete() was called and the response is waiting to be sent. */
+    bool completed = false;
+    /** Indicates if the response (or the timeout response) has been sent, or was dropped with its cloud connection. */
+    bool finished = false;
+    DeferredResponse *next = nullptr;
+    /** The next response in the list of responses waiting to be sent. */
+    DeferredResponse *parkedNext = nullptr;
+
+    DeferredResponse(OpenThingsFramework *framework, unsigned long timeout);
+
+    /** Queues the response to be sent by loop(). Must be called from the thread calling loop(). */
+    void queueCompletion(response_filler_t filler);
+
+  public:
+    DeferredResponse(const DeferredResponse &) = delete;
+    DeferredResponse &operator=(const DeferredResponse &) = delete;
+
+    /**
+     * Completes the response. The filler is called from the next call to loop() to write the response in the same way
+     * as a route callback. This may be called from any thread on Linux, since the completion is posted to the loop with
+     * OpenThingsFramework::post(), but only from the thread calling loop() on Arduino. Calls after the response was
+     * completed or timed out are ignored.
+     * @param filler Writes the status, headers and body of the response.
+     * @return A boolean indicating if the completion was accepted, or false if the framework's task queue is full or the
+     *         framework was destroyed.
+     */
+    bool complete(response_filler_t filler);
+
+    /**
+     * Returns a boolean indicating if the response has been sent, including if it timed out or if the cloud connection the
+     * request was forwarded over was lost. Must be called from the thread calling loop().
+     */
+    bool isFinished() const;
+  };
+
   class OpenThingsFramework {
+    friend class DeferredResponse;
+#if defined(OTF_BENCHMARK)
+    // Gives the benchmarks in extras/bench access to the internals they measure.
+    friend class BenchmarkAccess;
+#endif
+
   private:
-    LOCAL_SERVER_CLASS localServer = LOCAL_SERVER_CLASS(80);
+    /** A request forwarded from the cloud that is waiting to be processed. */
+    struct CloudRequest {
+      char id[CLOUD_ID_LENGTH + 1];
+      char *data;
+      size_t length;
+      CloudFraming framing;
+      CloudRequest *next = nullptr;
+    };
+
+    /** The server created for the port passed to the constructor, or nullptr if a server was passed instead. */
+    LOCAL_SERVER_CLASS *defaultLocalServer = nullptr;
+    LocalServer *localServer;
     LocalClient *localClient = nullptr;
+    /** Indicates if the local client was accepted and the framework is waiting for it to send its request. */
+    bool waitingForLocalClient = false;
+    /** Indicates if the local client did not send its request before the connection timeout. */
+    bool localClientTimedOut = false;
+    Scheduler scheduler;
+    Timer localClientTimer;
     WebsocketClient *webSocket = nullptr;
-    LinkedMap<callback_t> callbacks;
+    LinkedMap<Route<callback_t>> callbacks;
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+    LinkedMap<Route<coroutine_callback_t>> coroutineCallbacks;
+#endif
     callback_t missingPageCallback;
+    ResponseCache *responseCache = nullptr;
     CLOUD_STATUS cloudStatus = NOT_ENABLED;
     unsigned long lastCloudStatusChangeTime = millis();
     char *headerBuffer = NULL;
     int headerBufferSize = 0;
+    /** Indicates if the header buffer was allocated by the framework rather than passed to the constructor. */
+    bool ownsHeaderBuffer = false;
+    CloudRequest *cloudQueueHead = nullptr;
+    CloudRequest *cloudQueueTail = nullptr;
+    size_t cloudQueueLength = 0;
+    size_t cloudQueueBytes = 0;
+    char *cloudPaths[CLOUD_MAX_PATHS] = {};
+    /** Indicates if the server has sent a binary message on the current connection, so it understands the binary framing. */
+    bool cloudBinaryFraming = false;
+    EventBatch eventBatch;
+    /** Sends the pending events once the batch window has passed. */
+    Timer publishTimer;
+    /** The events published while the cloud was disconnected, waiting to be replayed. */
+    OutboundQueue outboundQueue;
+    /** Replays the queued events at a limited rate after reconnecting. */
+    Timer replayTimer;
+#if defined(OTF_ENABLE_DEFLATE) && !defined(ARDUINO)
+    MessageDeflater *cloudDeflater = nullptr;
+    MessageInflater *cloudInflater = nullptr;
+#endif
+#if defined(OTF_ENABLE_METRICS)
+    Metrics metrics;
+    /** Times the request currently being handled. Only one request is handled at a time. */
+    MetricsTimer requestTimer;
+    /** The map key of the metrics endpoint, or nullptr if it is disabled. */
+    char *metricsRouteKey = nullptr;
+    /** The metrics of the metrics, trace and websocket endpoints, if they are enabled. */
+    MetricsRoute *metricsRouteMetrics = nullptr;
+    MetricsRoute *traceRouteMetrics = nullptr;
+    MetricsRoute *websocketRouteMetrics = nullptr;
+#endif
+#if defined(OTF_ENABLE_TRACE)
+    /** The map key of the trace dump endpoint, or nullptr if it is disabled. */
+    char *traceRouteKey = nullptr;
+#endif
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+    LoopWatchdog loopWatchdog;
+#endif
+    /** The local websocket endpoint, or nullptr if it is disabled. */
+    WebsocketEndpoint *websocketEndpoint = nullptr;
+    /** The map key of the local websocket endpoint, or nullptr if it is disabled. */
+    char *websocketRouteKey = nullptr;
+    /** The Server-Sent Events streams, by map key. */
+    LinkedMap<Route<EventStream *>> eventStreams;
+    /** The response deferred by the callback that is currently running, or nullptr if it wasn't deferred. */
+    DeferredResponse *deferredRequest = nullptr;
+    /** The number of deferred responses that haven't been sent yet. */
+    size_t deferredCount = 0;
+    /** The deferred responses that have been completed and are waiting to be sent by loop(). */
+    DeferredResponse *completedHead = nullptr;
+    DeferredResponse **completedTail = &completedHead;
+    /** The deferred responses that have been parked and haven't been sent yet. */
+    DeferredResponse *parkedHead = nullptr;
+#if !defined(ARDUINO)
+    /** The tasks posted from other threads. */
+    TaskQueue taskQueue;
+#endif
 
+    /** Sets up the header buffer and starts the local server. */
+    void init(char *hdBuffer, int hdBufferSize);
     void webSocketEventCallback(WSEvent_t type, uint8_t *payload, size_t length);
 
+    /** Copies a forwarded request into the queue, or rejects it if the queue is full. */
+    void queueCloudRequest(const char *requestId, const char *data, size_t length, CloudFraming framing);
+    void clearCloudQueue();
+    void cloudRequestLoop();
+    void handleCloudRequest(const char *requestId, char *data, size_t length, CloudFraming framing);
+    void respondToCloudRequest(const char *requestId, const Request &request, CloudFraming framing);
+    /** Stores a path interned by the server for the binary framing. */
+    void defineCloudPath(const uint8_t *payload, size_t length);
+    void clearCloudPaths();
+    /** Starts new compression contexts for a new connection. */
+    void resetCloudCompression();
+    /** Sends the next message of queued events. */
+    void replayEvents();
+
+    /** Adds a callback to the route map, replacing any existing callback for the same key. */
+    void addRoute(char *key, callback_t callback);
     void fillResponse(const Request &req, Response &res);
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+    /**
+     * Starts a coroutine callback. The response is written directly if the coroutine finishes without suspending, and
+     * deferred otherwise.
+     */
+    void startCoroutine(coroutine_callback_t callback, const Request &req, Response &res);
+#endif
     void localServerLoop();
+    /**
+     * Hands the local client over to the websocket endpoint or an event stream if the request is for one of them.
+     * @return A boolean indicating if the client was handed over, so the request must not be handled any further.
+     */
+    bool handOverLocalClient(const Request &request);
+    /** Accepts the next local client once the current one has been responded to or deferred. */
+    void acceptNextLocalClient();
+    /** Streams a response to a local client. */
+    void startLocalResponse(Response &res, LocalClient *client);
+    /** Streams a response to the websocket and writes the prefix that tags it with its request ID. */
+    void startCloudResponse(Response &res, const char *requestId, CloudFraming framing);
+    /** Creates a deferred response for the callback that is currently running. Called by Response::defer(). */
+    std::shared_ptr<DeferredResponse> deferRequest(unsigned long timeout);
+    /** Stores where a deferred response should be sent once the callback has returned, and starts its timeout. */
+    void parkDeferredRequest(LocalClient *client, const char *requestId, CloudFraming framing);
+    void timeoutDeferredResponse(DeferredResponse &deferred);
+    void sendDeferredResponse(DeferredResponse &deferred, const response_filler_t &filler);
+    /** Removes a deferred response from the parked list and marks it as finished. */
+    void finishDeferredResponse(DeferredResponse &deferred);
+    /** Drops the deferred responses to forwarded requests, since they can't be delivered over a new connection. */
+    void dropCloudDeferredResponses();
+    /** Sends the deferred responses that have been completed. */
+    void deferredResponseLoop();
+    /** Starts waiting for the request of a newly accepted local client. */
+    void waitForLocalClient();
     void setCloudStatus(CLOUD_STATUS status);
 
     static void defaultMissingPageCallback(const Request &req, Response &res);
@@ -82,6 +397,17 @@ namespace OTF {
      */
     OpenThingsFramework(uint16_t webServerPort, char *hdBuffer = NULL, int hdBufferSize = HEADERS_BUFFER_SIZE);
 
+    /**
+     * Initializes the library to only accept requests from the specified server, such as a LoopbackLocalServer used for
+     * testing. The server is started by the constructor and must outlive the OpenThingsFramework instance.
+     * @param localServer The server to accept local requests from.
+     * @param hdBuffer externally provided header buffer (optional)
+     * @param hdBufferSize size of the externally provided header buffer (optional)
+     */
+    OpenThingsFramework(LocalServer &localServer, char *hdBuffer = NULL, int hdBufferSize = HEADERS_BUFFER_SIZE);
+
+    ~OpenThingsFramework();
+
     /**
      * Initializes the library to listen on a local webserver and connect to a remote websocket.
      * @param webServerPort The local port to bind the webserver to.
@@ -118,9 +444,131 @@ namespace OTF {
     void on(const __FlashStringHelper *path, callback_t callback, HTTPMethod method = HTTP_ANY);
 #endif
 
+#if defined(OTF_ENABLE_COROUTINES) && !defined(ARDUINO)
+    /**
+     * Registers a callback written as a coroutine. The coroutine can `co_await` sleepFor(), readable() and other tasks
+     * without blocking loop(), and its response is sent when it returns. Responses of coroutine callbacks are buffered,
+     * so they are limited to RESPONSE_BUFFER_SIZE bytes. Callbacks registered with the other overload take precedence
+     * for the same path and method.
+     * @param path
+     * @param callback
+     */
+    void on(const char *path, coroutine_callback_t callback, HTTPMethod method = HTTP_ANY);
+#endif
+
     /** Registers a callback function to run when a request is received but its path does not match a registered callback. */
     void onMissingPage(callback_t callback);
 
+    /**
+     * Enables the response cache. Responses are only cached for routes that have been given a TTL with setCacheTtl().
+     * @param maxBytes The maximum number of bytes the cache may use. Least recently used responses are evicted first.
+     */
+    void enableResponseCache(size_t maxBytes = RESPONSE_CACHE_SIZE);
+
+    /**
+     * Caches the responses to GET requests for the specified path, keyed by the path and the normalized query. Cache
+     * hits are sent without running the callback, so this should only be used for routes whose response only depends
+     * on the request and state that is invalidated with invalidateCache(). Enables the response cache with the default
+     * size if it was not already enabled.
+     * @param path
+     * @param ttl The number of milliseconds to serve a cached response for, or 0 to stop caching the path.
+     */
+    void setCacheTtl(const char *path, unsigned long ttl);
+
+    /** Removes all cached responses for the specified path. This should be called when the state the path reflects changes. */
+    void invalidateCache(const char *path);
+
+    /** Removes all cached responses. */
+    void invalidateCache();
+
+#if !defined(ARDUINO)
+    /**
+     * Serves the local webserver over HTTPS instead of HTTP. Sessions are cached and tickets are issued, so clients
+     * that reconnect can resume their session without a full handshake.
+     * @param certFile Path of the PEM encoded certificate chain.
+     * @param keyFile Path of the PEM encoded private key.
+     * @return A boolean indicating if the certificate and key were loaded.
+     */
+    bool enableLocalTls(const char *certFile, const char *keyFile);
+#endif
+
+#if defined(OTF_ENABLE_METRICS)
+    /**
+     * Serves the request metrics in the Prometheus text format on GET requests to the specified path. Requests to the
+     * endpoint are counted like any other route.
+     * @param path
+     */
+    void enableMetricsEndpoint(const char *path = "/metrics");
+
+    /** Returns the request metrics, which can be read with Metrics::getSnapshot(). */
+    const Metrics &getMetrics() const;
+#endif
+
+#if defined(OTF_ENABLE_TRACE)
+    /**
+     * Serves a binary dump of the trace buffer on GET requests to the specified path. Dumps can be decoded with
+     * extras/trace/decode_trace.py.
+     * @param path
+     */
+    void enableTraceEndpoint(const char *path = "/trace");
+#endif
+
+#if defined(OTF_ENABLE_LOOP_WATCHDOG)
+    /**
+     * Returns the watchdog that times each call to loop(), which can be used to set the budget, register an overrun
+     * callback and read the per-phase maximums.
+     */
+    LoopWatchdog &getLoopWatchdog();
+#endif
+
+    /**
+     * Accepts websocket connections from the local network on the specified path, so local dashboards can subscribe to
+     * state changes instead of polling. Requests to the path that aren't upgrade requests, including requests forwarded
+     * from the cloud, are rejected with a 426.
+     * @param path
+     * @return The endpoint, which is used to broadcast messages and to register callbacks for subscribers.
+     */
+    WebsocketEndpoint &enableWebsocketEndpoint(const char *path = "/ws");
+
+    /** Returns the local websocket endpoint, or nullptr if enableWebsocketEndpoint() hasn't been called. */
+    WebsocketEndpoint *getWebsocketEndpoint();
+
+    /**
+     * Serves a stream of Server-Sent Events (`text/event-stream`) on GET requests to the specified path from the local
+     * network. The response is kept open, and events pushed to the returned stream are sent to every connected client.
+     * Each path has its own stream and history. Requests forwarded from the cloud can't be kept open, so they are
+     * rejected with a 501.
+     * @param path
+     * @return The stream, which is used to push events. Calling this again with the same path returns the same stream.
+     */
+    EventStream &enableEventStream(const char *path);
+
+    /** Returns the event stream served on the specified path, or nullptr if enableEventStream() wasn't called for it. */
+    EventStream *getEventStream(const char *path);
+
+    /**
+     * Returns the scheduler that runs timers and deferred tasks from loop(). Firmware can use it instead of its own
+     * millis() timers, and callbacks can use it to defer work until after their response has been sent.
+     */
+    Scheduler &getScheduler();
+
+#if !defined(ARDUINO)
+    /**
+     * Runs a task from the next call to loop(). This is the only function that may be called from threads other than
+     * the one calling loop(); everything else, including the websocket and the local client, must only be used from
+     * that thread. Other threads should post a task that does the work instead.
+     * @param task
+     * @return A boolean indicating if the task was queued, or false if TASK_QUEUE_SIZE tasks are already waiting.
+     */
+    bool post(task_t task);
+
+    /**
+     * Returns a file descriptor that becomes readable when a task is posted, so an event loop that waits with poll() or
+     * epoll before calling loop() can wake up for posted tasks. loop() clears it.
+     */
+    int getWakeupFd() const;
+#endif
+
     void loop();
 
     /** Returns the current status of the connection to the OpenThings Cloud server. */
@@ -128,6 +576,38 @@ namespace OTF {
 
     /** Returns the number of milliseconds since there was last a change in the cloud status. */
     unsigned long getTimeSinceLastCloudStatusChange();
+
+    /**
+     * Publishes an event to the cloud, such as a state change, so apps don't have to poll for it. Events are held for
+     * PUBLISH_BATCH_WINDOW milliseconds and sent together in one message, and only the latest event of each topic is
+     * sent. Events published while the cloud is not connected are queued and replayed in order once it reconnects.
+     * @param topic A null-terminated topic of up to PUBLISH_MAX_TOPIC_LENGTH characters, such as "zone/1/state". Topics
+     * may contain any characters except spaces and control characters (including CR and LF).
+     * @param payload A null-terminated payload.
+     * @param priority Determines which events are dropped first if the outbound queue fills up while disconnected.
+     * @return A boolean indicating if the event was accepted, or false if the cloud is not enabled, the topic contains a
+     * character that isn't allowed, or the event is too large to be sent.
+     */
+    bool publish(const char *topic, const char *payload, EventPriority priority = EVENT_PRIORITY_NORMAL);
+
+    /**
+     * Publishes an event with a binary payload. See publish(const char *, const char *, EventPriority).
+     * @param length The length of the payload.
+     */
+    bool publish(const char *topic, const char *payload, size_t length, EventPriority priority = EVENT_PRIORITY_NORMAL);
+
+    /** Returns the number of events waiting to be replayed to the cloud. */
+    size_t getQueuedEventCount() const;
+
+    /** Returns the number of events dropped because the outbound queue was full. */
+    uint32_t getDroppedEventCount() const;
+
+    /**
+     * Sends the pending events immediately instead of waiting for the batch window to pass. If a response to a forwarded
+     * request is being streamed, such as when this is called from its callback, the events are queued and sent from
+     * loop() once the response has been sent.
+     */
+    void flushEvents();
   };
 }// namespace OTF
 
@@ -0,0 +1,118 @@
+#include "OutboundQueue.h"
+#include <string.h>
+
+using namespace OTF;
+
+OutboundQueue::~OutboundQueue() {
+  clear();
+}
+
+OutboundQueue::QueuedEvent &OutboundQueue::at(size_t position) {
+  return events[(head + position) % OUTBOUND_QUEUE_MAX_EVENTS];
+}
+
+const OutboundQueue::QueuedEvent &OutboundQueue::at(size_t position) const {
+  return events[(head + position) % OUTBOUND_QUEUE_MAX_EVENTS];
+}
+
+void OutboundQueue::remove(size_t position) {
+  QueuedEvent &event = at(position);
+  bytes -= event.topicLength + 1 + event.payloadLength;
+  delete[] event.data;
+
+  if (position == 0) {
+    head = (head + 1) % OUTBOUND_QUEUE_MAX_EVENTS;
+  } else {
+    for (size_t i = position; i + 1 < count; i++) {
+      at(i) = at(i + 1);
+    }
+  }
+  count--;
+}
+
+bool OutboundQueue::dropFor(EventPriority priority) {
+  if (count == 0) {
+    return false;
+  }
+
+  size_t lowest = 0;
+  for (size_t i = 1; i < count; i++) {
+    if (at(i).priority < at(lowest).priority) {
+      lowest = i;
+    }
+  }
+  if (at(lowest).priority > priority) {
+    return false;
+  }
+
+  remove(lowest);
+  droppedCount++;
+  return true;
+}
+
+bool OutboundQueue::push(const char *topic, const char *payload, size_t length, EventPriority priority) {
+  size_t topicLength = strlen(topic);
+  size_t size = topicLength + 1 + length;
+  if (size > OUTBOUND_QUEUE_MAX_BYTES) {
+    droppedCount++;
+    return false;
+  }
+
+  while (count >= OUTBOUND_QUEUE_MAX_EVENTS || bytes + size > OUTBOUND_QUEUE_MAX_BYTES) {
+    if (!dropFor(priority)) {
+      droppedCount++;
+      return false;
+    }
+  }
+
+  QueuedEvent &event = at(count);
+  event.data = new char[size];
+  memcpy(event.data, topic, topicLength + 1);
+  memcpy(&event.data[topicLength + 1], payload, length);
+  event.topicLength = topicLength;
+  event.payloadLength = length;
+  event.priority = priority;
+  count++;
+  bytes += size;
+  return true;
+}
+
+size_t OutboundQueue::encode(StringBuilder &builder, uint8_t frameType, size_t maxLength) const {
+  EventBatch::encodeStart(builder, frameType);
+  size_t length = PUBLISH_MESSAGE_OVERHEAD;
+  size_t encoded = 0;
+  for (; encoded < count; encoded++) {
+    const QueuedEvent &event = at(encoded);
+    size_t eventLength = PUBLISH_EVENT_OVERHEAD + event.topicLength + event.payloadLength;
+    if (encoded > 0 && length + eventLength > maxLength) {
+      break;
+    }
+
+    EventBatch::encodeEvent(builder, frameType, event.data, &event.data[event.topicLength + 1], event.payloadLength);
+    length += eventLength;
+  }
+  return encoded;
+}
+
+void OutboundQueue::pop(size_t count) {
+  while (count > 0 && this->count > 0) {
+    remove(0);
+    count--;
+  }
+}
+
+void OutboundQueue::clear() {
+  pop(count);
+}
+
+size_t OutboundQueue::getCount() const {
+  return count;
+}
+
+bool OutboundQueue::isEmpty() const {
+  return count == 0;
+}
+
+uint32_t OutboundQueue::getDroppedCount() const {
+  return droppedCount;
+}
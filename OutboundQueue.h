@@ -0,0 +1,87 @@
+#ifndef OTF_OUTBOUNDQUEUE_H
+#define OTF_OUTBOUNDQUEUE_H
+
+#include "EventBatch.h"
+
+#ifndef OUTBOUND_QUEUE_MAX_EVENTS
+// The maximum number of events kept while the cloud is disconnected.
+#define OUTBOUND_QUEUE_MAX_EVENTS 32
+#endif
+#ifndef OUTBOUND_QUEUE_MAX_BYTES
+// The maximum combined size in bytes of the topics and payloads kept while the cloud is disconnected.
+#define OUTBOUND_QUEUE_MAX_BYTES 4096
+#endif
+#ifndef OUTBOUND_REPLAY_INTERVAL
+/* The time in milliseconds between messages when the queued events are replayed after reconnecting, so a backlog
+ * doesn't flood the server or starve forwarded requests.
+ */
+#define OUTBOUND_REPLAY_INTERVAL 100
+#endif
+
+namespace OTF {
+  /**
+   * A bounded ring buffer of the events published while the cloud is disconnected, so they can be replayed in order
+   * once it reconnects. When the queue is full, the oldest event with the lowest priority is dropped to make room, as
+   * long as its priority is not higher than the new event's.
+   */
+  class OutboundQueue {
+  private:
+    struct QueuedEvent {
+      /** The null-terminated topic, followed by the payload. */
+      char *data;
+      size_t topicLength;
+      size_t payloadLength;
+      EventPriority priority;
+    };
+
+    QueuedEvent events[OUTBOUND_QUEUE_MAX_EVENTS];
+    /** The index of the oldest event. */
+    size_t head = 0;
+    size_t count = 0;
+    size_t bytes = 0;
+    uint32_t droppedCount = 0;
+
+    QueuedEvent &at(size_t position);
+    const QueuedEvent &at(size_t position) const;
+    /** Removes the event at a position, moving the newer events forward to keep the order. */
+    void remove(size_t position);
+    /** Drops the oldest event with the lowest priority, if it isn't higher than the specified priority. */
+    bool dropFor(EventPriority priority);
+
+  public:
+    OutboundQueue() {}
+    ~OutboundQueue();
+
+    OutboundQueue(const OutboundQueue &) = delete;
+    OutboundQueue &operator=(const OutboundQueue &) = delete;
+
+    /**
+     * Adds an event to the end of the queue, dropping lower priority events if there isn't room.
+     * @return A boolean indicating if the event was queued, or false if it was dropped because every queued event has
+     * a higher priority.
+     */
+    bool push(const char *topic, const char *payload, size_t length, EventPriority priority);
+
+    /**
+     * Encodes events from the front of the queue into a single message, without removing them.
+     * @param builder The builder to write the message to.
+     * @param frameType The first byte of a binary message, or 0 to use the text encoding.
+     * @param maxLength The maximum size of the message. At least one event is always encoded.
+     * @return The number of events that were encoded.
+     */
+    size_t encode(StringBuilder &builder, uint8_t frameType, size_t maxLength) const;
+
+    /** Removes events from the front of the queue, such as after they have been sent. */
+    void pop(size_t count);
+
+    void clear();
+
+    size_t getCount() const;
+    bool isEmpty() const;
+
+    /** Returns the number of events that have been dropped because the queue was full. */
+    uint32_t getDroppedCount() const;
+  };
+}// namespace OTF
+
+#endif
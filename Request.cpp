@@ -149,6 +149,126 @@ Request::Request(char *str, size_t length, bool cloudRequest) {
   bodyLength = length - index;
 }
 
+Request::Request(char *str, size_t length, char *const *paths, size_t pathCount) {
+  this->cloudRequest = true;
+  size_t index = 0;
+
+  // The method byte and path ID.
+  if (length < 3) {
+    requestType = INVALID;
+    return;
+  }
+
+  uint8_t method = (uint8_t) str[0];
+  if (method < HTTP_GET || method > HTTP_OPTIONS) {
+    REQ_DEBUG(F("Could not match HTTP method\n"));
+    requestType = INVALID;
+    return;
+  }
+  this->httpMethod = (HTTPMethod) method;
+
+  uint16_t pathId = ((uint8_t) str[1] << 8) | (uint8_t) str[2];
+  index = 3;
+  if (pathId == 0) {
+    // The path is specified literally after the path ID.
+    if (!decodeBinaryString(str, length, index, 2, path)) {
+      requestType = INVALID;
+      return;
+    }
+  } else {
+    if (pathId > pathCount || paths[pathId - 1] == nullptr) {
+      REQ_DEBUG((char *) F("Path ID %d was not defined\n"), pathId);
+      requestType = INVALID;
+      return;
+    }
+    path = paths[pathId - 1];
+  }
+
+  // Parse the query.
+  if (index + 2 > length) {
+    requestType = INVALID;
+    return;
+  }
+  size_t queryLength = ((uint8_t) str[index] << 8) | (uint8_t) str[index + 1];
+  if (index + 2 + queryLength > length) {
+    requestType = INVALID;
+    return;
+  }
+  if (queryLength > 0) {
+    // Move the query over its length prefix and terminate it with a space like in a request line.
+    memmove(&str[index], &str[index + 2], queryLength);
+    str[index + queryLength] = ' ';
+    size_t queryIndex = index;
+    if (parseQuery(str, index + queryLength + 1, queryIndex) != ' ') {
+      requestType = INVALID;
+      return;
+    }
+  }
+  index += 2 + queryLength;
+
+  // Parse the headers.
+  if (index >= length) {
+    requestType = INVALID;
+    return;
+  }
+  uint8_t headerCount = (uint8_t) str[index++];
+  for (uint8_t i = 0; i < headerCount; i++) {
+    char *name;
+    char *value;
+    if (!decodeBinaryString(str, length, index, 1, name) || !decodeBinaryString(str, length, index, 2, value)) {
+      requestType = INVALID;
+      return;
+    }
+
+    for (char *c = name; *c != '\0'; c++) {
+      *c = tolower(*c);
+    }
+    REQ_DEBUG((char *) F("Found header '%s' with value '%s'.\n"), name, value);
+    headers.add(name, value);
+  }
+
+  // The body must extend exactly to the end of the frame.
+  if (index + 4 > length) {
+    requestType = INVALID;
+    return;
+  }
+  bodyLength = ((uint32_t) (uint8_t) str[index] << 24) | ((uint32_t) (uint8_t) str[index + 1] << 16) |
+               ((uint32_t) (uint8_t) str[index + 2] << 8) | (uint8_t) str[index + 3];
+  index += 4;
+  if (index + bodyLength != length) {
+    requestType = INVALID;
+    return;
+  }
+  body = &str[index];
+  requestType = NORMAL;
+}
+
+bool Request::decodeBinaryString(char *str, size_t length, size_t &index, uint8_t prefixLength, char *&value) {
+  if (index + prefixLength > length) {
+    return false;
+  }
+
+  size_t stringLength = (uint8_t) str[index];
+  if (prefixLength == 2) {
+    stringLength = (stringLength << 8) | (uint8_t) str[index + 1];
+  }
+  if (index + prefixLength + stringLength > length) {
+    return false;
+  }
+
+  // Reject any strings that contain null characters to prevent null byte poisoning attacks.
+  if (memchr(&str[index + prefixLength], '\0', stringLength) != nullptr) {
+    return false;
+  }
+
+  // Moving the string over its prefix frees up a byte at the end for the null terminator.
+  memmove(&str[index], &str[index + prefixLength], stringLength);
+  str[index + stringLength] = '\0';
+  value = &str[index];
+  index += prefixLength + stringLength;
+  return true;
+}
+
 char Request::parseQuery(char *str, size_t length, size_t &index) {
   REQ_DEBUG(F("Starting to parse query.\n"));
   while (index < length) {
@@ -284,6 +404,70 @@ void Request::decodeQueryParameter(char *value) {
   value[index] = '\0';
 }
 
+// Returns the space needed to copy a string, including its null terminator.
+static size_t copiedLength(const char *str) {
+  return str != nullptr ? strlen(str) + 1 : 0;
+}
+
+// Copies a string to the end of a buffer, returning the copy.
+static char *copyString(char *buffer, size_t &index, const char *str) {
+  if (str == nullptr) {
+    return nullptr;
+  }
+
+  char *copy = &buffer[index];
+  size_t length = strlen(str) + 1;
+  memcpy(copy, str, length);
+  index += length;
+  return copy;
+}
+
+Request *Request::copy() const {
+  size_t length = copiedLength(path) + copiedLength(httpVersion) + bodyLength + 1;
+  for (LinkedMapNode<char *> *node = queryParams.head; node != nullptr; node = node->next) {
+    length += copiedLength(node->key) + copiedLength(node->value);
+  }
+  for (LinkedMapNode<char *> *node = headers.head; node != nullptr; node = node->next) {
+    length += copiedLength(node->key) + copiedLength(node->value);
+  }
+
+  char *buffer = new char[length];
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+
+  Request *request = new Request();
+  request->ownedBuffer = buffer;
+  request->httpMethod = httpMethod;
+  request->requestType = requestType;
+  request->cloudRequest = cloudRequest;
+
+  size_t index = 0;
+  request->path = copyString(buffer, index, path);
+  request->httpVersion = copyString(buffer, index, httpVersion);
+  for (LinkedMapNode<char *> *node = queryParams.head; node != nullptr; node = node->next) {
+    char *key = copyString(buffer, index, node->key);
+    request->queryParams.add(key, copyString(buffer, index, node->value));
+  }
+  for (LinkedMapNode<char *> *node = headers.head; node != nullptr; node = node->next) {
+    char *key = copyString(buffer, index, node->key);
+    request->headers.add(key, copyString(buffer, index, node->value));
+  }
+
+  // The body may contain null characters, so it is copied by length. It is null terminated for convenience.
+  request->body = &buffer[index];
+  if (bodyLength > 0) {
+    memcpy(request->body, body, bodyLength);
+  }
+  request->body[bodyLength] = 0;
+  request->bodyLength = bodyLength;
+  return request;
+}
+
+Request::~Request() {
+  delete[] ownedBuffer;
+}
+
 char *Request::getPath() const { return path; }
 
 #if defined(ARDUINO)
@@ -9,6 +9,7 @@
 
 #include "LinkedMap.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -47,9 +48,16 @@ namespace OTF {
 
   class Request {
     friend class OpenThingsFramework;
+    friend class ResponseCache;
+    friend class LoopWatchdog;
+    friend class WebsocketEndpoint;
+#if defined(OTF_BENCHMARK)
+    // Gives the benchmarks in extras/bench access to the internals they measure.
+    friend class BenchmarkAccess;
+#endif
 
   private:
-    enum HTTPMethod httpMethod;
+    enum HTTPMethod httpMethod = HTTP_ANY;
     char *httpVersion = nullptr;
     char *path = nullptr;
     LinkedMap<char *> queryParams;
@@ -58,6 +66,10 @@ namespace OTF {
     size_t bodyLength = 0;
     RequestType requestType = INVALID;
     bool cloudRequest;
+    /** The buffer holding the strings of a copied request, or nullptr if they point into the original message. */
+    char *ownedBuffer = nullptr;
+
+    Request() {}
 
     /**
      * Parses the query of the request.
@@ -90,6 +102,28 @@ namespace OTF {
      */
     static void decodeQueryParameter(char *value);
 
+    /**
+     * Decodes a length-prefixed string in place by moving it over its length prefix and null terminating it.
+     * @param str The full frame.
+     * @param length The length of the full frame.
+     * @param index The index of the string's length prefix. When the function terminates successfully, this will be
+     * updated to the index of the first byte after the string.
+     * @param prefixLength The number of bytes in the big-endian length prefix (1 or 2).
+     * @param value Set to the decoded string.
+     * @return A boolean indicating if the string could be decoded successfully.
+     */
+    static bool decodeBinaryString(char *str, size_t length, size_t &index, uint8_t prefixLength, char *&value);
+
+    /**
+     * Decodes a request that was forwarded with the cloud's binary framing (described in OpenThingsFramework.h). The
+     * frame is decoded in place, so no text HTTP parsing is needed.
+     * @param str The frame, starting at the method byte.
+     * @param length The length of the frame.
+     * @param paths The paths interned by the server, indexed by their ID minus 1.
+     * @param pathCount The number of entries in `paths`.
+     */
+    Request(char *str, size_t length, char *const *paths, size_t pathCount);
+
     /**
      * Parses an HTTP request. The parser makes some assumptions about the message format that may not hold if the
      * message is improperly formatted, so the behavior of this constructor is undefined if it is passed an improperly
@@ -97,7 +131,18 @@ namespace OTF {
      */
     Request(char *str, size_t length, bool cloudRequest);
 
+    /**
+     * Copies the request into a single buffer, so the copy stays valid after the message it was parsed from has been
+     * reused. The caller is responsible for deleting the copy.
+     * @return The copy, or nullptr if the buffer could not be allocated.
+     */
+    Request *copy() const;
+
   public:
+    ~Request();
+
+    Request(const Request &) = delete;
+    Request &operator=(const Request &) = delete;
 
     /** Returns the path of the request (not including the query) as a null-terminated string. */
     char *getPath() const;
@@ -0,0 +1,259 @@
+#if !defined(ARDUINO)
+#include "Resolver.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <chrono>
+
+using namespace OTF;
+
+Resolver::Resolver() {
+  for (int i = 0; i < RESOLVER_THREADS; i++) {
+    threads.push_back(std::thread(&Resolver::work, this));
+  }
+}
+
+Resolver::~Resolver() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  lookupQueued.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+Resolver &Resolver::instance() {
+  static Resolver resolver;
+  return resolver;
+}
+
+void Resolver::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    lookupQueued.wait(lock, [this]() { return stopping || !queue.empty(); });
+    if (stopping) {
+      return;
+    }
+
+    std::string host = queue.front();
+    queue.pop_front();
+
+    // getaddrinfo may block for several seconds, so don't hold the lock while it runs.
+    lock.unlock();
+    Entry result;
+    lookup(host, result);
+    lock.lock();
+
+    std::map<std::string, Entry>::iterator it = cache.find(host);
+    if (it == cache.end()) {
+      // The cache was cleared while the lookup was running.
+      continue;
+    }
+
+    Entry &entry = it->second;
+    entry.refreshing = false;
+    entry.resolvedAt = millis();
+    if (result.status == RESOLVE_OK) {
+      RESOLVER_DEBUG("Resolved '%s' to %d addresses\n", host.c_str(), (int) result.addresses.size());
+      entry.status = RESOLVE_OK;
+      entry.addresses = result.addresses;
+      entry.validFor = ttl;
+    } else if (entry.status == RESOLVE_OK) {
+      // Keep using the previous addresses if the host temporarily can't be resolved, but try again sooner.
+      RESOLVER_DEBUG("Failed to refresh '%s'\n", host.c_str());
+      entry.validFor = negativeTtl;
+    } else {
+      RESOLVER_DEBUG("Failed to resolve '%s'\n", host.c_str());
+      entry.status = RESOLVE_FAILED;
+      entry.validFor = negativeTtl;
+    }
+    lookupFinished.notify_all();
+  }
+}
+
+void Resolver::lookup(const std::string &host, Entry &result) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  // Only return the address families that have a configured interface.
+  hints.ai_flags = AI_ADDRCONFIG;
+
+  struct addrinfo *info = nullptr;
+  if (getaddrinfo(host.c_str(), nullptr, &hints, &info) != 0 || info == nullptr) {
+    result.status = RESOLVE_FAILED;
+    return;
+  }
+
+  // getaddrinfo sorts the addresses by preference (RFC 6724), so keep that order within each family.
+  std::vector<ResolvedAddress> preferred;
+  std::vector<ResolvedAddress> other;
+  int preferredFamily = info->ai_family;
+  for (struct addrinfo *ai = info; ai != nullptr; ai = ai->ai_next) {
+    if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6) || ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+      continue;
+    }
+
+    ResolvedAddress address;
+    memset(&address, 0, sizeof(address));
+    memcpy(&address.address, ai->ai_addr, ai->ai_addrlen);
+    address.length = ai->ai_addrlen;
+    (ai->ai_family == preferredFamily ? preferred : other).push_back(address);
+  }
+  freeaddrinfo(info);
+
+  // Alternate between the families so a broken path for one family only delays the connection by one attempt.
+  result.addresses.clear();
+  for (size_t i = 0; i < preferred.size() || i < other.size(); i++) {
+    if (i < preferred.size()) {
+      result.addresses.push_back(preferred[i]);
+    }
+    if (i < other.size()) {
+      result.addresses.push_back(other[i]);
+    }
+  }
+  result.status = result.addresses.empty() ? RESOLVE_FAILED : RESOLVE_OK;
+}
+
+bool Resolver::parseNumeric(const char *host, uint16_t port, std::vector<ResolvedAddress> &out) {
+  ResolvedAddress address;
+  memset(&address, 0, sizeof(address));
+
+  struct sockaddr_in *sin = (struct sockaddr_in *) &address.address;
+  struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &address.address;
+  if (inet_pton(AF_INET, host, &sin->sin_addr) == 1) {
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    address.length = sizeof(struct sockaddr_in);
+  } else if (inet_pton(AF_INET6, host, &sin6->sin6_addr) == 1) {
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(port);
+    address.length = sizeof(struct sockaddr_in6);
+  } else {
+    return false;
+  }
+
+  out.clear();
+  out.push_back(address);
+  return true;
+}
+
+void Resolver::copyAddresses(const std::vector<ResolvedAddress> &addresses, uint16_t port, std::vector<ResolvedAddress> &out) {
+  out = addresses;
+  for (ResolvedAddress &address : out) {
+    if (address.address.ss_family == AF_INET6) {
+      ((struct sockaddr_in6 *) &address.address)->sin6_port = htons(port);
+    } else {
+      ((struct sockaddr_in *) &address.address)->sin_port = htons(port);
+    }
+  }
+}
+
+void Resolver::queueLookup(const std::string &host, Entry &entry) {
+  if (entry.refreshing) {
+    return;
+  }
+
+  entry.refreshing = true;
+  queue.push_back(host);
+  lookupQueued.notify_one();
+}
+
+void Resolver::trim() {
+  while (cache.size() > RESOLVER_MAX_ENTRIES) {
+    std::map<std::string, Entry>::iterator oldest = cache.end();
+    for (std::map<std::string, Entry>::iterator it = cache.begin(); it != cache.end(); it++) {
+      if (!it->second.refreshing && (oldest == cache.end() || (long) (it->second.lastUsed - oldest->second.lastUsed) < 0)) {
+        oldest = it;
+      }
+    }
+
+    if (oldest == cache.end()) {
+      return;
+    }
+    cache.erase(oldest);
+  }
+}
+
+ResolveStatus Resolver::resolve(const char *host, uint16_t port, std::vector<ResolvedAddress> &out) {
+  if (parseNumeric(host, port, out)) {
+    return RESOLVE_OK;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  unsigned long now = millis();
+  std::map<std::string, Entry>::iterator it = cache.find(host);
+  if (it == cache.end()) {
+    Entry &entry = cache[host];
+    entry.status = RESOLVE_PENDING;
+    entry.resolvedAt = now;
+    entry.validFor = 0;
+    entry.lastUsed = now;
+    entry.refreshing = false;
+    queueLookup(host, entry);
+    trim();
+    return RESOLVE_PENDING;
+  }
+
+  Entry &entry = it->second;
+  entry.lastUsed = now;
+  if (entry.status != RESOLVE_PENDING && now - entry.resolvedAt >= entry.validFor) {
+    queueLookup(host, entry);
+    if (entry.status == RESOLVE_FAILED) {
+      entry.status = RESOLVE_PENDING;
+    }
+  }
+
+  if (entry.status == RESOLVE_OK) {
+    // Expired addresses are still returned while they are being refreshed.
+    copyAddresses(entry.addresses, port, out);
+  }
+  return entry.status;
+}
+
+bool Resolver::resolve(const char *host, uint16_t port, std::vector<ResolvedAddress> &out, unsigned long timeout) {
+  unsigned long start = millis();
+  while (true) {
+    ResolveStatus status = resolve(host, port, out);
+    if (status != RESOLVE_PENDING) {
+      return status == RESOLVE_OK;
+    }
+
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= timeout) {
+      RESOLVER_DEBUG("Timed out resolving '%s'\n", host);
+      return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    lookupFinished.wait_for(lock, std::chrono::milliseconds(timeout - elapsed), [this, host]() {
+      std::map<std::string, Entry>::iterator it = cache.find(host);
+      return it == cache.end() || it->second.status != RESOLVE_PENDING;
+    });
+  }
+}
+
+void Resolver::setTtl(unsigned long ttl, unsigned long negativeTtl) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->ttl = ttl;
+  this->negativeTtl = negativeTtl;
+}
+
+void Resolver::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<std::string, Entry>::iterator it = cache.begin();
+  while (it != cache.end()) {
+    if (it->second.refreshing) {
+      // Keep the entry so the running lookup has somewhere to store its result, but don't return its old addresses.
+      it->second.status = RESOLVE_PENDING;
+      it->second.addresses.clear();
+      it++;
+    } else {
+      it = cache.erase(it);
+    }
+  }
+}
+#endif
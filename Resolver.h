@@ -0,0 +1,121 @@
+#if !defined(ARDUINO)
+#ifndef OTF_RESOLVER_H
+#define OTF_RESOLVER_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+unsigned long millis();
+
+#ifdef SERIAL_DEBUG
+#define RESOLVER_DEBUG(...)          \
+  fprintf(stdout, "Resolver: "); \
+  fprintf(stdout, __VA_ARGS__)
+#else
+#define RESOLVER_DEBUG(...)
+#endif
+
+// How long in milliseconds a successful lookup is used before the host is resolved again.
+#define RESOLVER_TTL 300000
+// How long in milliseconds a failed lookup is remembered before the host is resolved again.
+#define RESOLVER_NEGATIVE_TTL 10000
+// The number of helper threads lookups run on, so a slow lookup of one host doesn't delay the others.
+#define RESOLVER_THREADS 2
+// The maximum number of hosts kept in the cache.
+#define RESOLVER_MAX_ENTRIES 32
+
+namespace OTF {
+  struct ResolvedAddress {
+    struct sockaddr_storage address;
+    socklen_t length;
+  };
+
+  enum ResolveStatus {
+    RESOLVE_PENDING,
+    RESOLVE_OK,
+    RESOLVE_FAILED
+  };
+
+  /**
+   * Resolves host names with getaddrinfo on helper threads and caches the results. Concurrent requests for the same
+   * host share a single lookup, and expired addresses keep being returned while they are refreshed so a burst of
+   * reconnects after a network outage doesn't wait on DNS. Addresses are returned with IPv6 and IPv4 interleaved,
+   * starting with the family preferred by the system, as recommended for Happy Eyeballs (RFC 8305).
+   */
+  class Resolver {
+  private:
+    struct Entry {
+      ResolveStatus status;
+      std::vector<ResolvedAddress> addresses;
+      unsigned long resolvedAt;
+      /** The time in milliseconds after `resolvedAt` the entry should be refreshed. */
+      unsigned long validFor;
+      unsigned long lastUsed;
+      /** Indicates if a lookup of the host is queued or running. */
+      bool refreshing;
+    };
+
+    std::mutex mutex;
+    std::condition_variable lookupQueued;
+    std::condition_variable lookupFinished;
+    std::deque<std::string> queue;
+    std::map<std::string, Entry> cache;
+    std::vector<std::thread> threads;
+    unsigned long ttl = RESOLVER_TTL;
+    unsigned long negativeTtl = RESOLVER_NEGATIVE_TTL;
+    bool stopping = false;
+
+    Resolver();
+    void work();
+    /** Queues a lookup of the host if one isn't already running. Must be called with the mutex held. */
+    void queueLookup(const std::string &host, Entry &entry);
+    /** Removes the least recently used entries that aren't being resolved. Must be called with the mutex held. */
+    void trim();
+    static void lookup(const std::string &host, Entry &result);
+    /** Parses a numeric IPv4 or IPv6 address, which doesn't need to be looked up. */
+    static bool parseNumeric(const char *host, uint16_t port, std::vector<ResolvedAddress> &out);
+    static void copyAddresses(const std::vector<ResolvedAddress> &addresses, uint16_t port, std::vector<ResolvedAddress> &out);
+
+  public:
+    ~Resolver();
+
+    /** Returns the resolver shared by all connections. */
+    static Resolver &instance();
+
+    /**
+     * Returns the addresses of a host without blocking, starting a lookup if the host isn't cached.
+     * @param host The host name or numeric address.
+     * @param port The port to set in the returned addresses.
+     * @param out Set to the addresses of the host if the status is RESOLVE_OK.
+     * @return RESOLVE_PENDING if the lookup hasn't completed yet and the method should be called again later.
+     */
+    ResolveStatus resolve(const char *host, uint16_t port, std::vector<ResolvedAddress> &out);
+
+    /**
+     * Returns the addresses of a host, waiting up to `timeout` milliseconds for the lookup to complete. The lookup
+     * continues in the background if it times out, and its result is cached for the next call.
+     * @return A boolean indicating if the host was resolved.
+     */
+    bool resolve(const char *host, uint16_t port, std::vector<ResolvedAddress> &out, unsigned long timeout);
+
+    /**
+     * Sets how long lookup results are cached.
+     * @param ttl Time in milliseconds successful lookups are used for.
+     * @param negativeTtl Time in milliseconds failed lookups are remembered for.
+     */
+    void setTtl(unsigned long ttl, unsigned long negativeTtl);
+
+    /** Removes all cached results, such as after the network configuration changes. */
+    void clear();
+  };
+}// namespace OTF
+
+#endif
+#endif
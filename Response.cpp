@@ -9,6 +9,7 @@ void Response::writeStatus(uint16_t statusCode, const String &statusMessage) {
     return;
   }
   responseStatus = STATUS_WRITTEN;
+  this->statusCode = statusCode;
 
   bprintf(F("HTTP/1.1 %d %s\r\n"), statusCode, statusMessage.c_str());
 }
@@ -19,6 +20,7 @@ void Response::writeStatus(uint16_t statusCode, const __FlashStringHelper *const
     return;
   }
   responseStatus = STATUS_WRITTEN;
+  this->statusCode = statusCode;
 
   bprintf(F("HTTP/1.1 %d %s\r\n"), statusCode, statusMessage);
 }
@@ -29,6 +31,7 @@ void Response::writeStatus(uint16_t statusCode, const char *statusMessage) {
     return;
   }
   responseStatus = STATUS_WRITTEN;
+  this->statusCode = statusCode;
 
   bprintf(F("HTTP/1.1 %d %s\r\n"), statusCode, statusMessage);
 }
@@ -166,4 +169,14 @@ void Response::writeBodyData(const __FlashStringHelper *const data, size_t lengt
 
   write_P(data, length);
 }
-#endif
\ No newline at end of file
+#endif
+
+std::shared_ptr<DeferredResponse> Response::defer(unsigned long timeout) {
+  if (!deferHandler) {
+    return nullptr;
+  }
+
+  std::shared_ptr<DeferredResponse> deferred = deferHandler(timeout);
+  deferHandler = nullptr;
+  return deferred;
+}
@@ -2,22 +2,32 @@
 #define OTF_RESPONSE_H
 
 #include "StringBuilder.hpp"
+#include <functional>
+#include <memory>
 
 #if defined(ARDUINO)
 #include <Arduino.h>
 #else
 #include <stdint.h>
-#include <functional>
 #include <stdarg.h>
 #endif
 
 // The maximum possible size of response messages.
 #define RESPONSE_BUFFER_SIZE 4096
+#ifndef DEFERRED_RESPONSE_TIMEOUT
+// The default time in milliseconds a deferred response may take before a 504 response is sent instead.
+#define DEFERRED_RESPONSE_TIMEOUT 10000
+#endif
 
 namespace OTF {
+  class DeferredResponse;
 
   class Response : public StringBuilder {
     friend class OpenThingsFramework;
+#if defined(OTF_BENCHMARK)
+    // Gives the benchmarks in extras/bench access to the internals they measure.
+    friend class BenchmarkAccess;
+#endif
 
   private:
     enum ResponseStatus {
@@ -27,10 +37,13 @@ namespace OTF {
       BODY_WRITTEN
     };
     ResponseStatus responseStatus = CREATED;
+    /** The status code written to the response, or 0 if no status has been written. */
+    uint16_t statusCode = 0;
+    /** Parks the request being responded to, or nullptr if the response can't be deferred. */
+    std::function<std::shared_ptr<DeferredResponse>(unsigned long timeout)> deferHandler;
 
     Response() : StringBuilder(RESPONSE_BUFFER_SIZE) {}
 
-
   public:
     static const size_t MAX_RESPONSE_LENGTH = RESPONSE_BUFFER_SIZE;
 
@@ -71,6 +84,17 @@ namespace OTF {
     void writeBodyChunk(const __FlashStringHelper *const format, ...);
     void writeBodyData(const __FlashStringHelper *const data, size_t max_length);
 #endif
+
+    /**
+     * Defers the response so the callback can return before the result is available, such as while waiting for a
+     * sensor or another device. Anything written to this response is discarded, and the connection is kept open until
+     * DeferredResponse::complete() is called from a later call to loop() or from another thread. The request is freed
+     * when the callback returns, so copy anything needed to build the response before then.
+     * @param timeout Time in milliseconds before a 504 response is sent instead.
+     * @return The deferred response, or nullptr if the response can't be deferred because too many responses are
+     * already deferred or it was already deferred.
+     */
+    std::shared_ptr<DeferredResponse> defer(unsigned long timeout = DEFERRED_RESPONSE_TIMEOUT);
   };
 }// namespace OTF
 #endif
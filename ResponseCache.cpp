@@ -0,0 +1,258 @@
+#include "ResponseCache.h"
+
+using namespace OTF;
+
+// The maximum number of query parameters that are sorted when normalizing a query. Requests with more parameters are not cached.
+#define CACHE_MAX_QUERY_PARAMS 16
+// The initial size of the buffer a response is recorded into. It grows as needed up to the size of the cache.
+#define CACHE_CAPTURE_INITIAL_SIZE 512
+
+ResponseCache::ResponseCache(size_t maxBytes) : maxBytes(maxBytes) {}
+
+ResponseCache::~ResponseCache() {
+  invalidateAll();
+  abortCapture();
+
+  LinkedMapNode<unsigned long *> *node = ttls.head;
+  while (node != nullptr) {
+    delete node->value;
+    delete[] node->key;
+    node = node->next;
+  }
+}
+
+size_t ResponseCache::entrySize(const Entry *entry) {
+  return sizeof(Entry) + strlen(entry->key) + 1 + entry->length;
+}
+
+void ResponseCache::setTtl(const char *path, unsigned long ttl) {
+  unsigned long *existing = ttls.find(path);
+  if (existing != nullptr) {
+    *existing = ttl;
+  } else {
+    // The map does not copy its keys, so the path must outlive it.
+    char *key = new char[strlen(path) + 1];
+    strcpy(key, path);
+    ttls.add(key, new unsigned long(ttl));
+  }
+  invalidate(path);
+}
+
+unsigned long ResponseCache::getTtl(const char *path) const {
+  unsigned long *ttl = ttls.find(path);
+  return ttl != nullptr ? *ttl : 0;
+}
+
+bool ResponseCache::makeKey(StringBuilder &sb, const Request &req) {
+  sb.bprintf(F("%c%d%s?"), req.isCloudRequest() ? 'C' : 'L', req.httpMethod, req.getPath());
+
+  // Sort the parameters by key and value so that the order they were specified in doesn't matter.
+  LinkedMapNode<char *> *params[CACHE_MAX_QUERY_PARAMS];
+  size_t count = 0;
+  for (LinkedMapNode<char *> *node = req.queryParams.head; node != nullptr; node = node->next) {
+    if (count >= CACHE_MAX_QUERY_PARAMS) {
+      return false;
+    }
+
+    size_t i = count++;
+    for (; i > 0; i--) {
+      int cmp = strcmp(params[i - 1]->key, node->key);
+      if (cmp < 0 || (cmp == 0 && strcmp(params[i - 1]->value, node->value) <= 0)) {
+        break;
+      }
+      params[i] = params[i - 1];
+    }
+    params[i] = node;
+  }
+
+  // Length prefix each key and value since decoded values may contain any separator character.
+  for (size_t i = 0; i < count; i++) {
+    sb.bprintf(F("&%u:%s=%u:%s"), (unsigned) strlen(params[i]->key), params[i]->key,
+               (unsigned) strlen(params[i]->value), params[i]->value);
+  }
+
+  return sb.isValid();
+}
+
+void ResponseCache::unlink(Entry *entry) {
+  if (entry->prev != nullptr) {
+    entry->prev->next = entry->next;
+  } else {
+    head = entry->next;
+  }
+
+  if (entry->next != nullptr) {
+    entry->next->prev = entry->prev;
+  } else {
+    tail = entry->prev;
+  }
+
+  entry->prev = nullptr;
+  entry->next = nullptr;
+}
+
+void ResponseCache::pushFront(Entry *entry) {
+  entry->prev = nullptr;
+  entry->next = head;
+  if (head != nullptr) {
+    head->prev = entry;
+  } else {
+    tail = entry;
+  }
+  head = entry;
+}
+
+void ResponseCache::remove(Entry *entry) {
+  unlink(entry);
+  usedBytes -= entrySize(entry);
+  delete[] entry->key;
+  delete[] entry->data;
+  delete entry;
+}
+
+void ResponseCache::evict(size_t needed) {
+  // Drop the least recently used entries until the new entry fits in the budget.
+  while (tail != nullptr && usedBytes + needed > maxBytes) {
+    CACHE_DEBUG((char *) F("Evicting '%s'\n"), tail->key);
+    remove(tail);
+  }
+}
+
+const ResponseCache::Entry *ResponseCache::find(const char *key) {
+  for (Entry *entry = head; entry != nullptr; entry = entry->next) {
+    if (strcmp(entry->key, key) != 0) {
+      continue;
+    }
+
+    if (millis() - entry->createdAt >= entry->ttl) {
+      CACHE_DEBUG((char *) F("Entry '%s' expired\n"), key);
+      remove(entry);
+      return nullptr;
+    }
+
+    unlink(entry);
+    pushFront(entry);
+    return entry;
+  }
+
+  return nullptr;
+}
+
+void ResponseCache::beginCapture(const char *key, unsigned long ttl, size_t skip) {
+  abortCapture();
+
+  captureKey = new char[strlen(key) + 1];
+  strcpy(captureKey, key);
+  captureTtl = ttl;
+  captureSkip = skip;
+  captureLength = 0;
+  captureCapacity = 0;
+}
+
+void ResponseCache::capture(const char *data, size_t length) {
+  if (captureKey == nullptr) {
+    return;
+  }
+
+  if (captureSkip > 0) {
+    size_t skipped = captureSkip < length ? captureSkip : length;
+    captureSkip -= skipped;
+    data += skipped;
+    length -= skipped;
+  }
+
+  // Give up on responses that could never fit in the cache.
+  if (sizeof(Entry) + strlen(captureKey) + 1 + captureLength + length > maxBytes) {
+    CACHE_DEBUG(F("Response is too large to cache\n"));
+    abortCapture();
+    return;
+  }
+
+  if (captureLength + length > captureCapacity) {
+    size_t capacity = captureCapacity > 0 ? captureCapacity * 2 : CACHE_CAPTURE_INITIAL_SIZE;
+    while (capacity < captureLength + length) {
+      capacity *= 2;
+    }
+
+    char *buffer = new char[capacity];
+    if (captureData != nullptr) {
+      memcpy(buffer, captureData, captureLength);
+      delete[] captureData;
+    }
+    captureData = buffer;
+    captureCapacity = capacity;
+  }
+
+  memcpy(&captureData[captureLength], data, length);
+  captureLength += length;
+}
+
+void ResponseCache::endCapture(bool store) {
+  if (captureKey == nullptr) {
+    return;
+  }
+
+  // Only cache successful responses so transient errors are not served repeatedly.
+  if (!store || captureLength < 10 || strncmp_P(captureData, (char *) F("HTTP/1.1 2"), 10) != 0) {
+    abortCapture();
+    return;
+  }
+
+  Entry *entry = new Entry();
+  entry->key = captureKey;
+  entry->length = captureLength;
+  entry->createdAt = millis();
+  entry->ttl = captureTtl;
+  // Shrink the buffer to the exact size of the response.
+  entry->data = new char[captureLength];
+  memcpy(entry->data, captureData, captureLength);
+  delete[] captureData;
+  captureKey = nullptr;
+  captureData = nullptr;
+
+  size_t size = entrySize(entry);
+  if (size > maxBytes) {
+    delete[] entry->key;
+    delete[] entry->data;
+    delete entry;
+    return;
+  }
+
+  evict(size);
+  pushFront(entry);
+  usedBytes += size;
+  CACHE_DEBUG((char *) F("Cached '%s' (%d bytes)\n"), entry->key, (int) entry->length);
+}
+
+void ResponseCache::abortCapture() {
+  delete[] captureKey;
+  delete[] captureData;
+  captureKey = nullptr;
+  captureData = nullptr;
+  captureLength = 0;
+  captureCapacity = 0;
+}
+
+void ResponseCache::invalidate(const char *path) {
+  size_t pathLength = strlen(path);
+  Entry *entry = head;
+  while (entry != nullptr) {
+    Entry *next = entry->next;
+    // Skip over the origin and method at the start of the key.
+    const char *keyPath = &entry->key[2];
+    if (strncmp(keyPath, path, pathLength) == 0 && keyPath[pathLength] == '?') {
+      remove(entry);
+    }
+    entry = next;
+  }
+}
+
+void ResponseCache::invalidateAll() {
+  while (head != nullptr) {
+    remove(head);
+  }
+}
+
+size_t ResponseCache::getUsedBytes() const {
+  return usedBytes;
+}
@@ -0,0 +1,127 @@
+#ifndef OTF_RESPONSECACHE_H
+#define OTF_RESPONSECACHE_H
+
+#include "Request.h"
+#include "StringBuilder.hpp"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+unsigned long millis();
+#endif
+
+#ifdef SERIAL_DEBUG
+#if defined(ARDUINO)
+#define CACHE_DEBUG(...)          \
+  Serial.print("Cache: "); \
+  Serial.printf(__VA_ARGS__)
+#else
+#define CACHE_DEBUG(...)          \
+  fprintf(stdout, "Cache: "); \
+  fprintf(stdout, __VA_ARGS__)
+#endif
+#else
+#define CACHE_DEBUG(...)
+#endif
+
+// The default number of bytes (keys, responses and bookkeeping) the response cache may hold.
+#define RESPONSE_CACHE_SIZE 8192
+// The maximum length of a cache key (origin, method, path and normalized query).
+#define CACHE_KEY_MAX_LENGTH 256
+
+namespace OTF {
+  /**
+   * Stores complete serialized responses of idempotent GET routes for a per-route TTL. Entries are evicted in least
+   * recently used order once the byte budget is exceeded, and can be explicitly invalidated when the state they
+   * reflect changes.
+   */
+  class ResponseCache {
+  public:
+    struct Entry {
+      char *key;
+      char *data;
+      size_t length;
+      unsigned long createdAt;
+      unsigned long ttl;
+      Entry *prev;
+      Entry *next;
+    };
+
+  private:
+    size_t maxBytes;
+    size_t usedBytes = 0;
+    /** The most recently used entry. */
+    Entry *head = nullptr;
+    /** The least recently used entry. */
+    Entry *tail = nullptr;
+    LinkedMap<unsigned long *> ttls;
+
+    char *captureKey = nullptr;
+    char *captureData = nullptr;
+    size_t captureLength = 0;
+    size_t captureCapacity = 0;
+    size_t captureSkip = 0;
+    unsigned long captureTtl = 0;
+
+    static size_t entrySize(const Entry *entry);
+
+    void unlink(Entry *entry);
+    void pushFront(Entry *entry);
+    void remove(Entry *entry);
+    void evict(size_t needed);
+    void abortCapture();
+
+  public:
+    explicit ResponseCache(size_t maxBytes);
+    ~ResponseCache();
+
+    /**
+     * Enables caching of GET responses for the specified path.
+     * @param path The path of the route (not including the query).
+     * @param ttl The number of milliseconds a cached response remains valid for, or 0 to disable caching of the route.
+     */
+    void setTtl(const char *path, unsigned long ttl);
+
+    /** Returns the TTL of the specified path in milliseconds, or 0 if responses for the path are not cached. */
+    unsigned long getTtl(const char *path) const;
+
+    /**
+     * Writes the cache key of a request to `sb`. The key includes whether the request came through the cloud since
+     * handlers may respond differently to already authenticated requests.
+     * @return A boolean indicating if the key fit in the builder.
+     */
+    static bool makeKey(StringBuilder &sb, const Request &req);
+
+    /** Returns the unexpired entry with the specified key and marks it as most recently used, or nullptr if there is none. */
+    const Entry *find(const char *key);
+
+    /**
+     * Starts recording the response passed to capture().
+     * @param key The cache key of the request.
+     * @param ttl The TTL of the entry that will be stored.
+     * @param skip The number of leading bytes that are not part of the response (such as the cloud response prefix).
+     */
+    void beginCapture(const char *key, unsigned long ttl, size_t skip);
+
+    /** Appends a chunk of the response being recorded. Does nothing if no response is being recorded. */
+    void capture(const char *data, size_t length);
+
+    /**
+     * Finishes recording a response.
+     * @param store Indicates if the response was built successfully and should be stored. Only 2xx responses are stored.
+     */
+    void endCapture(bool store);
+
+    /** Removes all entries for the specified path, regardless of their query. */
+    void invalidate(const char *path);
+
+    /** Removes all entries. */
+    void invalidateAll();
+
+    /** Returns the number of bytes currently used by the cache. */
+    size_t getUsedBytes() const;
+  };
+}// namespace OTF
+
+#endif
@@ -0,0 +1,345 @@
+#include "Scheduler.h"
+
+#if !defined(ARDUINO)
+#include <poll.h>
+#endif
+
+#define SCHEDULER_SLOT_MASK (SCHEDULER_WHEEL_SLOTS - 1)
+// Delays are limited so the expiry tick stays comparable with the current tick after wrapping around.
+#define SCHEDULER_MAX_DELAY 0x7fffffffUL
+
+using namespace OTF;
+
+Timer::~Timer() {
+  if (scheduler != nullptr) {
+    scheduler->stop(*this);
+  }
+}
+
+void Timer::setTask(task_t task) {
+  this->task = task;
+}
+
+bool Timer::isScheduled() const {
+  return pprev != nullptr;
+}
+
+#if !defined(ARDUINO)
+FdWatch::~FdWatch() {
+  if (scheduler != nullptr) {
+    scheduler->unwatch(*this);
+  }
+}
+
+void FdWatch::setTask(task_t task) {
+  this->task = task;
+}
+
+bool FdWatch::isWatching() const {
+  return pprev != nullptr;
+}
+
+short FdWatch::getReadyEvents() const {
+  return revents;
+}
+#endif
+
+Scheduler::Scheduler() {
+  currentTick = (uint32_t) millis();
+}
+
+Scheduler::~Scheduler() {
+  for (int level = 0; level < SCHEDULER_WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < SCHEDULER_WHEEL_SLOTS; slot++) {
+      while (wheel[level][slot] != nullptr) {
+        Timer *timer = wheel[level][slot];
+        unlink(*timer);
+        if (timer->owned) {
+          delete timer;
+        }
+      }
+    }
+  }
+
+  while (dueHead != nullptr) {
+    Timer *timer = dueHead;
+    unlink(*timer);
+    if (timer->owned) {
+      delete timer;
+    }
+  }
+
+#if !defined(ARDUINO)
+  while (watchHead != nullptr) {
+    unlink(*watchHead);
+  }
+  delete[] pollfds;
+#endif
+}
+
+void Scheduler::insert(Timer &timer) {
+  int32_t delta = (int32_t) (timer.expires - currentTick);
+  if (delta <= 0) {
+    appendDue(timer);
+    return;
+  }
+
+  // Use the lowest level whose range covers the delay. Longer delays are kept in the top level and cascaded into it again.
+  int level = 0;
+  while (level < SCHEDULER_WHEEL_LEVELS - 1 && ((uint32_t) delta >> (SCHEDULER_WHEEL_BITS * (level + 1))) != 0) {
+    level++;
+  }
+  Timer **head = &wheel[level][(timer.expires >> (SCHEDULER_WHEEL_BITS * level)) & SCHEDULER_SLOT_MASK];
+
+  timer.next = *head;
+  if (*head != nullptr) {
+    (*head)->pprev = &timer.next;
+  }
+  *head = &timer;
+  timer.pprev = head;
+  timer.due = false;
+  wheelCount++;
+}
+
+void Scheduler::appendDue(Timer &timer) {
+  timer.next = nullptr;
+  timer.pprev = dueTail;
+  *dueTail = &timer;
+  dueTail = &timer.next;
+  timer.due = true;
+  dueCount++;
+}
+
+void Scheduler::unlink(Timer &timer) {
+  *timer.pprev = timer.next;
+  if (timer.next != nullptr) {
+    timer.next->pprev = timer.pprev;
+  } else if (timer.due) {
+    dueTail = timer.pprev;
+  }
+  if (timer.due) {
+    dueCount--;
+  } else {
+    wheelCount--;
+  }
+
+  timer.next = nullptr;
+  timer.pprev = nullptr;
+  timer.due = false;
+  timer.scheduler = nullptr;
+}
+
+void Scheduler::cascade(int level, int slot) {
+  Timer *timer = wheel[level][slot];
+  wheel[level][slot] = nullptr;
+  while (timer != nullptr) {
+    Timer *next = timer->next;
+    wheelCount--;
+    insert(*timer);
+    timer = next;
+  }
+}
+
+void Scheduler::advance() {
+  uint32_t now = (uint32_t) millis();
+  while (wheelCount > 0 && (int32_t) (now - currentTick) > 0) {
+    currentTick++;
+
+    // When a level wraps around, the next slot of the level above it is moved down.
+    uint32_t tick = currentTick;
+    for (int level = 1; level < SCHEDULER_WHEEL_LEVELS && (tick & SCHEDULER_SLOT_MASK) == 0; level++) {
+      tick >>= SCHEDULER_WHEEL_BITS;
+      cascade(level, tick & SCHEDULER_SLOT_MASK);
+    }
+
+    // Every timer in the current slot of the first level expires on this tick.
+    Timer **head = &wheel[0][currentTick & SCHEDULER_SLOT_MASK];
+    while (*head != nullptr) {
+      Timer *timer = *head;
+      unlink(*timer);
+      timer->scheduler = this;
+      appendDue(*timer);
+    }
+  }
+
+  // There is nothing to expire while the wheel is empty, so skip ahead.
+  if (wheelCount == 0) {
+    currentTick = now;
+  }
+}
+
+void Scheduler::start(Timer &timer, unsigned long delay, unsigned long period) {
+  if (timer.scheduler != nullptr) {
+    timer.scheduler->stop(timer);
+  }
+  if (wheelCount == 0) {
+    currentTick = (uint32_t) millis();
+  }
+
+  if (delay > SCHEDULER_MAX_DELAY) {
+    delay = SCHEDULER_MAX_DELAY;
+  }
+  timer.expires = (uint32_t) millis() + (uint32_t) delay;
+  timer.period = period > SCHEDULER_MAX_DELAY ? SCHEDULER_MAX_DELAY : period;
+  timer.scheduler = this;
+  insert(timer);
+}
+
+void Scheduler::stop(Timer &timer) {
+  if (timer.scheduler == this && timer.isScheduled()) {
+    unlink(timer);
+  }
+  timer.scheduler = nullptr;
+}
+
+void Scheduler::setTimeout(task_t task, unsigned long delay) {
+  Timer *timer = new Timer(task);
+  timer->owned = true;
+  start(*timer, delay);
+}
+
+void Scheduler::defer(task_t task) {
+  Timer *timer = new Timer(task);
+  timer->owned = true;
+  timer->scheduler = this;
+  appendDue(*timer);
+}
+
+#if !defined(ARDUINO)
+void Scheduler::watch(FdWatch &watch, int fd, short events, unsigned long timeout) {
+  if (watch.scheduler != nullptr) {
+    watch.scheduler->unwatch(watch);
+  }
+
+  watch.fd = fd;
+  watch.events = events;
+  watch.revents = 0;
+  watch.start = millis();
+  watch.timeout = timeout;
+  watch.fired = false;
+  watch.scheduler = this;
+  watch.next = watchHead;
+  if (watchHead != nullptr) {
+    watchHead->pprev = &watch.next;
+  }
+  watchHead = &watch;
+  watch.pprev = &watchHead;
+  watchCount++;
+}
+
+void Scheduler::unwatch(FdWatch &watch) {
+  if (watch.scheduler == this && watch.isWatching()) {
+    unlink(watch);
+  }
+  watch.scheduler = nullptr;
+}
+
+void Scheduler::unlink(FdWatch &watch) {
+  *watch.pprev = watch.next;
+  if (watch.next != nullptr) {
+    watch.next->pprev = watch.pprev;
+  }
+  watchCount--;
+
+  watch.next = nullptr;
+  watch.pprev = nullptr;
+  watch.fired = false;
+  watch.scheduler = nullptr;
+}
+
+void Scheduler::pollWatches() {
+  if (watchHead == nullptr) {
+    return;
+  }
+
+  if (pollfdCapacity < watchCount) {
+    delete[] pollfds;
+    pollfds = new struct pollfd[watchCount];
+    pollfdCapacity = watchCount;
+  }
+  size_t count = 0;
+  for (FdWatch *watch = watchHead; watch != nullptr; watch = watch->next) {
+    pollfds[count].fd = watch->fd;
+    pollfds[count].events = watch->events;
+    pollfds[count].revents = 0;
+    count++;
+  }
+
+  int result = ::poll(pollfds, count, 0);
+  unsigned long now = millis();
+  count = 0;
+  for (FdWatch *watch = watchHead; watch != nullptr; watch = watch->next) {
+    watch->revents = result > 0 ? pollfds[count].revents & (watch->events | POLLERR | POLLHUP | POLLNVAL) : 0;
+    watch->fired = watch->revents != 0 || (watch->timeout > 0 && now - watch->start >= watch->timeout);
+    count++;
+  }
+
+  // A task may stop or destroy any watch, so start from the head again after each one.
+  FdWatch *watch = watchHead;
+  while (watch != nullptr) {
+    if (!watch->fired) {
+      watch = watch->next;
+      continue;
+    }
+
+    unlink(*watch);
+    // Run a copy of the task, since the task may destroy the watch.
+    task_t task = watch->task;
+    if (task) {
+      task();
+    }
+    watch = watchHead;
+  }
+}
+#endif
+
+void Scheduler::setBudget(unsigned long budget) {
+  this->budget = budget;
+}
+
+unsigned long Scheduler::getBudget() const {
+  return budget;
+}
+
+void Scheduler::run() {
+#if !defined(ARDUINO)
+  pollWatches();
+#endif
+  advance();
+  if (dueHead == nullptr) {
+    return;
+  }
+
+  // Only run the tasks that are already due, so a task that defers another task can't keep the loop busy.
+  size_t count = dueCount;
+  unsigned long start = micros();
+  for (size_t i = 0; i < count && dueHead != nullptr; i++) {
+    Timer *timer = dueHead;
+    unlink(*timer);
+    if (timer->period > 0) {
+      // Restart periodic timers before running them so the task can stop its own timer.
+      timer->expires += timer->period;
+      if ((int32_t) (timer->expires - currentTick) <= 0) {
+        // Don't try to catch up on runs that were missed while the loop was busy.
+        timer->expires = currentTick + timer->period;
+      }
+      timer->scheduler = this;
+      insert(*timer);
+    }
+
+    if (timer->task) {
+      timer->task();
+    }
+    if (timer->owned) {
+      delete timer;
+    }
+
+    if (budget > 0 && micros() - start >= budget) {
+      break;
+    }
+  }
+}
+
+size_t Scheduler::getDueCount() const {
+  return dueCount;
+}
@@ -0,0 +1,221 @@
+#ifndef OTF_SCHEDULER_H
+#define OTF_SCHEDULER_H
+
+#include <functional>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+unsigned long millis();
+unsigned long micros();
+struct pollfd;
+#endif
+
+#ifndef SCHEDULER_WHEEL_BITS
+// The number of slots in each level of the timer wheel is 2 to the power of this.
+#define SCHEDULER_WHEEL_BITS 5
+#endif
+#ifndef SCHEDULER_WHEEL_LEVELS
+/* The number of levels of the timer wheel. With 32 slots per level and a tick of 1 ms, 4 levels cover delays of up to
+ * about 17 minutes before timers have to be cascaded more than once.
+ */
+#define SCHEDULER_WHEEL_LEVELS 4
+#endif
+#ifndef SCHEDULER_LOOP_BUDGET
+/* The default time in microseconds loop() spends running due timers and deferred tasks. Tasks that don't fit in the
+ * budget are run by the next call, but at least one is always run.
+ */
+#define SCHEDULER_LOOP_BUDGET 10000
+#endif
+
+#define SCHEDULER_WHEEL_SLOTS (1 << SCHEDULER_WHEEL_BITS)
+
+namespace OTF {
+  class Scheduler;
+
+  typedef std::function<void()> task_t;
+
+  /**
+   * A timer that runs a task after a delay, and optionally repeats with a fixed period. Timers are linked directly into
+   * the scheduler's wheel, so starting and stopping one doesn't allocate and takes constant time. A timer is stopped
+   * automatically when it is destroyed.
+   */
+  class Timer {
+    friend class Scheduler;
+
+  private:
+    task_t task;
+    Scheduler *scheduler = nullptr;
+    Timer *next = nullptr;
+    /** The pointer that points to this timer, so it can be unlinked without searching its list. */
+    Timer **pprev = nullptr;
+    /** The tick the timer expires on. */
+    uint32_t expires = 0;
+    unsigned long period = 0;
+    /** Indicates if the timer was created by the scheduler and should be deleted after it runs. */
+    bool owned = false;
+    /** Indicates if the timer is in the list of due tasks rather than in the wheel. */
+    bool due = false;
+
+  public:
+    Timer() {}
+    Timer(task_t task) : task(task) {}
+    ~Timer();
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    /** Sets the task to run when the timer expires. */
+    void setTask(task_t task);
+
+    /** Returns a boolean indicating if the timer is waiting to run. */
+    bool isScheduled() const;
+  };
+
+#if !defined(ARDUINO)
+  /**
+   * A file descriptor watched by the scheduler. Its task runs from loop() once the descriptor is ready or the timeout
+   * passes, after which the watch is stopped. A watch is stopped automatically when it is destroyed, and may be
+   * destroyed by its own task.
+   */
+  class FdWatch {
+    friend class Scheduler;
+
+  private:
+    task_t task;
+    Scheduler *scheduler = nullptr;
+    FdWatch *next = nullptr;
+    /** The pointer that points to this watch, so it can be unlinked without searching the list. */
+    FdWatch **pprev = nullptr;
+    int fd = -1;
+    short events = 0;
+    short revents = 0;
+    unsigned long start = 0;
+    unsigned long timeout = 0;
+    /** Indicates if the task should run because the descriptor is ready or the timeout passed. */
+    bool fired = false;
+
+  public:
+    FdWatch() {}
+    ~FdWatch();
+
+    FdWatch(const FdWatch &) = delete;
+    FdWatch &operator=(const FdWatch &) = delete;
+
+    /** Sets the task to run when the descriptor is ready or the timeout passes. */
+    void setTask(task_t task);
+
+    /** Returns a boolean indicating if the descriptor is being watched. */
+    bool isWatching() const;
+
+    /** Returns the poll() events the descriptor was ready for when the task ran, or 0 if the timeout passed. */
+    short getReadyEvents() const;
+  };
+#endif
+
+  /**
+   * Runs timers and deferred tasks from OpenThingsFramework::loop(). Timers are kept in a hierarchical timer wheel
+   * with a tick of 1 ms, so starting, stopping and expiring a timer all take constant time no matter how many timers
+   * are pending. Tasks run on the thread calling loop(), so they may use the framework without any locking.
+   */
+  class Scheduler {
+    friend class Timer;
+
+  private:
+    /** The heads of the timer lists of each slot of each level. */
+    Timer *wheel[SCHEDULER_WHEEL_LEVELS][SCHEDULER_WHEEL_SLOTS] = {};
+    /** The timers that have expired and the deferred tasks, in the order they should run. */
+    Timer *dueHead = nullptr;
+    Timer **dueTail = &dueHead;
+    size_t dueCount = 0;
+    /** The last tick the wheel was advanced to. */
+    uint32_t currentTick;
+    /** The number of timers in the wheel, so the wheel doesn't have to be advanced tick by tick while it's empty. */
+    size_t wheelCount = 0;
+    unsigned long budget = SCHEDULER_LOOP_BUDGET;
+#if !defined(ARDUINO)
+    FdWatch *watchHead = nullptr;
+    size_t watchCount = 0;
+    /** The array passed to poll(), which is kept between calls and only grows. */
+    struct pollfd *pollfds = nullptr;
+    size_t pollfdCapacity = 0;
+#endif
+
+    /** Adds a timer to the wheel, or to the due list if it has already expired. */
+    void insert(Timer &timer);
+    void appendDue(Timer &timer);
+    void unlink(Timer &timer);
+    /** Moves the timers of a slot to the level below, or to the due list if they have expired. */
+    void cascade(int level, int slot);
+    /** Advances the wheel to the current time, moving expired timers to the due list. */
+    void advance();
+#if !defined(ARDUINO)
+    void unlink(FdWatch &watch);
+    /** Checks every watched descriptor with a single poll() and runs the tasks of the ready and timed out watches. */
+    void pollWatches();
+#endif
+
+  public:
+    Scheduler();
+    ~Scheduler();
+
+    /**
+     * Starts a timer, or restarts it if it's already scheduled.
+     * @param timer The timer, which must stay valid until it runs or is stopped.
+     * @param delay Time in milliseconds before the timer runs.
+     * @param period Time in milliseconds between runs after the first one, or 0 to only run once.
+     */
+    void start(Timer &timer, unsigned long delay, unsigned long period = 0);
+
+    /** Stops a timer if it's scheduled. */
+    void stop(Timer &timer);
+
+    /**
+     * Runs a task once after a delay. Unlike a Timer, the task can't be cancelled, but no storage has to be provided
+     * for it.
+     * @param task
+     * @param delay Time in milliseconds before the task runs.
+     */
+    void setTimeout(task_t task, unsigned long delay);
+
+    /**
+     * Runs a task from the next call to loop(), after any timers that have already expired. Callbacks can use this to
+     * finish work after their response has been sent.
+     */
+    void defer(task_t task);
+
+    /**
+     * Sets how long each call to run() may spend running tasks.
+     * @param budget Time in microseconds, or 0 to run all of the tasks that are due.
+     */
+    void setBudget(unsigned long budget);
+    unsigned long getBudget() const;
+
+#if !defined(ARDUINO)
+    /**
+     * Starts watching a file descriptor, or restarts the watch if it's already watching one.
+     * @param watch The watch, which must stay valid until its task runs or it is stopped.
+     * @param fd
+     * @param events The poll() events to wait for, such as POLLIN. Errors and hang-ups are always reported.
+     * @param timeout Time in milliseconds before the task runs anyway, or 0 to wait indefinitely.
+     */
+    void watch(FdWatch &watch, int fd, short events, unsigned long timeout = 0);
+
+    /** Stops watching a file descriptor if the watch is active. */
+    void unwatch(FdWatch &watch);
+#endif
+
+    /**
+     * Runs the timers that have expired and the deferred tasks, within the budget, and on Linux the tasks of the watched
+     * file descriptors that are ready. Called by loop().
+     */
+    void run();
+
+    /** Returns the number of tasks that are due but have not been run yet because of the budget. */
+    size_t getDueCount() const;
+  };
+}// namespace OTF
+
+#endif
@@ -0,0 +1,87 @@
+#include "SendQueue.h"
+
+using namespace OTF;
+
+SharedBuffer *SharedBuffer::create(size_t length) {
+  SharedBuffer *buffer = new SharedBuffer();
+  buffer->data = new char[length > 0 ? length : 1];
+  buffer->length = length;
+  buffer->references = 1;
+  return buffer;
+}
+
+void SharedBuffer::retain() {
+  references++;
+}
+
+void SharedBuffer::release() {
+  if (--references == 0) {
+    delete[] data;
+    delete this;
+  }
+}
+
+SendQueue::SendQueue(size_t capacity) : capacity(capacity) {
+  buffers = new SharedBuffer *[capacity];
+}
+
+SendQueue::~SendQueue() {
+  clear();
+  delete[] buffers;
+}
+
+bool SendQueue::push(SharedBuffer *buffer) {
+  if (count >= capacity) {
+    return false;
+  }
+
+  buffers[(head + count) % capacity] = buffer;
+  count++;
+  buffer->retain();
+  return true;
+}
+
+bool SendQueue::write(LocalClient *client) {
+  while (count > 0) {
+    SharedBuffer *buffer = buffers[head];
+    size_t remaining = buffer->length - sentOffset;
+    size_t written = client->writeAvailable(&buffer->data[sentOffset], remaining);
+    if (written == 0) {
+      // The connection is busy, so try again on the next call unless the write failed.
+      return client->connected();
+    }
+
+    sentOffset += written;
+    if (sentOffset < buffer->length) {
+      // The connection accepted part of the buffer, so try the rest on the next call.
+      return true;
+    }
+
+    buffer->release();
+    head = (head + 1) % capacity;
+    count--;
+    sentOffset = 0;
+  }
+  return true;
+}
+
+void SendQueue::clear() {
+  while (count > 0) {
+    buffers[head]->release();
+    head = (head + 1) % capacity;
+    count--;
+  }
+  sentOffset = 0;
+}
+
+size_t SendQueue::getCount() const {
+  return count;
+}
+
+bool SendQueue::isEmpty() const {
+  return count == 0;
+}
+
+bool SendQueue::isFull() const {
+  return count >= capacity;
+}
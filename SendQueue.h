@@ -0,0 +1,71 @@
+#ifndef OTF_SENDQUEUE_H
+#define OTF_SENDQUEUE_H
+
+#include "LocalServer.h"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+namespace OTF {
+  /**
+   * An encoded message that can be queued for several connections at once, so a broadcast is only encoded and stored
+   * once. It is freed when the last reference is released.
+   */
+  struct SharedBuffer {
+    char *data;
+    size_t length;
+    size_t references;
+
+    /** Allocates a buffer of the specified length, holding a single reference for the caller. */
+    static SharedBuffer *create(size_t length);
+
+    void retain();
+    void release();
+  };
+
+  /**
+   * A bounded queue of the messages waiting to be written to a long-lived local connection, so a connection that
+   * can't keep up doesn't hold up the others.
+   */
+  class SendQueue {
+  private:
+    SharedBuffer **buffers;
+    size_t capacity;
+    size_t head = 0;
+    size_t count = 0;
+    /** The number of bytes of the first buffer that have already been written. */
+    size_t sentOffset = 0;
+
+  public:
+    explicit SendQueue(size_t capacity);
+    ~SendQueue();
+
+    SendQueue(const SendQueue &) = delete;
+    SendQueue &operator=(const SendQueue &) = delete;
+
+    /**
+     * Adds a buffer to the end of the queue, taking a reference to it.
+     * @return A boolean indicating if the buffer was queued, or false if the queue is full.
+     */
+    bool push(SharedBuffer *buffer);
+
+    /**
+     * Writes as much of the queue as the client accepts without waiting for it (see LocalClient::writeAvailable()).
+     * @return A boolean indicating if the connection is still usable, or false if a write failed.
+     */
+    bool write(LocalClient *client);
+
+    /** Releases all of the queued buffers. */
+    void clear();
+
+    size_t getCount() const;
+    bool isEmpty() const;
+    bool isFull() const;
+  };
+}// namespace OTF
+
+#endif
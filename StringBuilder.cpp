@@ -17,17 +17,21 @@ void StringBuilder::bprintf(const char *format, va_list args) {
     return;
   }
 
+  // The arguments may need to be formatted a second time, which requires a copy since vsnprintf consumes them.
+  va_list retryArgs;
+  va_copy(retryArgs, args);
   size_t res = vsnprintf(&buffer[length], maxLength - length, format, args);
 
 
   if (streaming && ((res >= maxLength) || (length + res >= maxLength))) {
     // If in streaming mode flush the buffer and continue writing if the data doesn't fit.
-    stream_write(buffer, length, streaming);
+    stream_write(buffer, length, first_message);
     first_message = false;
     stream_flush();
     clear();
-    res = vsnprintf(&buffer[length], maxLength - length, format, args);
+    res = vsnprintf(&buffer[length], maxLength - length, format, retryArgs);
   }
+  va_end(retryArgs);
 
   totalLength += res;
   length += res;
@@ -79,7 +83,7 @@ size_t StringBuilder::_write(const char *data, size_t data_length, bool use_pgm)
     // If the buffer is full, flush it and continue writing.
     if (write_length == 0) {
       if (streaming) {
-        stream_write(buffer, length, streaming);
+        stream_write(buffer, length, first_message);
         first_message = false;
         stream_flush();
         clear();
@@ -130,7 +134,8 @@ void StringBuilder::enableStream(stream_write_t write, stream_flush_t flush, str
 
 bool StringBuilder::end() {
   if (stream_end) {
-    stream_write(buffer, length, streaming);
+    stream_write(buffer, length, first_message);
+    first_message = false;
     stream_end();
     return true;
   }
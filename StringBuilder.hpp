@@ -19,7 +19,7 @@
 #endif
 
 namespace OTF {
-  typedef std::function<void(const char *data, size_t length, bool streaming)> stream_write_t;
+  typedef std::function<void(const char *data, size_t length, bool first_message)> stream_write_t;
   typedef std::function<void()> stream_flush_t;
   typedef std::function<void()> stream_end_t;
 
@@ -0,0 +1,95 @@
+#if !defined(ARDUINO)
+#include "TaskQueue.h"
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace OTF;
+
+TaskQueue::TaskQueue(size_t capacity) : tail(0), wakeupPending(false) {
+  size_t size = 2;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  slots = new Slot[size];
+  mask = size - 1;
+  // A slot is free for the producer claiming position `i` when its sequence is `i`, and filled when it is `i + 1`.
+  for (size_t i = 0; i < size; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+TaskQueue::~TaskQueue() {
+  delete[] slots;
+  if (eventFd >= 0) {
+    close(eventFd);
+  }
+}
+
+bool TaskQueue::push(task_t task) {
+  size_t position = tail.load(std::memory_order_relaxed);
+  Slot *slot;
+  while (true) {
+    slot = &slots[position & mask];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+    if (difference == 0) {
+      if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // The consumer hasn't freed this slot since the previous lap, so the queue is full.
+      return false;
+    } else {
+      // Another producer claimed this position first.
+      position = tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->task = std::move(task);
+  slot->sequence.store(position + 1, std::memory_order_release);
+
+  if (!wakeupPending.exchange(true, std::memory_order_acq_rel) && eventFd >= 0) {
+    uint64_t value = 1;
+    ssize_t written = write(eventFd, &value, sizeof(value));
+    (void) written;
+  }
+  return true;
+}
+
+size_t TaskQueue::drain() {
+  // Clear the wakeup first, so a task posted while draining signals the eventfd again.
+  if (wakeupPending.exchange(false, std::memory_order_acq_rel) && eventFd >= 0) {
+    uint64_t value;
+    ssize_t read = ::read(eventFd, &value, sizeof(value));
+    (void) read;
+  }
+
+  // Only run the tasks posted before the call, so a task that posts another task can't keep the loop busy.
+  size_t end = tail.load(std::memory_order_acquire);
+  size_t count = 0;
+  while (head != end) {
+    Slot &slot = slots[head & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+      // The producer claimed the slot but hasn't finished writing it yet, so it will be run by the next call.
+      break;
+    }
+
+    task_t task = std::move(slot.task);
+    slot.task = nullptr;
+    // Free the slot before running the task, so producers can reuse it.
+    slot.sequence.store(head + mask + 1, std::memory_order_release);
+    head++;
+
+    task();
+    count++;
+  }
+  return count;
+}
+
+int TaskQueue::getWakeupFd() const {
+  return eventFd;
+}
+#endif
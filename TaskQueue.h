@@ -0,0 +1,64 @@
+#if !defined(ARDUINO)
+#ifndef OTF_TASKQUEUE_H
+#define OTF_TASKQUEUE_H
+
+#include "Scheduler.h"
+#include <atomic>
+#include <stddef.h>
+
+#ifndef TASK_QUEUE_SIZE
+// The number of tasks that can be posted to the framework before they are run. Must be a power of 2.
+#define TASK_QUEUE_SIZE 64
+#endif
+
+namespace OTF {
+  /**
+   * A bounded lock-free queue of tasks posted from any number of threads and run by a single thread. Each slot has a
+   * sequence number that tells producers and the consumer whether it is free or filled, so a producer only has to
+   * claim a position with a single compare-and-swap. An eventfd is signalled when tasks are posted, so the consumer can
+   * wait for work with poll() or epoll.
+   */
+  class TaskQueue {
+  private:
+    struct Slot {
+      std::atomic<size_t> sequence;
+      task_t task;
+    };
+
+    Slot *slots;
+    size_t mask;
+    /** The next position producers write to. */
+    std::atomic<size_t> tail;
+    /** The next position the consumer reads from. Only used by the consumer. */
+    size_t head = 0;
+    int eventFd;
+    /** Indicates if the eventfd has been signalled since the consumer last cleared it, to avoid redundant writes. */
+    std::atomic<bool> wakeupPending;
+
+  public:
+    /** @param capacity The maximum number of pending tasks, rounded up to a power of 2. */
+    explicit TaskQueue(size_t capacity = TASK_QUEUE_SIZE);
+    ~TaskQueue();
+
+    TaskQueue(const TaskQueue &) = delete;
+    TaskQueue &operator=(const TaskQueue &) = delete;
+
+    /**
+     * Adds a task to the queue. Safe to call from any thread.
+     * @return A boolean indicating if the task was added, or false if the queue is full.
+     */
+    bool push(task_t task);
+
+    /**
+     * Runs the tasks that were posted before the call. Must only be called from the consumer thread.
+     * @return The number of tasks that were run.
+     */
+    size_t drain();
+
+    /** Returns the eventfd that becomes readable when tasks are posted, or -1 if it could not be created. */
+    int getWakeupFd() const;
+  };
+}// namespace OTF
+
+#endif
+#endif
@@ -0,0 +1,131 @@
+#if defined(OTF_ENABLE_TRACE)
+#include "Trace.h"
+
+#if (TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) != 0
+#error "TRACE_BUFFER_EVENTS must be a power of 2"
+#endif
+
+using namespace OTF;
+
+#define OTF_TRACE_NAME(name, arg0, arg1) #name,
+static const char *const EVENT_NAMES[] = {OTF_TRACE_EVENTS(OTF_TRACE_NAME)};
+#undef OTF_TRACE_NAME
+
+#if defined(ARDUINO)
+// Events are only recorded from loop(), so the buffer doesn't need to be synchronized.
+static TraceRecord records[TRACE_BUFFER_EVENTS];
+static uint32_t recorded = 0;
+
+void Trace::record(TraceEvent event, uint32_t arg0, uint32_t arg1) {
+  TraceRecord &record = records[recorded & (TRACE_BUFFER_EVENTS - 1)];
+  record.timestamp = micros();
+  record.event = event;
+  record.arg0 = arg0;
+  record.arg1 = arg1;
+  recorded++;
+}
+
+size_t Trace::copy(TraceRecord *out) {
+  uint32_t end = recorded;
+  uint32_t start = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+  size_t count = 0;
+  for (uint32_t i = start; i != end; i++) {
+    out[count++] = records[i & (TRACE_BUFFER_EVENTS - 1)];
+  }
+  return count;
+}
+
+uint32_t Trace::getRecordedCount() {
+  return recorded;
+}
+#else
+/**
+ * A slot in the ring buffer. The sequence number is the index of the event plus 1 once the event has been written, and 0
+ * while it is being written, so readers can detect events that were overwritten while they were being copied.
+ */
+struct TraceSlot {
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> timestamp;
+  std::atomic<uint32_t> event;
+  std::atomic<uint32_t> arg0;
+  std::atomic<uint32_t> arg1;
+};
+
+static TraceSlot slots[TRACE_BUFFER_EVENTS];
+static std::atomic<uint32_t> recorded(0);
+
+void Trace::record(TraceEvent event, uint32_t arg0, uint32_t arg1) {
+  uint32_t index = recorded.fetch_add(1, std::memory_order_relaxed);
+  TraceSlot &slot = slots[index & (TRACE_BUFFER_EVENTS - 1)];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp.store(micros(), std::memory_order_relaxed);
+  slot.event.store(event, std::memory_order_relaxed);
+  slot.arg0.store(arg0, std::memory_order_relaxed);
+  slot.arg1.store(arg1, std::memory_order_relaxed);
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+size_t Trace::copy(TraceRecord *out) {
+  uint32_t end = recorded.load(std::memory_order_acquire);
+  uint32_t start = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+  size_t count = 0;
+  for (uint32_t i = start; i != end; i++) {
+    TraceSlot &slot = slots[i & (TRACE_BUFFER_EVENTS - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != i + 1) {
+      // The event is still being written or has already been overwritten.
+      continue;
+    }
+
+    TraceRecord &record = out[count];
+    record.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    record.event = slot.event.load(std::memory_order_relaxed);
+    record.arg0 = slot.arg0.load(std::memory_order_relaxed);
+    record.arg1 = slot.arg1.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == i + 1) {
+      count++;
+    }
+  }
+  return count;
+}
+
+uint32_t Trace::getRecordedCount() {
+  return recorded.load(std::memory_order_relaxed);
+}
+#endif
+
+/** Writes a little-endian integer of `size` bytes. */
+static void writeInt(StringBuilder &sb, uint32_t value, size_t size) {
+  char bytes[4];
+  for (size_t i = 0; i < size; i++) {
+    bytes[i] = (char) (value >> (8 * i));
+  }
+  sb.write(bytes, size);
+}
+
+void Trace::dump(StringBuilder &sb) {
+  TraceRecord *copied = new TraceRecord[TRACE_BUFFER_EVENTS];
+  uint32_t total = getRecordedCount();
+  size_t count = copy(copied);
+
+  sb.write(TRACE_DUMP_MAGIC, 4);
+  writeInt(sb, TRACE_DUMP_VERSION, 1);
+  writeInt(sb, sizeof(TraceRecord), 1);
+  writeInt(sb, count, 2);
+  writeInt(sb, total >= count ? total - count : 0, 4);
+  writeInt(sb, micros(), 4);
+  for (size_t i = 0; i < count; i++) {
+    writeInt(sb, copied[i].timestamp, 4);
+    writeInt(sb, copied[i].event, 4);
+    writeInt(sb, copied[i].arg0, 4);
+    writeInt(sb, copied[i].arg1, 4);
+  }
+
+  delete[] copied;
+}
+
+const char *Trace::getEventName(TraceEvent event) {
+  return event < TRACE_EVENT_COUNT ? EVENT_NAMES[event] : "UNKNOWN";
+}
+#endif
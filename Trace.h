@@ -0,0 +1,112 @@
+#ifndef OTF_TRACE_H
+#define OTF_TRACE_H
+
+/*
+ * The events that can be traced, each with a description of its two integer arguments (empty if unused). The host-side
+ * decoder (extras/trace/decode_trace.py) reads the names from this list, so events should only be added to the end to
+ * keep old dumps readable.
+ */
+#define OTF_TRACE_EVENTS(X)                                 \
+  X(LOCAL_CLIENT_ACCEPTED, "", "")                          \
+  X(LOCAL_CLIENT_TIMEOUT, "", "")                           \
+  X(LOCAL_REQUEST_TOO_LARGE, "length", "")                  \
+  X(LOCAL_REQUEST_READ, "headerLength", "bodyLength")       \
+  X(REQUEST_PARSED, "type", "method")                       \
+  X(REQUEST_ROUTED, "found", "cached")                      \
+  X(RESPONSE_SENT, "length", "valid")                       \
+  X(CLOUD_REQUEST_QUEUED, "framing", "length")              \
+  X(CLOUD_REQUEST_REJECTED, "pending", "length")            \
+  X(CLOUD_REQUEST_STARTED, "framing", "pending")            \
+  X(WEBSOCKET_CONNECTED, "", "")                            \
+  X(WEBSOCKET_DISCONNECTED, "", "")                         \
+  X(WEBSOCKET_RECONNECT_SCHEDULED, "attempt", "delay")      \
+  X(WEBSOCKET_FRAME_SENT, "length", "fin")                  \
+  X(TRACE_MARK, "arg0", "arg1")                             \
+  X(LOOP_BUDGET_EXCEEDED, "duration", "handlerDuration")    \
+  X(RESPONSE_DEFERRED, "timeout", "cloud")                  \
+  X(DEFERRED_RESPONSE_SENT, "status", "length")             \
+  X(EVENTS_SENT, "count", "length")                         \
+  X(EVENTS_DROPPED, "count", "priority")                    \
+  X(EVENTS_QUEUED, "count", "queued")                       \
+  X(EVENTS_REPLAYED, "count", "remaining")                  \
+  X(LOCAL_WEBSOCKET_OPENED, "subscriber", "count")          \
+  X(LOCAL_WEBSOCKET_CLOSED, "subscriber", "count")          \
+  X(LOCAL_WEBSOCKET_BROADCAST, "length", "subscribers")    \
+  X(EVENT_STREAM_OPENED, "client", "replayed")              \
+  X(EVENT_STREAM_CLOSED, "client", "count")                 \
+  X(EVENT_STREAM_PUSHED, "id", "clients")
+
+#if defined(OTF_ENABLE_TRACE)
+#include "StringBuilder.hpp"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+unsigned long micros();
+#endif
+
+#ifndef TRACE_BUFFER_EVENTS
+// The number of events kept in the ring buffer. Must be a power of 2.
+#define TRACE_BUFFER_EVENTS 256
+#endif
+// Identifies a trace dump, followed by the format version.
+#define TRACE_DUMP_MAGIC "OTFT"
+#define TRACE_DUMP_VERSION 1
+
+/** Records an event in the trace buffer. The arguments are not evaluated if tracing is disabled. */
+#define OTF_TRACE(event, arg0, arg1) OTF::Trace::record(OTF::TRACE_##event, (uint32_t) (arg0), (uint32_t) (arg1))
+
+namespace OTF {
+#define OTF_TRACE_ENUM(name, arg0, arg1) TRACE_##name,
+  enum TraceEvent {
+    OTF_TRACE_EVENTS(OTF_TRACE_ENUM)
+    TRACE_EVENT_COUNT
+  };
+#undef OTF_TRACE_ENUM
+
+  struct TraceRecord {
+    /** The value of micros() when the event was recorded. Wraps around every 71 minutes. */
+    uint32_t timestamp;
+    uint32_t event;
+    uint32_t arg0;
+    uint32_t arg1;
+  };
+
+  /**
+   * Records compact binary events into a fixed size ring buffer, overwriting the oldest events once it is full.
+   * Recording an event only claims a slot and stores a few words, so it can stay enabled while debugging timing
+   * problems. On Linux events may be recorded from any thread without locking.
+   *
+   * A dump is little-endian: the 4 byte magic, 1 byte version, 1 byte record size, 2 byte record count, 4 byte number of
+   * events that were overwritten, 4 byte timestamp of the dump, then each record in the order it was recorded.
+   */
+  class Trace {
+  public:
+    static void record(TraceEvent event, uint32_t arg0, uint32_t arg1);
+
+    /**
+     * Copies the events in the buffer, oldest first. Events that are overwritten while being copied are skipped.
+     * @param out Array of at least TRACE_BUFFER_EVENTS records.
+     * @return The number of records copied.
+     */
+    static size_t copy(TraceRecord *out);
+
+    /** Writes a dump of the buffer to `sb`. */
+    static void dump(StringBuilder &sb);
+
+    /** Returns the total number of events recorded, including those that have been overwritten. */
+    static uint32_t getRecordedCount();
+
+    /** Returns the name of an event. */
+    static const char *getEventName(TraceEvent event);
+  };
+}// namespace OTF
+
+#else
+#define OTF_TRACE(event, arg0, arg1)
+#endif
+
+#endif
@@ -1,5 +1,11 @@
 #include "Websocket.h"
 
+#if !defined(ARDUINO)
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #if defined(ARDUINO)
 void WebsocketClient::enableHeartbeat(unsigned long interval, unsigned long timeout, uint8_t maxMissed) {
   WebSocketsClient::enableHeartbeat(interval, timeout, maxMissed);
@@ -9,12 +15,26 @@ void WebsocketClient::disableHeartbeat() {
   WebSocketsClient::disableHeartbeat();
 }
 
-void WebsocketClient::setReconnectInterval(unsigned long interval) {
+void WebsocketClient::setReconnectInterval(unsigned long interval, unsigned long maxInterval) {
+  reconnectInterval = interval;
+  reconnectMaxInterval = maxInterval;
+  reconnectAttempts = 0;
   WebSocketsClient::setReconnectInterval(interval);
 }
 
+unsigned long WebsocketClient::randomJitter(unsigned long max) {
+  return random(max);
+}
+
 void WebsocketClient::poll() {
+  // The library records the time of each failed connection attempt, which is used to detect failures.
+  unsigned long lastConnectionFail = _lastConnectionFail;
   WebSocketsClient::loop();
+  if (_lastConnectionFail != lastConnectionFail && _lastConnectionFail != 0) {
+    unsigned long delay = nextReconnectDelay();
+    WS_DEBUG("Connection attempt failed, retrying in %lu ms\n", delay);
+    WebSocketsClient::setReconnectInterval(delay);
+  }
 }
 
 void WebsocketClient::onEvent(WebSocketEventCallback callback) {
@@ -31,57 +51,27 @@ void WebsocketClient::connectSecure(WSInterfaceString host, int port, WSInterfac
   WebSocketsClient::beginSSL(host.c_str(), port, path.c_str());
 }
 
-void WebsocketClient::resetStreaming() {
-    isStreaming = false;
-}
-
-bool WebsocketClient::stream() {
-  if (clientIsConnected(&_client)) {
-    if (isStreaming) {
-      WS_DEBUG("Already streaming\n");
-      return false;
-    }
-    isStreaming = sendFrame(&_client, WSop_text, (uint8_t *) "", 0, false, false);
-  } else {
+bool WebsocketClient::writeFrame(const char *payload, size_t length, bool first, bool fin) {
+  if (!clientIsConnected(&_client)) {
     WS_DEBUG("Client is not connected\n");
-    isStreaming = false;
+    return false;
   }
 
-  return isStreaming;
+  WSopcode_t opcode = first ? (isBinary ? WSop_binary : WSop_text) : WSop_continuation;
+  return sendFrame(&_client, opcode, (uint8_t *) payload, length, fin, false);
 }
 
 bool WebsocketClient::send(uint8_t *payload, size_t length, bool headerToPayload) {
-  WS_DEBUG("Sending message of length %d\n", length);
-
-  if (length == 0) {
-    length = strlen((const char *) payload);
-  }
-
-  if (clientIsConnected(&_client)) {
-    if (isStreaming) {
-      return sendFrame(&_client, WSop_continuation, payload, length, false, headerToPayload);
-    } else {
-      return sendFrame(&_client, WSop_text, payload, length, true, headerToPayload);
-    }
-  }
-
-  return false;
-}
-
-bool WebsocketClient::send(const char *payload, size_t length, bool headerToPayload) {
-  return send((uint8_t *) payload, length, headerToPayload);
+  return send((const char *) payload, length, headerToPayload);
 }
 
-bool WebsocketClient::end() {
-  if (!isStreaming) {
-    return true;
+bool WebsocketClient::sendBinary(const char *payload, size_t length) {
+  WS_DEBUG("Sending binary message of length %d\n", length);
+  if (clientIsConnected(&_client) && !isStreaming) {
+    return sendFrame(&_client, WSop_binary, (uint8_t *) payload, length, true, false);
   }
 
-  WS_DEBUG("Ending stream\n");
-
-  bool res = sendFrame(&_client, WSop_continuation, (uint8_t *) "", 0, true, false);
-  isStreaming = !res;
-  return res;
+  return false;
 }
 
 #else
@@ -91,14 +81,28 @@ void WebsocketClient::enableHeartbeat(unsigned long interval, unsigned long time
   heartbeatInterval = interval;
   heartbeatTimeout = timeout;
   heartbeatMaxMissed = maxMissed;
+  if (!connecting && available() && !heartbeatInProgress) {
+    scheduleHeartbeat();
+  }
 }
 
 void WebsocketClient::disableHeartbeat() {
   heartbeatEnabled = false;
+  heartbeatInProgress = false;
+  stopHeartbeatTimers();
 }
 
-void WebsocketClient::setReconnectInterval(unsigned long interval) {
+void WebsocketClient::setReconnectInterval(unsigned long interval, unsigned long maxInterval) {
   reconnectInterval = interval;
+  reconnectMaxInterval = maxInterval;
+  reconnectAttempts = 0;
+  reconnectDelay = interval;
+  // Restart any pending wait with the new delay.
+  scheduler.stop(reconnectTimer);
+}
+
+unsigned long WebsocketClient::randomJitter(unsigned long max) {
+  return rand_r(&jitterSeed) % max;
 }
 
 unsigned long millis() {
@@ -109,44 +113,114 @@ unsigned long millis() {
   return now = (uint64_t) tv.tv_sec * (uint64_t) 1000 + (uint64_t) (tv.tv_usec / 1000);
 }
 
-void WebsocketClient::poll() {
-  websockets::WebsocketsClient::poll();
-  if (heartbeatEnabled && available()) {
-    if (!heartbeatInProgress && (millis() - heartbeatLastSent > heartbeatInterval)) {
-      if (heartbeatMissed >= heartbeatMaxMissed) {
-        // Too many missed heartbeats, close the connection
-        WS_DEBUG("Too many missed heartbeats, closing connection\n");
-        reconnectLastAttempt = 0;
-        heartbeatMissed = 0;
-        websockets::WebsocketsClient::close();
-        return;
-      }
-
-      WS_DEBUG("Sending ping\n");
-      ping();
-      heartbeatLastSent = millis();
-      heartbeatInProgress = true;
-    }
+unsigned long micros() {
+  // Use the monotonic clock since this is only used to measure durations.
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * (uint64_t) 1000000 + (uint64_t) (ts.tv_nsec / 1000);
+}
 
-    if (heartbeatInProgress && (millis() - heartbeatLastSent > heartbeatTimeout)) {
-      // Heartbeat timeout
-      WS_DEBUG("Heartbeat timeout\n");
-      heartbeatMissed++;
-      heartbeatInProgress = false;
+void WebsocketClient::poll() {
+  if (connecting) {
+    if (!connectFinished) {
+      // The client can't be used until the connection attempt completes.
       return;
     }
+    finishConnect();
   }
 
-  if (shouldReconnect && !available()) {
-    if (millis() - reconnectLastAttempt > reconnectInterval) {
-      WS_DEBUG("Reconnecting...\n");
-      // Attempt to reconnect
-      websockets::WebsocketsClient::connect(host, port, path);
+  websockets::WebsocketsClient::poll();
 
-      WS_DEBUG("Reconnect attempt complete\n");
-      WS_DEBUG("Connection status: %d\n", websockets::WebsocketsClient::available());
-      reconnectLastAttempt = millis();
-    }
+  // The connection can be lost without a close event, so check for it here and let the timer wait out the delay.
+  if (shouldReconnect && !reconnectTimer.isScheduled() && !available()) {
+    unsigned long elapsed = millis() - reconnectLastAttempt;
+    scheduler.start(reconnectTimer, elapsed < reconnectDelay ? reconnectDelay - elapsed : 0);
+  }
+}
+
+void WebsocketClient::scheduleHeartbeat() {
+  unsigned long elapsed = millis() - heartbeatLastSent;
+  scheduler.start(heartbeatTimer, elapsed < heartbeatInterval ? heartbeatInterval - elapsed : 0);
+}
+
+void WebsocketClient::stopHeartbeatTimers() {
+  scheduler.stop(heartbeatTimer);
+  scheduler.stop(heartbeatTimeoutTimer);
+}
+
+void WebsocketClient::sendHeartbeat() {
+  // The timer is started again when the pong arrives, the heartbeat times out or the client reconnects.
+  if (!heartbeatEnabled || heartbeatInProgress || connecting || !available()) {
+    return;
+  }
+
+  if (heartbeatMissed >= heartbeatMaxMissed) {
+    // Too many missed heartbeats, close the connection
+    WS_DEBUG("Too many missed heartbeats, closing connection\n");
+    reconnectLastAttempt = 0;
+    heartbeatMissed = 0;
+    websockets::WebsocketsClient::close();
+    return;
+  }
+
+  WS_DEBUG("Sending ping\n");
+  ping();
+  heartbeatLastSent = millis();
+  heartbeatInProgress = true;
+  scheduler.start(heartbeatTimeoutTimer, heartbeatTimeout);
+}
+
+void WebsocketClient::heartbeatTimedOut() {
+  WS_DEBUG("Heartbeat timeout\n");
+  heartbeatMissed++;
+  heartbeatInProgress = false;
+  scheduleHeartbeat();
+}
+
+void WebsocketClient::reconnect() {
+  if (shouldReconnect && !connecting && !available()) {
+    WS_DEBUG("Reconnecting...\n");
+    startConnect();
+  }
+}
+
+void WebsocketClient::startConnect() {
+  connecting = true;
+  connectOpened = false;
+  connectFinished = false;
+  reconnectLastAttempt = millis();
+  connectThread = std::thread([this]() {
+    websockets::WebsocketsClient::connect(host, port, path);
+    connectFinished = true;
+  });
+}
+
+void WebsocketClient::finishConnect() {
+  connectThread.join();
+  connecting = false;
+  reconnectLastAttempt = millis();
+
+  if (!connectOpened) {
+    reconnectDelay = nextReconnectDelay();
+    WS_DEBUG("Connection attempt failed, retrying in %lu ms\n", reconnectDelay);
+    return;
+  }
+
+  WS_DEBUG("Connection opened\n");
+  // Start backing off from the initial interval again the next time the connection is lost.
+  reconnectAttempts = 0;
+  reconnectDelay = reconnectInterval;
+  heartbeatLastSent = millis();
+  if (heartbeatEnabled) {
+    scheduleHeartbeat();
+  }
+  _callback(WSEvent_CONNECTED, nullptr, 0);
+}
+
+void WebsocketClient::cancelConnect() {
+  if (connecting) {
+    connectThread.join();
+    connecting = false;
   }
 }
 
@@ -156,52 +230,172 @@ void WebsocketClient::onEvent(WebSocketEventCallback callback) {
 }
 
 void WebsocketClient::connect(WSInterfaceString host, int port, WSInterfaceString path) {
-  WS_DEBUG("Connecting to ws://%s:%d%s\n", host, port, path);
+  WS_DEBUG("Connecting to ws://%s:%d%s\n", host.c_str(), port, path.c_str());
+  beginConnect(host, port, path, false);
+}
+
+void WebsocketClient::connectSecure(WSInterfaceString host, int port, WSInterfaceString path) {
+  WS_DEBUG("Connecting to wss://%s:%d%s\n", host.c_str(), port, path.c_str());
+  beginConnect(host, port, path, true);
+}
+
+void WebsocketClient::beginConnect(WSInterfaceString host, int port, WSInterfaceString path, bool secure) {
+  // The connection settings are read by the connect thread, so wait for any previous attempt to finish first.
+  cancelConnect();
+  scheduler.stop(reconnectTimer);
   this->host = host;
   this->port = port;
   this->path = path;
+  tcpClient->setSecure(secure);
   shouldReconnect = true;
   heartbeatMissed = 0;
   heartbeatInProgress = false;
-  //   isSecure = false;
-  websockets::WebsocketsClient::connect(this->host.c_str(), this->port, this->path.c_str());
-}
-
-// void WebsocketClient::connectSecure(WSInterfaceString host, int port, WSInterfaceString path) {
-//   WS_DEBUG("Connecting to wss://%s:%d%s\n", host.c_str(), port, path.c_str());
-//   this->host = host;
-//   this->port = port;
-//   this->path = path;
-//   shouldReconnect = true;
-//   heartbeatMissed = 0;
-//   heartbeatInProgress = false;
-//   isSecure = true;
-//   websockets::WebsocketsClient::connect(this->host.c_str(), this->port, this->path.c_str());
-// }
-
-void WebsocketClient::resetStreaming() {
-    isStreaming = false;
+  reconnectAttempts = 0;
+  jitterSeed = (unsigned int) millis() ^ (unsigned int) getpid();
+  startConnect();
 }
 
-bool WebsocketClient::stream() {
-  return websockets::WebsocketsClient::stream();
+bool WebsocketClient::writeFrame(const char *payload, size_t length, bool first, bool fin) {
+  if (connecting) {
+    WS_DEBUG("Client is not connected\n");
+    return false;
+  }
+
+  if (first && fin) {
+    if (isBinary) {
+      return websockets::WebsocketsClient::sendBinary(payload, length);
+    }
+    return websockets::WebsocketsClient::send(payload, length);
+  } else if (first) {
+    if (isBinary) {
+      return websockets::WebsocketsClient::streamBinary(std::string(payload, length));
+    }
+    return websockets::WebsocketsClient::stream(std::string(payload, length));
+  } else if (fin) {
+    return websockets::WebsocketsClient::end(std::string(payload, length));
+  }
+
+  // Data sent while streaming is sent as a continuation frame.
+  return websockets::WebsocketsClient::send(payload, length);
 }
 
 bool WebsocketClient::send(uint8_t *payload, size_t length, bool headerToPayload) {
   return send((const char *) payload, length, headerToPayload);
 }
 
+bool WebsocketClient::sendBinary(const char *payload, size_t length) {
+  WS_DEBUG("Sending binary message of length %d\n", length);
+  // A message can't be sent in the middle of a streamed message.
+  if (connecting || isStreaming) {
+    return false;
+  }
+  return websockets::WebsocketsClient::sendBinary(payload, length);
+}
+
+#endif
+
+void WebsocketClient::setFrameSize(size_t size) {
+  if (size == 0 || isStreaming) {
+    return;
+  }
+
+  frameSize = size;
+  delete[] frameBuffer;
+  frameBuffer = nullptr;
+}
+
+void WebsocketClient::resetStreaming() {
+  isStreaming = false;
+  frameLength = 0;
+}
+
+bool WebsocketClient::streaming() const {
+  return isStreaming;
+}
+
+bool WebsocketClient::stream(bool binary) {
+  if (isStreaming) {
+    WS_DEBUG("Already streaming\n");
+    return false;
+  }
+
+  if (frameBuffer == nullptr) {
+    frameBuffer = new char[frameSize];
+  }
+  isStreaming = true;
+  isBinary = binary;
+  frameSent = false;
+  frameLength = 0;
+  return true;
+}
+
+bool WebsocketClient::sendBufferedFrame(bool fin) {
+  OTF_TRACE(WEBSOCKET_FRAME_SENT, frameLength, fin);
+  bool res = writeFrame(frameBuffer, frameLength, !frameSent, fin);
+  frameSent = true;
+  frameLength = 0;
+  return res;
+}
+
 bool WebsocketClient::send(const char *payload, size_t length, bool headerToPayload) {
-  WS_DEBUG("Sending message of length %d\n", length);
-  if (length == 0) {
-    length = strlen(payload);
+  if (!isStreaming) {
+    WS_DEBUG("Sending message of length %d\n", length);
+    isBinary = false;
+    return writeFrame(payload, length, true, true);
   }
 
-  return websockets::WebsocketsClient::send((const char *) payload, length);
+  bool res = true;
+  while (length > 0) {
+    // Only send a full frame once more data arrives so the final frame is never empty.
+    if (frameLength == frameSize) {
+      res = sendBufferedFrame(false) && res;
+    }
+
+    size_t copyLength = frameSize - frameLength < length ? frameSize - frameLength : length;
+    memcpy(&frameBuffer[frameLength], payload, copyLength);
+    frameLength += copyLength;
+    payload += copyLength;
+    length -= copyLength;
+  }
+
+  return res;
 }
 
-bool WebsocketClient::end() {
-  return websockets::WebsocketsClient::end();
+bool WebsocketClient::flush() {
+  if (!isStreaming || frameLength == 0) {
+    return true;
+  }
+
+  WS_DEBUG("Flushing %d buffered bytes\n", frameLength);
+  return sendBufferedFrame(false);
+}
+
+unsigned long WebsocketClient::nextReconnectDelay() {
+  // Double the delay after each consecutive failure, up to the maximum.
+  unsigned long delay = reconnectInterval;
+  for (uint8_t i = 0; i < reconnectAttempts && delay < reconnectMaxInterval; i++) {
+    delay *= 2;
+  }
+  if (delay > reconnectMaxInterval) {
+    delay = reconnectMaxInterval;
+  }
+  if (reconnectAttempts < 255) {
+    reconnectAttempts++;
+  }
+
+  // Wait for a random part of the second half of the delay so reconnecting devices are spread out.
+  delay = delay / 2 + randomJitter(delay - delay / 2 + 1);
+  OTF_TRACE(WEBSOCKET_RECONNECT_SCHEDULED, reconnectAttempts, delay);
+  return delay;
 }
 
-#endif
\ No newline at end of file
+bool WebsocketClient::end() {
+  if (!isStreaming) {
+    return true;
+  }
+
+  WS_DEBUG("Ending stream\n");
+  bool res = sendBufferedFrame(true);
+  isStreaming = false;
+  return res;
+}
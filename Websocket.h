@@ -7,11 +7,17 @@
 typedef String WSInterfaceString;
 #else
 #include <tiny_websockets/client.hpp>
+#include "EthernetTcpClient.h"
 #include <sys/time.h>
+#include <atomic>
 #include <functional>
+#include <thread>
 typedef std::string WSInterfaceString;
 #endif
 
+#include "Trace.h"
+#include "Scheduler.h"
+
 #ifdef SERIAL_DEBUG
 #if defined(ARDUINO)
 #define WS_DEBUG(...)          \
@@ -42,6 +48,14 @@ typedef enum {
 
 typedef std::function<void(WSEvent_t type, uint8_t * payload, size_t length)> WebSocketEventCallback;
 
+/* The default maximum payload size of each frame of a streamed message. This lets each frame fit in a single TCP segment
+ * on a 1500 byte MTU with room for the IP, TCP and websocket headers.
+ */
+#define WEBSOCKET_FRAME_SIZE 1400
+
+// The default maximum time in milliseconds between reconnection attempts while the server is unreachable.
+#define WEBSOCKET_RECONNECT_MAX_INTERVAL 60000
+
 #if defined(ARDUINO)
 class WebsocketClient : protected WebSocketsClient {
 public:
@@ -59,6 +73,9 @@ public:
           break;
         case WStype_CONNECTED: {
           WS_DEBUG("Connected to url: %s\n", payload);
+          // Start backing off from the initial interval again the next time the connection is lost.
+          reconnectAttempts = 0;
+          WebSocketsClient::setReconnectInterval(reconnectInterval);
           _callback(WSEvent_CONNECTED, payload, length);
         } break;
         case WStype_TEXT:
@@ -84,6 +101,10 @@ public:
     });
   }
 
+  ~WebsocketClient() {
+    delete[] frameBuffer;
+  }
+
   /**
    * @brief Connect to a websocket server
    * 
@@ -127,11 +148,14 @@ public:
   void disableHeartbeat();
 
   /**
-   * @brief Sets the interval between reconnection attempts
+   * @brief Sets the interval between reconnection attempts. The interval doubles after each failed attempt up to the
+   * maximum, and a random part of it is skipped so devices that lost the connection at the same time don't all retry
+   * at once.
    * 
-   * @param interval Time in milliseconds between reconnection attempts
+   * @param interval Time in milliseconds before the first reconnection attempt
+   * @param maxInterval Maximum time in milliseconds between reconnection attempts
    */
-  void setReconnectInterval(unsigned long interval);
+  void setReconnectInterval(unsigned long interval, unsigned long maxInterval = WEBSOCKET_RECONNECT_MAX_INTERVAL);
 
   /**
    * @brief Poll the websocket connection
@@ -153,34 +177,64 @@ public:
   void resetStreaming();
 
   /**
-   * @brief Enable streaming mode
+   * @brief Returns if a streamed message has been started and not ended yet, during which no other message can be sent
+   */
+  bool streaming() const;
+
+  /**
+   * @brief Start a message that is sent in multiple parts. Data passed to send() is coalesced into frames of the
+   * configured frame size, and partial frames are only sent when the message ends or when flush() is called.
+   * @param binary Indicates if the streamed message is a binary message rather than a text message
    * @return true Streaming mode enabled
    * @return false Streaming mode not enabled
    */
-  bool stream();
+  bool stream(bool binary = false);
+
+  /**
+   * @brief Send the buffered part of the streamed message as a frame
+   * @return true The frame was sent or there was nothing to send
+   * @return false The frame could not be sent
+   */
+  bool flush();
+
+  /**
+   * @brief Sets the size of the frames streamed messages are split into
+   *
+   * @param size The maximum payload size of each frame, ideally matching the TCP MSS or TLS record size
+   */
+  void setFrameSize(size_t size);
 
   /**
-   * @brief Send a text message to the server
+   * @brief Send a text message to the server, or append data to the streamed message if streaming
    * @param payload Data to send
    * @param length Length of the data to send
-   * @param headerToPayload bool  (see sendFrame for more details)
+   * @param headerToPayload Unused, kept for compatibility
    * @return true Message was successful
    * @return false Message was unsuccessful
   */
   bool send(uint8_t *payload, size_t length, bool headerToPayload = false);
 
   /**
-   * @brief Send a text message to the server
+   * @brief Send a text message to the server, or append data to the streamed message if streaming
    * @param payload Data to send
    * @param length Length of the data to send
-   * @param headerToPayload bool  (see sendFrame for more details)
+   * @param headerToPayload Unused, kept for compatibility
    * @return true Message was successful
    * @return false Message was unsuccessful
   */
   bool send(const char *payload, size_t length, bool headerToPayload = false);
 
   /**
-   * @brief End the stream
+   * @brief Send a binary message to the server
+   * @param payload Data to send
+   * @param length Length of the data to send
+   * @return true Message was successful
+   * @return false Message was unsuccessful
+  */
+  bool sendBinary(const char *payload, size_t length);
+
+  /**
+   * @brief End the stream, sending the remaining buffered data as the final frame
    * @return true Stream ended
    * @return false Stream failed to end
   */
@@ -189,6 +243,9 @@ public:
 private:
   bool enableReconnect = false;
   unsigned long reconnectInterval = 0;
+  unsigned long reconnectMaxInterval = WEBSOCKET_RECONNECT_MAX_INTERVAL;
+  /** The number of consecutive failed connection attempts. */
+  uint8_t reconnectAttempts = 0;
 
   WSInterfaceString host;
   int port;
@@ -205,14 +262,46 @@ private:
   bool isSecure = false;
 
   bool isStreaming = false;
+
+  char *frameBuffer = nullptr;
+  size_t frameSize = WEBSOCKET_FRAME_SIZE;
+  size_t frameLength = 0;
+  /** Indicates if the streamed message is binary. */
+  bool isBinary = false;
+  /** Indicates if a frame of the streamed message has already been sent. */
+  bool frameSent = false;
+
+  /** Sends a single frame of the streamed message using the underlying library. */
+  bool writeFrame(const char *payload, size_t length, bool first, bool fin);
+
+  /** Sends the buffered data as a frame of the streamed message. */
+  bool sendBufferedFrame(bool fin);
+
+  /** Returns the delay before the next reconnection attempt and counts the attempt. */
+  unsigned long nextReconnectDelay();
+
+  /** Returns a random number from 0 to `max` (exclusive). */
+  unsigned long randomJitter(unsigned long max);
 };
 
 #else
 unsigned long millis();
+unsigned long micros();
 
 class WebsocketClient : protected websockets::WebsocketsClient {
 public:
-  WebsocketClient() : websockets::WebsocketsClient() {
+  /**
+   * @param scheduler The scheduler that runs the heartbeat and reconnection timers, which must outlive the client.
+   */
+  WebsocketClient(OTF::Scheduler &scheduler) : WebsocketClient(scheduler, std::make_shared<OTF::EthernetTcpClient>()) {}
+
+private:
+  WebsocketClient(OTF::Scheduler &scheduler, std::shared_ptr<OTF::EthernetTcpClient> tcpClient)
+      : websockets::WebsocketsClient(tcpClient), tcpClient(tcpClient.get()), scheduler(scheduler) {
+    heartbeatTimer.setTask([this]() { sendHeartbeat(); });
+    heartbeatTimeoutTimer.setTask([this]() { heartbeatTimedOut(); });
+    reconnectTimer.setTask([this]() { reconnect(); });
+
     websockets::WebsocketsClient::onEvent([this](websockets::WebsocketsEvent event, websockets::WSInterfaceString message) {
       switch (event) {
         case websockets::WebsocketsEvent::GotPing:
@@ -227,20 +316,32 @@ public:
             // If heartbeat is enabled, reset the missed coun and set the heartbeat in progress flag to false
             heartbeatMissed = 0;
             heartbeatInProgress = false;
+            this->scheduler.stop(heartbeatTimeoutTimer);
+            scheduleHeartbeat();
           }
           _callback(WSEvent_PONG, (uint8_t *) message.c_str(), message.length());
           break;
         case websockets::WebsocketsEvent::ConnectionOpened:
+          if (connecting) {
+            // This is running on the connect thread, so the event is delivered by poll() once the attempt completes.
+            connectOpened = true;
+            break;
+          }
           WS_DEBUG("Connection opened\n");
           _callback(WSEvent_CONNECTED, (uint8_t *) message.c_str(), message.length());
           break;
           case websockets::WebsocketsEvent::ConnectionClosed:
+          if (connecting) {
+            // A failed connection attempt was never reported as connected.
+            break;
+          }
           WS_DEBUG("Connection closed\n");
           // If the connection was closed, set the heartbeat in progress flag to false
           if (heartbeatEnabled) {
             heartbeatMissed = 0;
             heartbeatInProgress = false;
           }
+          stopHeartbeatTimers();
           _callback(WSEvent_DISCONNECTED, (uint8_t *) message.c_str(), message.length());
           break;
       }
@@ -268,8 +369,15 @@ public:
     });
   }
 
+public:
+  ~WebsocketClient() {
+    cancelConnect();
+    delete[] frameBuffer;
+  }
+
   /**
-   * @brief Connect to a websocket server
+   * @brief Connect to a websocket server. The connection is opened in the background and the connected event is
+   * delivered from poll().
    * 
    * @param host String containing the host name or IP address of the server
    * @param port Port number to connect to
@@ -277,14 +385,14 @@ public:
    */
   void connect(WSInterfaceString host, int port, WSInterfaceString path);
 
-//   /**
-//    * @brief Connect to a websocket server using a secure connection
-//    * 
-//    * @param host String containing the host name or IP address of the server
-//    * @param port Port number to connect to
-//    * @param path Path to connect to on the server
-//    */
-//   void connectSecure(WSInterfaceString host, int port, WSInterfaceString path);
+  /**
+   * @brief Connect to a websocket server using a secure connection. TLS sessions are resumed when reconnecting.
+   * 
+   * @param host String containing the host name or IP address of the server
+   * @param port Port number to connect to
+   * @param path Path to connect to on the server
+   */
+  void connectSecure(WSInterfaceString host, int port, WSInterfaceString path);
 
   /**
    * @brief Close the connection to the websocket server
@@ -292,8 +400,11 @@ public:
    */
   void close() {
     shouldReconnect = false;
+    cancelConnect();
     heartbeatMissed = 0;
     heartbeatInProgress = false;
+    stopHeartbeatTimers();
+    scheduler.stop(reconnectTimer);
     websockets::WebsocketsClient::close();
   }
 
@@ -313,11 +424,14 @@ public:
   void disableHeartbeat();
 
   /**
-   * @brief Sets the interval between reconnection attempts
+   * @brief Sets the interval between reconnection attempts. The interval doubles after each failed attempt up to the
+   * maximum, and a random part of it is skipped so devices that lost the connection at the same time don't all retry
+   * at once.
    * 
-   * @param interval Time in milliseconds between reconnection attempts
+   * @param interval Time in milliseconds before the first reconnection attempt
+   * @param maxInterval Maximum time in milliseconds between reconnection attempts
    */
-  void setReconnectInterval(unsigned long interval);
+  void setReconnectInterval(unsigned long interval, unsigned long maxInterval = WEBSOCKET_RECONNECT_MAX_INTERVAL);
 
   /**
    * @brief Poll the websocket connection
@@ -339,34 +453,64 @@ public:
   void resetStreaming();
 
   /**
-   * @brief Enable streaming mode
+   * @brief Returns if a streamed message has been started and not ended yet, during which no other message can be sent
+   */
+  bool streaming() const;
+
+  /**
+   * @brief Start a message that is sent in multiple parts. Data passed to send() is coalesced into frames of the
+   * configured frame size, and partial frames are only sent when the message ends or when flush() is called.
+   * @param binary Indicates if the streamed message is a binary message rather than a text message
    * @return true Streaming mode enabled
    * @return false Streaming mode not enabled
    */
-  bool stream();
+  bool stream(bool binary = false);
+
+  /**
+   * @brief Send the buffered part of the streamed message as a frame
+   * @return true The frame was sent or there was nothing to send
+   * @return false The frame could not be sent
+   */
+  bool flush();
 
   /**
-   * @brief Send a text message to the server
+   * @brief Sets the size of the frames streamed messages are split into
+   *
+   * @param size The maximum payload size of each frame, ideally matching the TCP MSS or TLS record size
+   */
+  void setFrameSize(size_t size);
+
+  /**
+   * @brief Send a text message to the server, or append data to the streamed message if streaming
    * @param payload Data to send
    * @param length Length of the data to send
-   * @param headerToPayload bool  (see sendFrame for more details)
+   * @param headerToPayload Unused, kept for compatibility
    * @return true Message was successful
    * @return false Message was unsuccessful
   */
   bool send(uint8_t *payload, size_t length, bool headerToPayload = false);
 
   /**
-   * @brief Send a text message to the server
+   * @brief Send a text message to the server, or append data to the streamed message if streaming
    * @param payload Data to send
    * @param length Length of the data to send
-   * @param headerToPayload bool  (see sendFrame for more details)
+   * @param headerToPayload Unused, kept for compatibility
    * @return true Message was successful
    * @return false Message was unsuccessful
   */
   bool send(const char *payload, size_t length, bool headerToPayload = false);
 
   /**
-   * @brief End the stream
+   * @brief Send a binary message to the server
+   * @param payload Data to send
+   * @param length Length of the data to send
+   * @return true Message was successful
+   * @return false Message was unsuccessful
+  */
+  bool sendBinary(const char *payload, size_t length);
+
+  /**
+   * @brief End the stream, sending the remaining buffered data as the final frame
    * @return true Stream ended
    * @return false Stream failed to end
   */
@@ -381,9 +525,36 @@ private:
   bool heartbeatInProgress = false;
   bool heartbeatEnabled = false;
 
+  /** The connection the websocket is made over, which is owned by the base class. */
+  OTF::EthernetTcpClient *tcpClient;
+
   unsigned int reconnectInterval = 500;
+  unsigned long reconnectMaxInterval = WEBSOCKET_RECONNECT_MAX_INTERVAL;
   unsigned long reconnectLastAttempt = 0;
+  /** The time to wait after the last attempt before trying to reconnect again. */
+  unsigned long reconnectDelay = 0;
+  /** The number of consecutive failed connection attempts. */
+  uint8_t reconnectAttempts = 0;
   bool shouldReconnect = false;
+  unsigned int jitterSeed = 0;
+
+  OTF::Scheduler &scheduler;
+  /** Sends the next heartbeat once the interval has passed since the previous one. */
+  OTF::Timer heartbeatTimer;
+  /** Counts the heartbeat as missed if the pong doesn't arrive in time. */
+  OTF::Timer heartbeatTimeoutTimer;
+  /** Starts the next connection attempt once the reconnection delay has passed. */
+  OTF::Timer reconnectTimer;
+
+  /* tiny_websockets resolves the host, connects and performs the handshake synchronously, so each attempt runs on its
+   * own thread and the client isn't touched by the loop until the attempt completes.
+   */
+  std::thread connectThread;
+  std::atomic<bool> connectFinished{false};
+  /** Indicates if a connection attempt is running on the connect thread. */
+  bool connecting = false;
+  /** Indicates if the running connection attempt opened the connection. */
+  bool connectOpened = false;
 
   WSInterfaceString host;
   int port;
@@ -400,6 +571,45 @@ private:
   bool done = false;
 
   bool isStreaming = false;
+
+  char *frameBuffer = nullptr;
+  size_t frameSize = WEBSOCKET_FRAME_SIZE;
+  size_t frameLength = 0;
+  /** Indicates if the streamed message is binary. */
+  bool isBinary = false;
+  /** Indicates if a frame of the streamed message has already been sent. */
+  bool frameSent = false;
+
+  /** Sends a single frame of the streamed message using the underlying library. */
+  bool writeFrame(const char *payload, size_t length, bool first, bool fin);
+
+  /** Sends the buffered data as a frame of the streamed message. */
+  bool sendBufferedFrame(bool fin);
+
+  /** Returns the delay before the next reconnection attempt and counts the attempt. */
+  unsigned long nextReconnectDelay();
+
+  /** Returns a random number from 0 to `max` (exclusive). */
+  unsigned long randomJitter(unsigned long max);
+
+  /** Stores the server to connect to and starts the first connection attempt. */
+  void beginConnect(WSInterfaceString host, int port, WSInterfaceString path, bool secure);
+
+  /** Starts a connection attempt on the connect thread. */
+  void startConnect();
+
+  /** Waits for the connect thread and delivers the result of its connection attempt. */
+  void finishConnect();
+
+  /** Waits for any running connection attempt to complete without delivering its result. */
+  void cancelConnect();
+
+  /** Starts the heartbeat timer for the end of the interval that started with the last heartbeat. */
+  void scheduleHeartbeat();
+  void stopHeartbeatTimers();
+  void sendHeartbeat();
+  void heartbeatTimedOut();
+  void reconnect();
 };
 
 #endif
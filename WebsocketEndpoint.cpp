@@ -0,0 +1,510 @@
+#include "WebsocketEndpoint.h"
+#include "Trace.h"
+#include <string.h>
+#include <strings.h>
+
+// The GUID appended to the key of an upgrade request to compute the accept key (RFC 6455 section 1.3).
+#define WEBSOCKET_ACCEPT_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+// The length of a base64 encoded 16 byte key.
+#define WEBSOCKET_KEY_LENGTH 24
+// The length of a base64 encoded SHA-1 digest.
+#define WEBSOCKET_ACCEPT_LENGTH 28
+
+#define WEBSOCKET_OPCODE_CONTINUATION 0x0
+#define WEBSOCKET_OPCODE_TEXT 0x1
+#define WEBSOCKET_OPCODE_BINARY 0x2
+#define WEBSOCKET_OPCODE_CLOSE 0x8
+#define WEBSOCKET_OPCODE_PING 0x9
+#define WEBSOCKET_OPCODE_PONG 0xA
+
+#define WEBSOCKET_CLOSE_NORMAL 1000
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEBSOCKET_CLOSE_TOO_LARGE 1009
+
+using namespace OTF;
+
+namespace {
+  uint32_t rotateLeft(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+  }
+
+  /** Computes the SHA-1 digest of a message. Only used for the handshake, so it favors size over speed. */
+  void sha1(const uint8_t *data, size_t length, uint8_t digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint64_t bitLength = (uint64_t) length * 8;
+    // The message is followed by a 1 bit, zeros and the 64 bit length, padded to a multiple of 64 bytes.
+    size_t paddedLength = ((length + 8) / 64 + 1) * 64;
+
+    for (size_t block = 0; block < paddedLength; block += 64) {
+      uint32_t w[80];
+      for (int i = 0; i < 16; i++) {
+        w[i] = 0;
+        for (int j = 0; j < 4; j++) {
+          size_t index = block + i * 4 + j;
+          uint8_t byte;
+          if (index < length) {
+            byte = data[index];
+          } else if (index == length) {
+            byte = 0x80;
+          } else if (index >= paddedLength - 8) {
+            byte = (uint8_t) (bitLength >> ((paddedLength - 1 - index) * 8));
+          } else {
+            byte = 0;
+          }
+          w[i] = (w[i] << 8) | byte;
+        }
+      }
+      for (int i = 16; i < 80; i++) {
+        w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+      }
+
+      uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+      for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+          f = (b & c) | (~b & d);
+          k = 0x5A827999;
+        } else if (i < 40) {
+          f = b ^ c ^ d;
+          k = 0x6ED9EBA1;
+        } else if (i < 60) {
+          f = (b & c) | (b & d) | (c & d);
+          k = 0x8F1BBCDC;
+        } else {
+          f = b ^ c ^ d;
+          k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = temp;
+      }
+      h[0] += a;
+      h[1] += b;
+      h[2] += c;
+      h[3] += d;
+      h[4] += e;
+    }
+
+    for (int i = 0; i < 20; i++) {
+      digest[i] = (uint8_t) (h[i / 4] >> ((3 - i % 4) * 8));
+    }
+  }
+
+  /** Writes the base64 encoding of `data` and a null terminator to `out`, which needs room for 4 * ceil(length / 3) + 1 characters. */
+  void base64Encode(const uint8_t *data, size_t length, char *out) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (size_t i = 0; i < length; i += 3) {
+      uint32_t group = (uint32_t) data[i] << 16;
+      if (i + 1 < length) group |= (uint32_t) data[i + 1] << 8;
+      if (i + 2 < length) group |= data[i + 2];
+      *out++ = alphabet[(group >> 18) & 0x3F];
+      *out++ = alphabet[(group >> 12) & 0x3F];
+      *out++ = i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+      *out++ = i + 2 < length ? alphabet[group & 0x3F] : '=';
+    }
+    *out = 0;
+  }
+
+  /** Returns a boolean indicating if a comma separated header value contains a token, ignoring case. */
+  bool headerHasToken(const char *value, const char *token) {
+    size_t tokenLength = strlen(token);
+    while (*value) {
+      while (*value == ' ' || *value == ',') {
+        value++;
+      }
+      const char *end = value;
+      while (*end && *end != ',') {
+        end++;
+      }
+      const char *trimmed = end;
+      while (trimmed > value && trimmed[-1] == ' ') {
+        trimmed--;
+      }
+      if ((size_t) (trimmed - value) == tokenLength && strncasecmp(value, token, tokenLength) == 0) {
+        return true;
+      }
+      value = end;
+    }
+    return false;
+  }
+}// namespace
+
+WebsocketEndpoint::WebsocketEndpoint(Scheduler &scheduler) : scheduler(scheduler) {
+  pingTimer.setTask([this]() {
+    ping();
+  });
+  scheduler.start(pingTimer, WEBSOCKET_PING_INTERVAL, WEBSOCKET_PING_INTERVAL);
+}
+
+WebsocketEndpoint::~WebsocketEndpoint() {
+  scheduler.stop(pingTimer);
+  connectionCallback = nullptr;
+  for (size_t i = 0; i < WEBSOCKET_MAX_SUBSCRIBERS; i++) {
+    if (subscribers[i] != nullptr) {
+      remove(i);
+    }
+  }
+}
+
+bool WebsocketEndpoint::isUpgradeRequest(const Request &request) {
+  char *upgrade = request.getHeader(F("upgrade"));
+  char *connection = request.getHeader(F("connection"));
+  return !request.isCloudRequest() && upgrade != nullptr && connection != nullptr &&
+         headerHasToken(upgrade, "websocket") && headerHasToken(connection, "upgrade");
+}
+
+void WebsocketEndpoint::accept(const Request &request, LocalClient *client) {
+  char *version = request.getHeader(F("sec-websocket-version"));
+  char *key = request.getHeader(F("sec-websocket-key"));
+
+  if (request.httpMethod != HTTP_GET || key == nullptr || strlen(key) != WEBSOCKET_KEY_LENGTH) {
+    client->print(F("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n"));
+  } else if (version == nullptr || strcmp(version, "13") != 0) {
+    client->print(F("HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\n\r\n"));
+  } else if (subscriberCount >= WEBSOCKET_MAX_SUBSCRIBERS) {
+    client->print(F("HTTP/1.1 503 Too many connections\r\nContent-Length: 0\r\n\r\n"));
+  } else {
+    char keyAndGuid[WEBSOCKET_KEY_LENGTH + sizeof(WEBSOCKET_ACCEPT_GUID)];
+    strcpy(keyAndGuid, key);
+    strcpy(&keyAndGuid[WEBSOCKET_KEY_LENGTH], WEBSOCKET_ACCEPT_GUID);
+    uint8_t digest[20];
+    sha1((const uint8_t *) keyAndGuid, strlen(keyAndGuid), digest);
+    char acceptKey[WEBSOCKET_ACCEPT_LENGTH + 1];
+    base64Encode(digest, sizeof(digest), acceptKey);
+
+    client->print(F("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "));
+    client->print(acceptKey);
+    client->print(F("\r\n\r\n"));
+
+    Subscriber *subscriber = new Subscriber();
+    subscriber->id = nextId++;
+    subscriber->client = client;
+    subscriber->receiveBuffer = new char[WEBSOCKET_MAX_HEADER_LENGTH + WEBSOCKET_MAX_MESSAGE_SIZE];
+    for (size_t i = 0; i < WEBSOCKET_MAX_SUBSCRIBERS; i++) {
+      if (subscribers[i] == nullptr) {
+        subscribers[i] = subscriber;
+        break;
+      }
+    }
+    subscriberCount++;
+    OTF_TRACE(LOCAL_WEBSOCKET_OPENED, subscriber->id, subscriberCount);
+    if (connectionCallback) {
+      connectionCallback(subscriber->id, true);
+    }
+    return;
+  }
+
+  client->flush();
+  client->stop();
+  delete client;
+}
+
+void WebsocketEndpoint::loop() {
+  for (size_t i = 0; i < WEBSOCKET_MAX_SUBSCRIBERS; i++) {
+    Subscriber *subscriber = subscribers[i];
+    if (subscriber == nullptr) {
+      continue;
+    }
+
+    if (!subscriber->closed && !subscriber->closing) {
+      receive(*subscriber);
+    }
+    if (!subscriber->closed) {
+      flush(*subscriber);
+    }
+    if (subscriber->closed || (subscriber->closing && subscriber->queue.isEmpty()) || !subscriber->client->connected()) {
+      remove(i);
+    }
+  }
+}
+
+WebsocketEndpoint::Subscriber *WebsocketEndpoint::find(uint32_t id) {
+  for (size_t i = 0; i < WEBSOCKET_MAX_SUBSCRIBERS; i++) {
+    Subscriber *subscriber = subscribers[i];
+    if (subscriber != nullptr && subscriber->id == id) {
+      return subscriber->closed || subscriber->closing ? nullptr : subscriber;
+    }
+  }
+  return nullptr;
+}
+
+SharedBuffer *WebsocketEndpoint::encodeFrame(uint8_t opcode, const char *data, size_t length) {
+  size_t headerLength = length < 126 ? 2 : length <= 0xFFFF ? 4 : 10;
+  SharedBuffer *frame = SharedBuffer::create(headerLength + length);
+
+  frame->data[0] = (char) (0x80 | opcode);
+  if (length < 126) {
+    frame->data[1] = (char) length;
+  } else if (length <= 0xFFFF) {
+    frame->data[1] = 126;
+    frame->data[2] = (char) (length >> 8);
+    frame->data[3] = (char) length;
+  } else {
+    frame->data[1] = 127;
+    for (int i = 0; i < 8; i++) {
+      frame->data[2 + i] = (char) ((uint64_t) length >> ((7 - i) * 8));
+    }
+  }
+  memcpy(&frame->data[headerLength], data, length);
+  return frame;
+}
+
+bool WebsocketEndpoint::enqueue(Subscriber &subscriber, SharedBuffer *frame) {
+  if (subscriber.queue.isFull()) {
+    // Many frames may be queued within a single call to loop(), so make room by writing them now if possible.
+    flush(subscriber);
+  }
+  if (subscriber.closed || !subscriber.queue.push(frame)) {
+    // The subscriber isn't keeping up, and skipping frames would leave it with a stale state.
+    subscriber.closed = true;
+    return false;
+  }
+  return true;
+}
+
+bool WebsocketEndpoint::sendFrame(Subscriber &subscriber, uint8_t opcode, const char *data, size_t length) {
+  SharedBuffer *frame = encodeFrame(opcode, data, length);
+  bool queued = enqueue(subscriber, frame);
+  frame->release();
+  return queued;
+}
+
+size_t WebsocketEndpoint::broadcastFrame(uint8_t opcode, const char *data, size_t length) {
+  if (subscriberCount == 0) {
+    return 0;
+  }
+
+  SharedBuffer *frame = encodeFrame(opcode, data, length);
+  size_t queued = 0;
+  for (size_t i = 0; i < WEBSOCKET_MAX_SUBSCRIBERS; i++) {
+    Subscriber *subscriber = subscribers[i];
+    if (subscriber != nullptr && !subscriber->closed && !subscriber->closing && enqueue(*subscriber, frame)) {
+      queued++;
+    }
+  }
+  frame->release();
+  return queued;
+}
+
+size_t WebsocketEndpoint::broadcast(const char *data, size_t length, bool binary) {
+  size_t queued = broadcastFrame(binary ? WEBSOCKET_OPCODE_BINARY : WEBSOCKET_OPCODE_TEXT, data, length);
+  OTF_TRACE(LOCAL_WEBSOCKET_BROADCAST, length, queued);
+  return queued;
+}
+
+size_t WebsocketEndpoint::broadcast(const char *text) {
+  return broadcast(text, strlen(text), false);
+}
+
+bool WebsocketEndpoint::send(uint32_t subscriber, const char *data, size_t length, bool binary) {
+  Subscriber *target = find(subscriber);
+  if (target == nullptr) {
+    return false;
+  }
+
+  return sendFrame(*target, binary ? WEBSOCKET_OPCODE_BINARY : WEBSOCKET_OPCODE_TEXT, data, length);
+}
+
+bool WebsocketEndpoint::send(uint32_t subscriber, const char *text) {
+  return send(subscriber, text, strlen(text), false);
+}
+
+void WebsocketEndpoint::close(uint32_t subscriber) {
+  Subscriber *target = find(subscriber);
+  if (target != nullptr) {
+    fail(*target, WEBSOCKET_CLOSE_NORMAL);
+  }
+}
+
+void WebsocketEndpoint::fail(Subscriber &subscriber, uint16_t code) {
+  char payload[2] = {(char) (code >> 8), (char) code};
+  sendFrame(subscriber, WEBSOCKET_OPCODE_CLOSE, payload, sizeof(payload));
+  subscriber.closing = true;
+}
+
+void WebsocketEndpoint::receive(Subscriber &subscriber) {
+  size_t read = subscriber.client->readAvailable(&subscriber.receiveBuffer[subscriber.receiveLength],
+                                                 WEBSOCKET_MAX_HEADER_LENGTH + WEBSOCKET_MAX_MESSAGE_SIZE - subscriber.receiveLength);
+  if (read == 0) {
+    return;
+  }
+  subscriber.active = true;
+  subscriber.receiveLength += read;
+
+  size_t offset = 0;
+  while (!subscriber.closed && !subscriber.closing) {
+    const uint8_t *header = (const uint8_t *) &subscriber.receiveBuffer[offset];
+    size_t available = subscriber.receiveLength - offset;
+    if (available < 2) {
+      break;
+    }
+
+    // No extensions are negotiated, so the reserved bits must be clear, and frames from clients must be masked.
+    if ((header[0] & 0x70) != 0 || (header[1] & 0x80) == 0) {
+      fail(subscriber, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+      break;
+    }
+
+    size_t headerLength = 2;
+    uint64_t length = header[1] & 0x7F;
+    if (length == 126) {
+      headerLength = 4;
+      if (available < headerLength) {
+        break;
+      }
+      length = ((uint64_t) header[2] << 8) | header[3];
+    } else if (length == 127) {
+      headerLength = 10;
+      if (available < headerLength) {
+        break;
+      }
+      length = 0;
+      for (int i = 2; i < 10; i++) {
+        length = (length << 8) | header[i];
+      }
+    }
+    if (length > WEBSOCKET_MAX_MESSAGE_SIZE) {
+      fail(subscriber, WEBSOCKET_CLOSE_TOO_LARGE);
+      break;
+    }
+
+    headerLength += 4;
+    if (available < headerLength + length) {
+      break;
+    }
+
+    const uint8_t *mask = &header[headerLength - 4];
+    char *payload = &subscriber.receiveBuffer[offset + headerLength];
+    for (size_t i = 0; i < length; i++) {
+      payload[i] ^= mask[i & 3];
+    }
+    offset += headerLength + length;
+    handleFrame(subscriber, header[0] & 0x0F, (header[0] & 0x80) != 0, payload, length);
+  }
+
+  // Keep the start of the next frame for the next read.
+  if (offset > 0) {
+    memmove(subscriber.receiveBuffer, &subscriber.receiveBuffer[offset], subscriber.receiveLength - offset);
+    subscriber.receiveLength -= offset;
+  }
+}
+
+void WebsocketEndpoint::handleFrame(Subscriber &subscriber, uint8_t opcode, bool fin, const char *payload, size_t length) {
+  switch (opcode) {
+    case WEBSOCKET_OPCODE_TEXT:
+    case WEBSOCKET_OPCODE_BINARY:
+      if (subscriber.message != nullptr) {
+        // The previous message hasn't been finished.
+        fail(subscriber, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+      } else if (fin) {
+        if (messageCallback) {
+          messageCallback(subscriber.id, payload, length, opcode == WEBSOCKET_OPCODE_BINARY);
+        }
+      } else {
+        subscriber.message = new char[WEBSOCKET_MAX_MESSAGE_SIZE];
+        memcpy(subscriber.message, payload, length);
+        subscriber.messageLength = length;
+        subscriber.messageOpcode = opcode;
+      }
+      break;
+
+    case WEBSOCKET_OPCODE_CONTINUATION:
+      if (subscriber.message == nullptr) {
+        fail(subscriber, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+        break;
+      }
+      if (subscriber.messageLength + length > WEBSOCKET_MAX_MESSAGE_SIZE) {
+        fail(subscriber, WEBSOCKET_CLOSE_TOO_LARGE);
+        break;
+      }
+      memcpy(&subscriber.message[subscriber.messageLength], payload, length);
+      subscriber.messageLength += length;
+      if (fin) {
+        if (messageCallback) {
+          messageCallback(subscriber.id, subscriber.message, subscriber.messageLength,
+                          subscriber.messageOpcode == WEBSOCKET_OPCODE_BINARY);
+        }
+        delete[] subscriber.message;
+        subscriber.message = nullptr;
+        subscriber.messageLength = 0;
+      }
+      break;
+
+    case WEBSOCKET_OPCODE_CLOSE:
+      // Echo the status code, then close the connection once everything queued before it has been sent.
+      if (length >= 2) {
+        fail(subscriber, ((uint8_t) payload[0] << 8) | (uint8_t) payload[1]);
+      } else {
+        fail(subscriber, WEBSOCKET_CLOSE_NORMAL);
+      }
+      break;
+
+    case WEBSOCKET_OPCODE_PING:
+      if (!fin || length > 125) {
+        fail(subscriber, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+      } else {
+        sendFrame(subscriber, WEBSOCKET_OPCODE_PONG, payload, length);
+      }
+      break;
+
+    case WEBSOCKET_OPCODE_PONG:
+      // Receiving it already marked the subscriber as active.
+      break;
+
+    default:
+      fail(subscriber, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+      break;
+  }
+}
+
+void WebsocketEndpoint::flush(Subscriber &subscriber) {
+  if (!subscriber.queue.write(subscriber.client)) {
+    subscriber.closed = true;
+  }
+}
+
+void WebsocketEndpoint::remove(size_t index) {
+  Subscriber *subscriber = subscribers[index];
+  subscribers[index] = nullptr;
+  subscriberCount--;
+
+  subscriber->client->stop();
+  delete subscriber->client;
+  delete[] subscriber->receiveBuffer;
+  delete[] subscriber->message;
+
+  uint32_t id = subscriber->id;
+  delete subscriber;
+  OTF_TRACE(LOCAL_WEBSOCKET_CLOSED, id, subscriberCount);
+  if (connectionCallback) {
+    connectionCallback(id, false);
+  }
+}
+
+void WebsocketEndpoint::ping() {
+  for (size_t i = 0; i < WEBSOCKET_MAX_SUBSCRIBERS; i++) {
+    Subscriber *subscriber = subscribers[i];
+    if (subscriber != nullptr && !subscriber->active) {
+      // Nothing was received since the last ping, so the connection is gone.
+      subscriber->closed = true;
+    } else if (subscriber != nullptr) {
+      subscriber->active = false;
+    }
+  }
+  broadcastFrame(WEBSOCKET_OPCODE_PING, "", 0);
+}
+
+void WebsocketEndpoint::onConnection(websocket_connection_callback_t callback) {
+  connectionCallback = callback;
+}
+
+void WebsocketEndpoint::onMessage(websocket_message_callback_t callback) {
+  messageCallback = callback;
+}
+
+size_t WebsocketEndpoint::getSubscriberCount() const {
+  return subscriberCount;
+}
@@ -0,0 +1,153 @@
+#ifndef OTF_WEBSOCKETENDPOINT_H
+#define OTF_WEBSOCKETENDPOINT_H
+
+#include "LocalServer.h"
+#include "Request.h"
+#include "Scheduler.h"
+#include "SendQueue.h"
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#ifndef WEBSOCKET_MAX_SUBSCRIBERS
+// The maximum number of local websocket connections. Additional upgrade requests are rejected with a 503.
+#define WEBSOCKET_MAX_SUBSCRIBERS 4
+#endif
+#ifndef WEBSOCKET_MAX_MESSAGE_SIZE
+// The maximum size of a message received from a subscriber. Subscribers that send larger messages are disconnected.
+#define WEBSOCKET_MAX_MESSAGE_SIZE 512
+#endif
+#ifndef WEBSOCKET_SEND_QUEUE_FRAMES
+// The maximum number of frames waiting to be sent to each subscriber. Subscribers that fall further behind are disconnected.
+#define WEBSOCKET_SEND_QUEUE_FRAMES 16
+#endif
+#ifndef WEBSOCKET_PING_INTERVAL
+/* The time in milliseconds between pings. Subscribers that don't send anything, not even the pong, between two pings
+ * are disconnected, so the slots of dashboards that went away without closing the connection are freed.
+ */
+#define WEBSOCKET_PING_INTERVAL 30000
+#endif
+// The longest frame header: 2 bytes, an 8 byte length and a 4 byte mask.
+#define WEBSOCKET_MAX_HEADER_LENGTH 14
+
+namespace OTF {
+  /** Called when a subscriber connects (`connected` is true) or disconnects. */
+  typedef std::function<void(uint32_t subscriber, bool connected)> websocket_connection_callback_t;
+
+  /**
+   * Called with each complete text or binary message received from a subscriber. The data is not null-terminated and
+   * is only valid during the call.
+   */
+  typedef std::function<void(uint32_t subscriber, const char *data, size_t length, bool binary)> websocket_message_callback_t;
+
+  /**
+   * Accepts websocket connections (RFC 6455) upgraded from requests to the local server, so local dashboards can
+   * receive state changes as they happen instead of polling. Each connection is a subscriber with its own send queue.
+   * A broadcast is encoded into a single frame that is shared by the queues of every subscriber, and the queues are
+   * written from loop() with LocalClient::writeAvailable(), which never waits for a connection, so a slow subscriber
+   * doesn't hold up the others. Subscribers whose queue fills up are disconnected, and can reconnect to get the current
+   * state again.
+   *
+   * All functions must be called from the thread calling OpenThingsFramework::loop().
+   */
+  class WebsocketEndpoint {
+  private:
+    struct Subscriber {
+      uint32_t id;
+      LocalClient *client;
+      SendQueue queue{WEBSOCKET_SEND_QUEUE_FRAMES};
+      /** The received bytes that don't form a complete frame yet. */
+      char *receiveBuffer;
+      size_t receiveLength = 0;
+      /** The fragments received so far of a message split into several frames, or nullptr. */
+      char *message = nullptr;
+      size_t messageLength = 0;
+      uint8_t messageOpcode = 0;
+      /** Indicates if anything was received since the last ping. */
+      bool active = true;
+      /** Indicates if a close frame was queued, so the connection is closed once the queue has been sent. */
+      bool closing = false;
+      /** Indicates if the connection should be closed immediately. */
+      bool closed = false;
+    };
+
+    Scheduler &scheduler;
+    Subscriber *subscribers[WEBSOCKET_MAX_SUBSCRIBERS] = {};
+    size_t subscriberCount = 0;
+    uint32_t nextId = 1;
+    Timer pingTimer;
+    websocket_connection_callback_t connectionCallback = nullptr;
+    websocket_message_callback_t messageCallback = nullptr;
+
+    /** Returns the subscriber with the specified ID, or nullptr if it isn't connected or is being closed. */
+    Subscriber *find(uint32_t id);
+    /** Encodes a frame. Frames sent by the server are not masked, so the same frame can be sent to every subscriber. */
+    static SharedBuffer *encodeFrame(uint8_t opcode, const char *data, size_t length);
+    /** Adds a frame to a subscriber's queue, or disconnects the subscriber if its queue is full. */
+    bool enqueue(Subscriber &subscriber, SharedBuffer *frame);
+    /** Encodes a frame and queues it for a single subscriber. */
+    bool sendFrame(Subscriber &subscriber, uint8_t opcode, const char *data, size_t length);
+    size_t broadcastFrame(uint8_t opcode, const char *data, size_t length);
+    /** Queues a close frame, after which nothing else is sent or received. */
+    void fail(Subscriber &subscriber, uint16_t code);
+    void receive(Subscriber &subscriber);
+    void handleFrame(Subscriber &subscriber, uint8_t opcode, bool fin, const char *payload, size_t length);
+    /** Writes as much of the subscriber's queue as the connection accepts. */
+    void flush(Subscriber &subscriber);
+    void remove(size_t index);
+    void ping();
+
+  public:
+    WebsocketEndpoint(Scheduler &scheduler);
+    ~WebsocketEndpoint();
+
+    WebsocketEndpoint(const WebsocketEndpoint &) = delete;
+    WebsocketEndpoint &operator=(const WebsocketEndpoint &) = delete;
+
+    /** Returns a boolean indicating if a request asks to be upgraded to a websocket connection. */
+    static bool isUpgradeRequest(const Request &request);
+
+    /**
+     * Completes the handshake of an upgrade request and adds the client as a subscriber, or responds with an error if
+     * the request is invalid or WEBSOCKET_MAX_SUBSCRIBERS are already connected. Takes ownership of the client either
+     * way.
+     */
+    void accept(const Request &request, LocalClient *client);
+
+    /** Reads the messages received from subscribers and writes their send queues. Called by OpenThingsFramework::loop(). */
+    void loop();
+
+    /**
+     * Sends a message to every subscriber. The message is encoded once, and sent by the following calls to loop().
+     * @param binary Indicates if the message should be sent as a binary message instead of UTF-8 text.
+     * @return The number of subscribers the message was queued for.
+     */
+    size_t broadcast(const char *data, size_t length, bool binary = false);
+
+    /** Sends a null-terminated text message to every subscriber. */
+    size_t broadcast(const char *text);
+
+    /**
+     * Sends a message to a single subscriber, such as the current state when it connects.
+     * @return A boolean indicating if the message was queued.
+     */
+    bool send(uint32_t subscriber, const char *data, size_t length, bool binary = false);
+
+    /** Sends a null-terminated text message to a single subscriber. */
+    bool send(uint32_t subscriber, const char *text);
+
+    /** Closes a subscriber's connection once the messages queued for it have been sent. */
+    void close(uint32_t subscriber);
+
+    void onConnection(websocket_connection_callback_t callback);
+    void onMessage(websocket_message_callback_t callback);
+
+    size_t getSubscriberCount() const;
+  };
+}// namespace OTF
+
+#endif
@@ -36,6 +36,7 @@ inline  void DEBUG_PRINT(const char*s) {fprintf(stdout, "%s", s);}
 #endif
 
 #include "etherport.h"
+#include "Resolver.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -46,6 +47,13 @@ inline  void DEBUG_PRINT(const char*s) {fprintf(stdout, "%s", s);}
 #include <netinet/in.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <pthread.h>
+#include <signal.h>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include<openssl/bio.h>
 #include<openssl/ssl.h>
@@ -54,6 +62,127 @@ inline  void DEBUG_PRINT(const char*s) {fprintf(stdout, "%s", s);}
 #include<openssl/x509.h>
 #include<openssl/x509_vfy.h>
 
+// How long to wait for a host name to be resolved.
+#define RESOLVE_TIMEOUT 5000
+// How long to wait for a connection to any of the addresses of a host.
+#define CONNECT_TIMEOUT 5000
+// How long to wait for a connection attempt before also trying the next address (RFC 8305).
+#define CONNECTION_ATTEMPT_DELAY 250
+// How long to wait for a client to complete the TLS handshake.
+#define SSL_HANDSHAKE_TIMEOUT 1500
+// The number of sessions a TLS server keeps for resuming TLS 1.2 connections by session ID.
+#define SSL_SERVER_SESSION_CACHE_SIZE 64
+// How long in seconds sessions and tickets issued by a TLS server can be resumed for.
+#define SSL_SERVER_SESSION_TIMEOUT 7200
+
+// OpenSSL and sendfile() write to sockets without MSG_NOSIGNAL, which raises SIGPIPE if the peer has closed the
+//	connection. The signal is blocked while writing and any instance raised by the write is discarded, rather than
+//	terminating the process.
+static bool blockSigpipe(sigset_t *old)
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, old);
+	return !sigismember(old, SIGPIPE);
+}
+
+static void restoreSigpipe(const sigset_t *old, bool blocked)
+{
+	if (blocked) {
+		sigset_t pending;
+		sigpending(&pending);
+		if (sigismember(&pending, SIGPIPE)) {
+			sigset_t set;
+			sigemptyset(&set);
+			sigaddset(&set, SIGPIPE);
+			struct timespec zero = {0, 0};
+			sigtimedwait(&set, NULL, &zero);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, old, NULL);
+}
+
+//	Connects to the first address of the list that accepts a connection. A new attempt is started every
+//	 CONNECTION_ATTEMPT_DELAY ms (or as soon as the previous one fails) while the earlier ones are still pending.
+//	 Returns the connected blocking socket, or -1 if none of the addresses could be reached.
+static int connectToAny(const std::vector<OTF::ResolvedAddress> &addresses, unsigned long timeout)
+{
+	std::vector<struct pollfd> pending;
+	size_t next = 0;
+	int sock = -1;
+	unsigned long start = millis();
+	unsigned long lastAttempt = 0;
+
+	while (sock < 0)
+	{
+		unsigned long now = millis();
+		if (now - start >= timeout)
+			break;
+
+		if (next < addresses.size() && (pending.empty() || now - lastAttempt >= CONNECTION_ATTEMPT_DELAY))
+		{
+			const OTF::ResolvedAddress &address = addresses[next++];
+			lastAttempt = now;
+			int s = socket(address.address.ss_family, SOCK_STREAM, 0);
+			if (s < 0)
+				continue;
+			fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+			if (::connect(s, (struct sockaddr *) &address.address, address.length) == 0)
+			{
+				sock = s;
+				break;
+			}
+			if (errno != EINPROGRESS)
+			{
+				close(s);
+				continue;
+			}
+			struct pollfd fd;
+			memset(&fd, 0, sizeof(fd));
+			fd.fd = s;
+			fd.events = POLLOUT;
+			pending.push_back(fd);
+			continue;
+		}
+
+		if (pending.empty())
+			break;
+
+		unsigned long wait = timeout - (now - start);
+		if (next < addresses.size() && CONNECTION_ATTEMPT_DELAY - (now - lastAttempt) < wait)
+			wait = CONNECTION_ATTEMPT_DELAY - (now - lastAttempt);
+		if (poll(pending.data(), pending.size(), wait) < 0 && errno != EINTR)
+			break;
+
+		for (size_t i = 0; i < pending.size();)
+		{
+			if (!pending[i].revents)
+			{
+				i++;
+				continue;
+			}
+			int error = 0;
+			socklen_t len = sizeof(error);
+			if (sock < 0 && getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0)
+				sock = pending[i].fd;
+			else
+				close(pending[i].fd);
+			pending.erase(pending.begin() + i);
+		}
+	}
+
+	for (size_t i = 0; i < pending.size(); i++)
+		close(pending[i].fd);
+
+	if (sock >= 0) {
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+	} else {
+		DEBUG_ETHERPORT("Error: connecting to the server");
+	}
+	return sock;
+}
+
 EthernetServer::EthernetServer(uint16_t port)
 		: m_port(port), m_sock(0)
 {
@@ -62,6 +191,12 @@ EthernetServer::EthernetServer(uint16_t port)
 EthernetServer::~EthernetServer()
 {
 	close(m_sock);
+	if (m_pending) {
+		m_pending->stop();
+		delete m_pending;
+	}
+	if (m_ctx)
+		SSL_CTX_free(m_ctx);
 }
 
 bool EthernetServer::begin()
@@ -121,13 +256,93 @@ EthernetClient EthernetServer::available()
 	if (rc > 0)
 	{
 		int client_sock = 0;
-		if ((client_sock = accept(m_sock, NULL, NULL)) <= 0)
+		if ((client_sock = ::accept(m_sock, NULL, NULL)) <= 0)
 			return EthernetClient();
 		return EthernetClient(client_sock);
 	}
 	return EthernetClient();
 }
 
+EthernetClient *EthernetServer::accept()
+{
+	if (m_pending) {
+		int rc = m_pending->handshake();
+		if (rc == 0 && millis() - m_pendingStart < SSL_HANDSHAKE_TIMEOUT)
+			return NULL;
+
+		EthernetClientSsl *client = m_pending;
+		m_pending = NULL;
+		if (rc != 1) {
+			DEBUG_ETHERPORT("Error: TLS handshake failed");
+			m_stats.failed++;
+			client->stop();
+			delete client;
+			return NULL;
+		}
+		m_stats.handshakes++;
+		if (client->sessionReused())
+			m_stats.resumed++;
+		if (client->ktlsSend())
+			m_stats.ktls++;
+		return client;
+	}
+
+	struct pollfd fds;
+	memset(&fds, 0, sizeof(fds));
+	fds.fd = m_sock;
+	fds.events = POLLIN;
+	int timeout = 5; // reduce this timeout for less blocking time
+
+	if (poll(&fds, 1, timeout) <= 0)
+		return NULL;
+	int client_sock = ::accept(m_sock, NULL, NULL);
+	if (client_sock <= 0)
+		return NULL;
+	if (!m_ctx)
+		return new EthernetClient(client_sock);
+
+	// Start the handshake, which is continued by the following calls if the client hasn't sent enough data yet.
+	m_pending = new EthernetClientSsl(client_sock, m_ctx);
+	m_pendingStart = millis();
+	return accept();
+}
+
+bool EthernetServer::enableTls(const char *certFile, const char *keyFile)
+{
+	SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+	if (!ctx) {
+		DEBUG_ETHERPORT("Error: unable to create SSL context.\n");
+		return false;
+	}
+	if (SSL_CTX_use_certificate_chain_file(ctx, certFile) != 1 ||
+			SSL_CTX_use_PrivateKey_file(ctx, keyFile, SSL_FILETYPE_PEM) != 1 ||
+			SSL_CTX_check_private_key(ctx) != 1) {
+		DEBUG_ETHERPORT("Error: unable to load the certificate or private key.\n");
+		SSL_CTX_free(ctx);
+		return false;
+	}
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+	SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+	// TLS 1.2 sessions can be resumed by ID from the internal cache. Sessions of both versions can also be resumed with
+	//	tickets, which are encrypted with a key generated for this context.
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(ctx, SSL_SERVER_SESSION_CACHE_SIZE);
+	SSL_CTX_set_timeout(ctx, SSL_SERVER_SESSION_TIMEOUT);
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "OTF", 3);
+	// Clients only need a single ticket since they make one connection at a time.
+	SSL_CTX_set_num_tickets(ctx, 1);
+
+	if (m_ctx)
+		SSL_CTX_free(m_ctx);
+	m_ctx = ctx;
+	return true;
+}
+
+SslStats EthernetServer::getTlsStats()
+{
+	return m_stats;
+}
+
 EthernetClient::EthernetClient()
 		: m_sock(0), m_connected(false)
 {
@@ -148,17 +363,16 @@ int EthernetClient::connect(const char* server, uint16_t port)
 	if (m_sock)
 		return 0;
 
-	struct hostent *host = gethostbyname(server);
-	if (!host) {
+	std::vector<OTF::ResolvedAddress> addresses;
+	if (!OTF::Resolver::instance().resolve(server, port, addresses, RESOLVE_TIMEOUT)) {
 		DEBUG_ETHERPORT("Error: DNS look up failed\n");
 		return 0;
 	}
 
-	struct sockaddr_in sin = {0};
-	sin.sin_family = AF_INET;
-	sin.sin_port = htons(port);
-	sin.sin_addr.s_addr = *(uint32_t*) (host->h_addr);
-	m_sock = socket(AF_INET, SOCK_STREAM, 0);
+	int sock = connectToAny(addresses, CONNECT_TIMEOUT);
+	if (sock < 0)
+		return 0;
+	m_sock = sock;
 
 	struct timeval timeout;
 	timeout.tv_sec = 2;
@@ -166,11 +380,6 @@ int EthernetClient::connect(const char* server, uint16_t port)
 	setsockopt (m_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 	setsockopt (m_sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
 
-	if (::connect(m_sock, (struct sockaddr *) &sin, sizeof(sin)) < 0)
-	{
-		DEBUG_ETHERPORT("Error: connecting to the server");
-		return 0;
-	}
 	m_connected = true;
 	return 1;
 }
@@ -284,6 +493,10 @@ void EthernetClient::setTimeout(int msec) {
 }
 
 bool EthernetClient::available() {
+	return available(5);
+}
+
+bool EthernetClient::available(int msec) {
     if (tmpbufidx < tmpbufsize) {
         return true;
     }
@@ -296,9 +509,8 @@ bool EthernetClient::available() {
 	memset(&fds, 0, sizeof(fds));
 	fds.fd = m_sock;
 	fds.events = POLLIN;
-	int timeout = 5;
 
-	int rc = poll(&fds, 1, timeout);
+	int rc = poll(&fds, 1, msec);
 	return rc > 0;
 }
 
@@ -307,10 +519,151 @@ size_t EthernetClient::write(const uint8_t *buf, size_t size)
 	return ::send(m_sock, buf, size, MSG_NOSIGNAL);
 }
 
+size_t EthernetClient::writeNonBlocking(const uint8_t *buf, size_t size)
+{
+	ssize_t rc = ::send(m_sock, buf, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (rc < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			m_connected = false;
+		return 0;
+	}
+	return rc;
+}
+
+ssize_t EthernetClient::sendFile(int fd, off_t offset, size_t size)
+{
+	sigset_t old;
+	bool blocked = blockSigpipe(&old);
+	size_t sent = 0;
+	while (sent < size) {
+		ssize_t rc = ::sendfile(m_sock, fd, &offset, size - sent);
+		if (rc <= 0)
+			break;
+		sent += rc;
+	}
+	restoreSigpipe(&old, blocked);
+	return sent;
+}
+
 /**
  * SSL Client
 */
-static SSL_CTX* ctx = NULL;
+// The context shared by all client connections, which holds the settings and callbacks used for session resumption.
+static SSL_CTX* clientCtx = NULL;
+// Guards the context, the stored sessions and the counters, since connections may be made from several threads.
+static std::mutex sslMutex;
+// The most recently issued session of each host and port, used to resume the next connection to it.
+static std::map<std::string, SSL_SESSION*> sslSessions;
+static SslStats sslStats = {0, 0, 0, 0};
+// Indicates if connections should be offloaded to kernel TLS when the kernel supports it.
+static bool sslKtls = true;
+static std::string sslCipherList;
+static std::string sslCipherSuites;
+static std::string sslAlpn;
+static bool sslAlpnSet = false;
+// The index of the SSL ex data that holds the session key of a connection.
+static int sessionKeyIndex = -1;
+
+static void freeSessionKey(void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *)
+{
+	free(ptr);
+}
+
+// Converts a comma separated protocol list to the length prefixed ALPN wire format.
+static bool encodeAlpn(const char *protocols, std::string &out)
+{
+	out.clear();
+	while (*protocols) {
+		const char *end = strchr(protocols, ',');
+		size_t len = end ? (size_t) (end - protocols) : strlen(protocols);
+		if (len == 0 || len > 255)
+			return false;
+		out += (char) len;
+		out.append(protocols, len);
+		protocols += len;
+		if (*protocols == ',')
+			protocols++;
+	}
+	return true;
+}
+
+// Called by OpenSSL when the server issues a session. With TLS 1.3 this happens after the handshake completes.
+static int newSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+	const char *key = (const char *) SSL_get_ex_data(ssl, sessionKeyIndex);
+	if (!key)
+		return 0;
+
+	std::lock_guard<std::mutex> lock(sslMutex);
+	SSL_SESSION *&stored = sslSessions[key];
+	if (stored)
+		SSL_SESSION_free(stored);
+	stored = session;
+	// Keep the reference to the session.
+	return 1;
+}
+
+// Applies the configured ciphers and ALPN protocols to the context. Must be called with sslMutex held.
+static bool applySslSettings()
+{
+	bool ok = true;
+	if (!sslCipherList.empty() && SSL_CTX_set_cipher_list(clientCtx, sslCipherList.c_str()) != 1)
+		ok = false;
+	if (!sslCipherSuites.empty() && SSL_CTX_set_ciphersuites(clientCtx, sslCipherSuites.c_str()) != 1)
+		ok = false;
+	if (!sslAlpnSet) {
+		encodeAlpn(SSL_CLIENT_ALPN, sslAlpn);
+		sslAlpnSet = true;
+	}
+	// Unlike most OpenSSL functions, this returns 0 on success.
+	if (SSL_CTX_set_alpn_protos(clientCtx, (const unsigned char *) sslAlpn.data(), sslAlpn.size()) != 0)
+		ok = false;
+	return ok;
+}
+
+// Asks OpenSSL to hand the connection's encryption to the kernel once the handshake completes. OpenSSL falls back to
+//	encrypting in user space if the kernel or the negotiated cipher doesn't support it.
+static void configureKtls(SSL *ssl)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	if (sslKtls)
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+	else
+		SSL_clear_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+}
+
+// Returns the shared client context, creating it if necessary. Must be called with sslMutex held.
+static SSL_CTX* clientContext()
+{
+	if (clientCtx)
+		return clientCtx;
+
+	OpenSSL_add_all_algorithms();
+	//ERR_load_BIO_strings();
+	ERR_load_crypto_strings();
+	SSL_load_error_strings();
+	if (SSL_library_init() < 0)	{
+		DEBUG_ETHERPORT("Error: could not initialize the OpenSSL library.\n");
+		return NULL;
+	}
+	const SSL_METHOD* method = SSLv23_client_method();
+	clientCtx = SSL_CTX_new(method);
+	if (!clientCtx) {
+		DEBUG_ETHERPORT("Error: unable to create SSL context.\n");
+		return NULL;
+	}
+	SSL_CTX_set_options(clientCtx, SSL_OP_NO_SSLv2);
+	SSL_CTX_set_verify(clientCtx, SSL_VERIFY_NONE, NULL); //Accept all certs
+	// Sessions are stored per host by the callback rather than in OpenSSL's internal cache, which clients can't look up.
+	SSL_CTX_set_session_cache_mode(clientCtx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(clientCtx, newSessionCallback);
+	sessionKeyIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, freeSessionKey);
+	if (!applySslSettings()) {
+		DEBUG_ETHERPORT("Error: invalid cipher or ALPN settings.\n");
+	}
+	return clientCtx;
+}
 
 EthernetClientSsl::EthernetClientSsl()
 		: EthernetClient()
@@ -322,6 +675,18 @@ EthernetClientSsl::EthernetClientSsl(int sock)
 {
 }
 
+EthernetClientSsl::EthernetClientSsl(int sock, SSL_CTX *ctx)
+		: EthernetClient(sock)
+{
+	m_connected = false;
+	ssl = SSL_new(ctx);
+	configureKtls(ssl);
+	SSL_set_fd(ssl, sock);
+	SSL_set_accept_state(ssl);
+	// Handshake without blocking so a slow client doesn't stall the server.
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+}
+
 EthernetClientSsl::~EthernetClientSsl()
 {
 	// if (tmpbuf) free(tmpbuf);
@@ -335,60 +700,150 @@ int EthernetClientSsl::connect(const char* server, uint16_t port)
 	if (m_sock)
 		return 0;
 
-	static bool sslInit = false;
-	if (!sslInit) {
-		OpenSSL_add_all_algorithms();
-		//ERR_load_BIO_strings();
-		ERR_load_crypto_strings();
-		SSL_load_error_strings();	
-		//BIO* certbio = BIO_new(BIO_s_file());
-		//BIO* outbio = BIO_new_fp(stdout, BIO_NOCLOSE);
-		if (SSL_library_init() < 0)	{
-			DEBUG_ETHERPORT("Error: could not initialize the OpenSSL library.\n");
-			return 0;
-		}
-		const SSL_METHOD* method = SSLv23_client_method();
-		ctx = SSL_CTX_new(method);
-		if (!ctx) {
-			DEBUG_ETHERPORT("Error: unable to create SSL context.\n");
+	std::string key = std::string(server) + ":" + std::to_string(port);
+	SSL_CTX *ctx;
+	SSL_SESSION *session = NULL;
+	{
+		std::lock_guard<std::mutex> lock(sslMutex);
+		ctx = clientContext();
+		if (!ctx)
 			return 0;
+
+		std::map<std::string, SSL_SESSION*>::iterator it = sslSessions.find(key);
+		if (it != sslSessions.end() && SSL_SESSION_is_resumable(it->second)) {
+			session = it->second;
+			SSL_SESSION_up_ref(session);
 		}
-		SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2);
-		SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL); //Accept all certs
-		sslInit = true;
 	}
 
-	struct hostent *host = gethostbyname(server);
-	if (!host) {
+	std::vector<OTF::ResolvedAddress> addresses;
+	if (!OTF::Resolver::instance().resolve(server, port, addresses, RESOLVE_TIMEOUT)) {
 		DEBUG_ETHERPORT("Error: DNS look up failed\n");
+		if (session)
+			SSL_SESSION_free(session);
 		return 0;
 	}
-	// Create a new SSL session. This does not connect the socket.
-	ssl = SSL_new(ctx);
 
-	struct sockaddr_in sin = {0};
-	sin.sin_family = AF_INET;
-	sin.sin_port = htons(port);
-	sin.sin_addr.s_addr = *(long*) (host->h_addr);
-	m_sock = socket(AF_INET, SOCK_STREAM, 0);
-	if (::connect(m_sock, (struct sockaddr *) &sin, sizeof(struct sockaddr)) < 0)
-	{
-		DEBUG_ETHERPORT("Error: connecting to the server failed");
+	int sock = connectToAny(addresses, CONNECT_TIMEOUT);
+	if (sock < 0) {
+		if (session)
+			SSL_SESSION_free(session);
 		return 0;
 	}
+	m_sock = sock;
+
+	// Create a new SSL session. This does not connect the socket.
+	ssl = SSL_new(ctx);
+	configureKtls(ssl);
+	SSL_set_ex_data(ssl, sessionKeyIndex, strdup(key.c_str()));
+	if (session) {
+		// Offer the previous session so the server can skip the full handshake.
+		SSL_set_session(ssl, session);
+		SSL_SESSION_free(session);
+	}
 	SSL_set_fd(ssl, m_sock);
 	SSL_set_tlsext_host_name(ssl, server);	// set correct host name
 
 	if (SSL_connect(ssl) < 1) {
+		SSL_free(ssl);
+		ssl = NULL;
 		close(m_sock);
 		m_sock = 0;
+		std::lock_guard<std::mutex> lock(sslMutex);
+		sslStats.failed++;
+		// Don't offer a session the server may have rejected again.
+		std::map<std::string, SSL_SESSION*>::iterator it = sslSessions.find(key);
+		if (it != sslSessions.end()) {
+			SSL_SESSION_free(it->second);
+			sslSessions.erase(it);
+		}
 		DEBUG_ETHERPORT("Error: Could not build an SSL session");
 		return 0;
 	}
+
+	{
+		std::lock_guard<std::mutex> lock(sslMutex);
+		sslStats.handshakes++;
+		if (SSL_session_reused(ssl))
+			sslStats.resumed++;
+		if (ktlsSend())
+			sslStats.ktls++;
+	}
 	m_connected = true;
 	return 1;
 }
 
+int EthernetClientSsl::handshake()
+{
+	if (!ssl)
+		return -1;
+
+	sigset_t old;
+	bool blocked = blockSigpipe(&old);
+	int rc = SSL_do_handshake(ssl);
+	restoreSigpipe(&old, blocked);
+	if (rc == 1) {
+		fcntl(m_sock, F_SETFL, fcntl(m_sock, F_GETFL, 0) & ~O_NONBLOCK);
+		m_connected = true;
+		return 1;
+	}
+
+	int err = SSL_get_error(ssl, rc);
+	return (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? 0 : -1;
+}
+
+bool EthernetClientSsl::sessionReused()
+{
+	return ssl && SSL_session_reused(ssl);
+}
+
+bool EthernetClientSsl::ktlsSend()
+{
+	return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
+
+bool EthernetClientSsl::ktlsRecv()
+{
+	return ssl && BIO_get_ktls_recv(SSL_get_rbio(ssl));
+}
+
+void EthernetClientSsl::setKtlsEnabled(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(sslMutex);
+	sslKtls = enabled;
+}
+
+bool EthernetClientSsl::setCiphers(const char *cipherList, const char *cipherSuites)
+{
+	std::lock_guard<std::mutex> lock(sslMutex);
+	sslCipherList = cipherList ? cipherList : "";
+	sslCipherSuites = cipherSuites ? cipherSuites : "";
+	return !clientCtx || applySslSettings();
+}
+
+bool EthernetClientSsl::setAlpnProtocols(const char *protocols)
+{
+	std::lock_guard<std::mutex> lock(sslMutex);
+	if (!encodeAlpn(protocols, sslAlpn))
+		return false;
+	sslAlpnSet = true;
+	return !clientCtx || applySslSettings();
+}
+
+void EthernetClientSsl::clearSessions()
+{
+	std::lock_guard<std::mutex> lock(sslMutex);
+	for (std::map<std::string, SSL_SESSION*>::iterator it = sslSessions.begin(); it != sslSessions.end(); it++)
+		SSL_SESSION_free(it->second);
+	sslSessions.clear();
+}
+
+SslStats EthernetClientSsl::getStats()
+{
+	std::lock_guard<std::mutex> lock(sslMutex);
+	return sslStats;
+}
+
 bool EthernetClientSsl::connected()
 {
 	if (!m_sock || !ssl)
@@ -401,6 +856,18 @@ bool EthernetClientSsl::connected()
 
 void EthernetClientSsl::stop()
 {
+	// OpenSSL won't resume sessions of connections that weren't shut down, so send a close notify if the connection is
+	//	still open, or mark it as shut down if the peer already closed it.
+	if (ssl) {
+		if (m_connected) {
+			sigset_t old;
+			bool blocked = blockSigpipe(&old);
+			SSL_shutdown(ssl);
+			restoreSigpipe(&old, blocked);
+		} else {
+			SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN);
+		}
+	}
 	if (m_sock) {
 		close(m_sock);
 		m_sock = 0;
@@ -410,6 +877,7 @@ void EthernetClientSsl::stop()
 		ssl = NULL;
 	}
 	m_connected = false;
+	tmpbufidx = tmpbufsize = 0;
 }
 
 EthernetClientSsl::operator bool()
@@ -422,18 +890,31 @@ EthernetClientSsl::operator bool()
 //	If an error occurs or a timeout happens, we set the disconnect flag on the socket
 //	and return 0;
 int EthernetClientSsl::read(uint8_t *buf, size_t size) {
-	fd_set readfds;
-	struct timeval timeout;
-	int sel_rc;
+	// Return data buffered by timedRead() first.
+	if (tmpbufidx < tmpbufsize) {
+		size_t tmpsize = tmpbufsize-tmpbufidx;
+		if (tmpsize > size)
+			tmpsize = size;
+		memcpy(buf, &tmpbuf[tmpbufidx], tmpsize);
+		tmpbufidx += tmpsize;
+		return tmpsize;
+	}
 
-	FD_ZERO(&readfds);
-	FD_SET(m_sock, &readfds);
-	timeout.tv_sec  = 5;
-	timeout.tv_usec = 0;
-	sel_rc = select(m_sock + 1, &readfds, NULL, NULL, &timeout);
-	if(sel_rc < 1) {
-		m_connected = false;
-		return 0;
+	// Data that was already decrypted can't be seen by select().
+	if (SSL_pending(ssl) <= 0) {
+		fd_set readfds;
+		struct timeval timeout;
+		int sel_rc;
+
+		FD_ZERO(&readfds);
+		FD_SET(m_sock, &readfds);
+		timeout.tv_sec  = 5;
+		timeout.tv_usec = 0;
+		sel_rc = select(m_sock + 1, &readfds, NULL, NULL, &timeout);
+		if(sel_rc < 1) {
+			m_connected = false;
+			return 0;
+		}
 	}
 	size_t readsize;
 	int n = SSL_read_ex(ssl, buf, size, &readsize);
@@ -445,6 +926,68 @@ int EthernetClientSsl::read(uint8_t *buf, size_t size) {
 }
 
 size_t EthernetClientSsl::write(const uint8_t *buf, size_t size) {
-	return SSL_write(ssl, buf, size);
+	sigset_t old;
+	bool blocked = blockSigpipe(&old);
+	int rc = SSL_write(ssl, buf, size);
+	restoreSigpipe(&old, blocked);
+	if (rc <= 0) {
+		m_connected = false;
+		return 0;
+	}
+	return rc;
+}
+
+size_t EthernetClientSsl::writeNonBlocking(const uint8_t *buf, size_t size) {
+	// The socket is only made non-blocking for this write, since reads and write() wait for the connection.
+	int flags = fcntl(m_sock, F_GETFL, 0);
+	fcntl(m_sock, F_SETFL, flags | O_NONBLOCK);
+	sigset_t old;
+	bool blocked = blockSigpipe(&old);
+	int rc = SSL_write(ssl, buf, size);
+	restoreSigpipe(&old, blocked);
+	fcntl(m_sock, F_SETFL, flags);
+	if (rc <= 0) {
+		int err = SSL_get_error(ssl, rc);
+		if (err != SSL_ERROR_WANT_WRITE && err != SSL_ERROR_WANT_READ)
+			m_connected = false;
+		return 0;
+	}
+	return rc;
+}
+
+ssize_t EthernetClientSsl::sendFile(int fd, off_t offset, size_t size) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	// With kernel TLS the file is encrypted by the kernel without being copied into user space.
+	if (ktlsSend()) {
+		sigset_t old;
+		bool blocked = blockSigpipe(&old);
+		size_t sent = 0;
+		while (sent < size) {
+			ossl_ssize_t rc = SSL_sendfile(ssl, fd, offset + sent, size - sent, 0);
+			if (rc <= 0)
+				break;
+			sent += rc;
+		}
+		restoreSigpipe(&old, blocked);
+		return sent;
+	}
+#endif
+
+	uint8_t buf[TMPBUF];
+	size_t sent = 0;
+	while (sent < size) {
+		size_t chunk = size - sent < sizeof(buf) ? size - sent : sizeof(buf);
+		ssize_t rc = pread(fd, buf, chunk, offset + sent);
+		if (rc <= 0 || write(buf, rc) != (size_t) rc)
+			break;
+		sent += rc;
+	}
+	return sent;
+}
+
+bool EthernetClientSsl::available(int msec) {
+	if (ssl && SSL_pending(ssl) > 0)
+		return true;
+	return EthernetClient::available(msec);
 }
 #endif
\ No newline at end of file
@@ -33,6 +33,7 @@
 #include <inttypes.h>
 #include <ctype.h>
 #include <netdb.h>
+#include <sys/types.h>
 #include <openssl/ssl.h>
 #include <string>
 
@@ -43,13 +44,16 @@
 
 #define TMPBUF 1024*8
 
+// The default ALPN protocols offered by TLS connections, as a comma separated list.
+#define SSL_CLIENT_ALPN "http/1.1"
+
 class EthernetServer;
 
 class EthernetClient {
 public:
 	EthernetClient();
 	EthernetClient(int sock);
-	~EthernetClient();
+	virtual ~EthernetClient();
 	virtual int connect(const char *server, uint16_t port);
 	virtual bool connected();
 	virtual void stop();
@@ -57,12 +61,20 @@ public:
 	virtual int timedRead();
     virtual size_t readBytesUntil(char terminator, char *buffer, size_t length);
 	virtual size_t write(const uint8_t *buf, size_t size);
+	// Sends up to size bytes without waiting for room in the socket buffer.
+	//	Returns the number of bytes sent, which is 0 if the buffer is full or the connection failed.
+	virtual size_t writeNonBlocking(const uint8_t *buf, size_t size);
+	// Sends size bytes of a file starting at offset without copying them through user space where possible.
+	//	Returns the number of bytes sent.
+	virtual ssize_t sendFile(int fd, off_t offset, size_t size);
 	virtual operator bool();
 	int GetSocket() {
 		return m_sock;
 	}
     virtual void flush();
 	virtual bool available();
+	// Returns true if data can be read within msec milliseconds.
+	virtual bool available(int msec);
 	virtual void setTimeout(int msec);
 protected:
 	uint8_t *tmpbuf = NULL;
@@ -73,19 +85,58 @@ protected:
 	friend class EthernetServer;
 };
 
+struct SslStats {
+	// The number of completed TLS handshakes.
+	unsigned long handshakes;
+	// The number of completed handshakes that resumed a previous session.
+	unsigned long resumed;
+	// The number of handshakes that failed.
+	unsigned long failed;
+	// The number of completed handshakes whose connection was offloaded to kernel TLS.
+	unsigned long ktls;
+};
+
 class EthernetClientSsl : public EthernetClient {
 public:
 	EthernetClientSsl();
 	EthernetClientSsl(int sock);
+	// Creates the server side of a connection accepted from a TLS server. The handshake is performed by handshake().
+	EthernetClientSsl(int sock, SSL_CTX *ctx);
 	~EthernetClientSsl();
 	virtual int connect(const char *server, uint16_t port);
 	virtual bool connected();
 	virtual void stop();
 	virtual int read(uint8_t *buf, size_t size);
 	virtual size_t write(const uint8_t *buf, size_t size);
+	// After returning 0 because the buffer is full, the next call must pass the same data again.
+	virtual size_t writeNonBlocking(const uint8_t *buf, size_t size);
+	virtual ssize_t sendFile(int fd, off_t offset, size_t size);
+	using EthernetClient::available;
+	virtual bool available(int msec);
 	virtual operator bool();
+	// Continues the handshake of an accepted connection without blocking.
+	//	Returns 1 when it completes, 0 if it's still in progress, or -1 if it failed.
+	int handshake();
+	// Returns true if the handshake resumed a previous session.
+	bool sessionReused();
+	// Returns true if data sent over the connection is encrypted by the kernel.
+	bool ktlsSend();
+	// Returns true if data received over the connection is decrypted by the kernel.
+	bool ktlsRecv();
+
+	// Sets the ciphers offered by TLS 1.2 (OpenSSL cipher list format) and TLS 1.3 (cipher suite names) connections.
+	//	Either may be NULL to keep the OpenSSL default.
+	static bool setCiphers(const char *cipherList, const char *cipherSuites);
+	// Sets the ALPN protocols offered by TLS connections, as a comma separated list in order of preference.
+	static bool setAlpnProtocols(const char *protocols);
+	// Forgets the sessions kept for resuming connections.
+	static void clearSessions();
+	// Returns the handshake counters of all TLS connections.
+	static SslStats getStats();
+	// Sets if connections made or accepted after the call are offloaded to kernel TLS when it's available. Enabled by default.
+	static void setKtlsEnabled(bool enabled);
 protected:
-	SSL* ssl;
+	SSL* ssl = NULL;
 };
 
 class EthernetServer {
@@ -95,9 +146,21 @@ public:
 
 	virtual bool begin();
 	virtual EthernetClient available();
+	// Accepts a new client without blocking. When TLS is enabled, the handshake is performed over several calls and
+	//	the client is only returned once it completes. The caller owns the returned client.
+	virtual EthernetClient *accept();
+	// Serves connections accepted after the call over TLS, using a PEM certificate chain and private key.
+	bool enableTls(const char *certFile, const char *keyFile);
+	// Returns the handshake counters of TLS connections accepted by this server.
+	SslStats getTlsStats();
 private:
 	uint16_t m_port;
 	int m_sock;
+	SSL_CTX *m_ctx = NULL;
+	// The client whose TLS handshake is in progress.
+	EthernetClientSsl *m_pending = NULL;
+	unsigned long m_pendingStart = 0;
+	SslStats m_stats = {0, 0, 0, 0};
 };
 #endif
 
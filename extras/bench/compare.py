@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Compares two result files written by micro_bench.
+
+Usage:
+    python3 compare.py old.json new.json [--threshold 10]
+
+Prints the change in time per operation of each benchmark, and exits with status 1 if any benchmark got slower by more
+than the threshold (in percent), so it can be used to gate a release.
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data.get("version", "unknown"), {b["name"]: b for b in data["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    args = parser.parse_args()
+
+    old_version, old = load(args.old)
+    new_version, new = load(args.new)
+    print("%-36s %14s %14s %9s" % ("benchmark", old_version[:14], new_version[:14], "change"))
+
+    regressions = 0
+    for name in sorted(set(old) | set(new)):
+        if name not in old or name not in new:
+            print("%-36s %s" % (name, "only in " + (args.old if name in old else args.new)))
+            continue
+
+        before = old[name]["ns_per_op"]
+        after = new[name]["ns_per_op"]
+        change = (after - before) * 100.0 / before if before > 0 else 0.0
+        marker = ""
+        if change > args.threshold:
+            marker = "  REGRESSION"
+            regressions += 1
+        print("%-36s %11.1f ns %11.1f ns %+8.1f%%%s" % (name, before, after, change, marker))
+
+    if regressions > 0:
+        print("%d benchmarks are more than %.0f%% slower" % (regressions, args.threshold))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
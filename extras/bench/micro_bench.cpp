@@ -0,0 +1,413 @@
+/* Microbenchmarks of the request parser, LinkedMap, StringBuilder, response streaming and route dispatch. Results are
+ * printed as JSON so runs against different versions of the library can be compared with compare.py.
+ *
+ * Build and run from the root of the library (the Linux build of the library requires tiny_websockets):
+ *   g++ -std=c++17 -O2 -I. -DOTF_BENCHMARK extras/bench/micro_bench.cpp $(ls *.cpp) -o micro_bench \
+ *       -ltiny_websockets -lssl -lcrypto -lpthread -DOTF_BENCH_VERSION="\"$(git describe --always)\""
+ *   ./micro_bench > new.json
+ *   python3 extras/bench/compare.py old.json new.json
+ *
+ * Options:
+ *   --filter <text>      Only run benchmarks whose name contains the text.
+ *   --min-time <sec>     Minimum duration of each repetition (default 0.1).
+ *   --repetitions <n>    Number of repetitions; the median is reported (default 5).
+ *   --text               Print a table instead of JSON.
+ */
+#include "OpenThingsFramework.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef OTF_BENCH_VERSION
+#define OTF_BENCH_VERSION "unknown"
+#endif
+
+using namespace OTF;
+
+namespace OTF {
+  class BenchmarkAccess {
+  public:
+    static RequestType parse(char *data, size_t length, bool cloudRequest) {
+      Request request(data, length, cloudRequest);
+      return request.getType();
+    }
+
+    static RequestType parseBinary(char *data, size_t length, char *const *paths, size_t pathCount) {
+      Request request(data, length, paths, pathCount);
+      return request.getType();
+    }
+
+    static Request *newRequest(char *data, size_t length) {
+      return new Request(data, length, false);
+    }
+
+    static Response *newResponse() {
+      return new Response();
+    }
+
+    static void fillResponse(OpenThingsFramework &otf, const Request &request, Response &response) {
+      otf.fillResponse(request, response);
+    }
+  };
+}// namespace OTF
+
+/** Prevents the compiler from optimizing away the computation of `value`. */
+template<typename T>
+static inline void doNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct Benchmark {
+  std::string name;
+  /** Runs the measured operation the specified number of times. */
+  std::function<void(uint64_t iterations)> run;
+  /** The number of bytes processed by each operation, or 0 if throughput isn't meaningful. */
+  size_t bytesPerOp;
+};
+
+struct Result {
+  std::string name;
+  uint64_t iterations;
+  double nsPerOp;
+  double minNsPerOp;
+  double maxNsPerOp;
+  size_t bytesPerOp;
+};
+
+static std::vector<Benchmark> benchmarks;
+
+static void add(const std::string &name, std::function<void(uint64_t)> run, size_t bytesPerOp = 0) {
+  benchmarks.push_back({name, run, bytesPerOp});
+}
+
+/* Request corpora, modelled on requests sent by the mobile app and browsers. */
+
+static const char GET_SIMPLE[] =
+  "GET /jc HTTP/1.1\r\n"
+  "host: 192.168.1.20\r\n"
+  "\r\n";
+
+static const char GET_QUERY[] =
+  "GET /cm?sid=3&en=1&t=600&pw=a6d82bced638de3def1e9bbb4983225c&ssta=0&qd=1&uwt=0 HTTP/1.1\r\n"
+  "host: 192.168.1.20\r\n"
+  "user-agent: Mozilla/5.0 (Linux; Android 13) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0 Mobile Safari/537.36\r\n"
+  "accept: application/json, text/plain, */*\r\n"
+  "accept-encoding: gzip, deflate\r\n"
+  "accept-language: en-US,en;q=0.9\r\n"
+  "connection: keep-alive\r\n"
+  "\r\n";
+
+static const char POST_JSON[] =
+  "POST /cp?pw=a6d82bced638de3def1e9bbb4983225c HTTP/1.1\r\n"
+  "host: 192.168.1.20\r\n"
+  "user-agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0 Safari/537.36\r\n"
+  "accept: application/json\r\n"
+  "accept-encoding: gzip, deflate, br\r\n"
+  "accept-language: en-US,en;q=0.9\r\n"
+  "cache-control: no-cache\r\n"
+  "content-type: application/json\r\n"
+  "content-length: 96\r\n"
+  "origin: http://192.168.1.20\r\n"
+  "referer: http://192.168.1.20/\r\n"
+  "\r\n"
+  "{\"name\":\"Morning\",\"days\":[1,3,5],\"start\":[360,0,0,0],\"durations\":[600,600,300,0,0,0,0,0],\"on\":1}";
+
+static const char CLOUD_TEXT[] =
+  "GET /jc?pw=a6d82bced638de3def1e9bbb4983225c HTTP/1.1\r\n"
+  "x-forwarded-for: 203.0.113.7\r\n"
+  "accept: application/json\r\n"
+  "\r\n";
+
+/** Builds the binary framing equivalent of CLOUD_TEXT, using an interned path. */
+static std::string makeBinaryRequest() {
+  const char *query = "pw=a6d82bced638de3def1e9bbb4983225c";
+  const char *headers[][2] = {{"x-forwarded-for", "203.0.113.7"}, {"accept", "application/json"}};
+
+  std::string frame;
+  frame += (char) HTTP_GET;
+  frame += '\0';
+  frame += (char) 1;
+  frame += (char) (strlen(query) >> 8);
+  frame += (char) strlen(query);
+  frame += query;
+  frame += (char) 2;
+  for (auto &header : headers) {
+    frame += (char) strlen(header[0]);
+    frame += header[0];
+    frame += (char) (strlen(header[1]) >> 8);
+    frame += (char) strlen(header[1]);
+    frame += header[1];
+  }
+  frame.append(4, '\0');
+  return frame;
+}
+
+/** Adds a benchmark that parses a copy of `corpus` in each iteration, as the framework does with each request. */
+static void addParse(const std::string &name, const std::string &corpus, std::function<RequestType(char *, size_t)> parse) {
+  add("request_parse/" + name, [corpus, parse](uint64_t iterations) {
+    std::vector<char> buffer(corpus.size() + 1);
+    for (uint64_t i = 0; i < iterations; i++) {
+      memcpy(buffer.data(), corpus.data(), corpus.size());
+      buffer[corpus.size()] = '\0';
+      RequestType type = parse(buffer.data(), corpus.size());
+      doNotOptimize(type);
+    }
+  }, corpus.size());
+}
+
+static void addParserBenchmarks() {
+  auto parseLocal = [](char *data, size_t length) { return BenchmarkAccess::parse(data, length, false); };
+  auto parseCloud = [](char *data, size_t length) { return BenchmarkAccess::parse(data, length, true); };
+  addParse("local_get_simple", GET_SIMPLE, parseLocal);
+  addParse("local_get_query", GET_QUERY, parseLocal);
+  addParse("local_post_json", POST_JSON, parseLocal);
+  addParse("cloud_text", CLOUD_TEXT, parseCloud);
+
+  static char path[] = "/jc";
+  static char *paths[] = {path};
+  addParse("cloud_binary", makeBinaryRequest(), [](char *data, size_t length) {
+    return BenchmarkAccess::parseBinary(data, length, paths, 1);
+  });
+}
+
+/** Returns N keys in the format the framework uses for routes. */
+static std::vector<std::string> makeKeys(size_t count) {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < count; i++) {
+    keys.push_back(std::to_string(HTTP_GET) + "/route/" + std::to_string(i));
+  }
+  return keys;
+}
+
+static void addLinkedMapBenchmarks() {
+  for (size_t size : {4, 16, 64}) {
+    std::vector<std::string> keys = makeKeys(size);
+    std::string suffix = "/" + std::to_string(size);
+
+    add("linkedmap_add" + suffix, [keys](uint64_t iterations) {
+      // Each operation builds a complete map, since adding to an ever growing map would measure a different size.
+      for (uint64_t i = 0; i < iterations; i++) {
+        LinkedMap<int *> map;
+        for (const std::string &key : keys) {
+          map.add(key.c_str(), nullptr);
+        }
+        doNotOptimize(map);
+      }
+    });
+
+    add("linkedmap_find_hit" + suffix, [keys](uint64_t iterations) {
+      LinkedMap<const char *> map;
+      for (const std::string &key : keys) {
+        map.add(key.c_str(), key.c_str());
+      }
+      // Look up every key in turn, so the average position is the middle of the list.
+      for (uint64_t i = 0; i < iterations; i++) {
+        const char *value = map.find(keys[i % keys.size()].c_str());
+        doNotOptimize(value);
+      }
+    });
+
+    add("linkedmap_find_miss" + suffix, [keys](uint64_t iterations) {
+      LinkedMap<const char *> map;
+      for (const std::string &key : keys) {
+        map.add(key.c_str(), key.c_str());
+      }
+      std::string missing = std::to_string(HTTP_GET) + "/route/missing";
+      for (uint64_t i = 0; i < iterations; i++) {
+        const char *value = map.find(missing.c_str());
+        doNotOptimize(value);
+      }
+    });
+  }
+}
+
+static void addStringBuilderBenchmarks() {
+  static const char CHUNK[] = "{\"sid\":3,\"dur\":600,\"st\":1},\r\n";
+
+  add("stringbuilder_bprintf/32B", [](uint64_t iterations) {
+    StringBuilder builder(RESPONSE_BUFFER_SIZE);
+    for (uint64_t i = 0; i < iterations; i++) {
+      if (builder.getLength() + sizeof(CHUNK) >= RESPONSE_BUFFER_SIZE) {
+        builder.clear();
+      }
+      builder.bprintf("%s", CHUNK);
+    }
+    doNotOptimize(builder.getLength());
+  }, sizeof(CHUNK) - 1);
+
+  add("stringbuilder_bprintf_format/32B", [](uint64_t iterations) {
+    StringBuilder builder(RESPONSE_BUFFER_SIZE);
+    for (uint64_t i = 0; i < iterations; i++) {
+      if (builder.getLength() + sizeof(CHUNK) >= RESPONSE_BUFFER_SIZE) {
+        builder.clear();
+      }
+      builder.bprintf("{\"sid\":%d,\"dur\":%d,\"st\":%d},\r\n", 3, 600, 1);
+    }
+    doNotOptimize(builder.getLength());
+  }, sizeof(CHUNK) - 1);
+
+  add("stringbuilder_write/32B", [](uint64_t iterations) {
+    StringBuilder builder(RESPONSE_BUFFER_SIZE);
+    for (uint64_t i = 0; i < iterations; i++) {
+      if (builder.getLength() + sizeof(CHUNK) >= RESPONSE_BUFFER_SIZE) {
+        builder.clear();
+      }
+      builder.write(CHUNK, sizeof(CHUNK) - 1);
+    }
+    doNotOptimize(builder.getLength());
+  }, sizeof(CHUNK) - 1);
+}
+
+static void addResponseBenchmarks() {
+  static const size_t BODY_SIZE = 16 * 1024;
+  static const size_t CHUNK_SIZE = 256;
+
+  add("response_stream/16KiB", [](uint64_t iterations) {
+    char chunk[CHUNK_SIZE];
+    memset(chunk, 'x', sizeof(chunk));
+    size_t sunk = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+      Response *res = BenchmarkAccess::newResponse();
+      res->enableStream([&sunk](const char *buffer, size_t length, bool first_message) {
+        sunk += length;
+      }, []() {}, []() {});
+      res->writeStatus(200, "OK");
+      res->writeHeader("content-type", "application/octet-stream");
+      for (size_t written = 0; written < BODY_SIZE; written += CHUNK_SIZE) {
+        res->writeBodyData(chunk, CHUNK_SIZE);
+      }
+      res->end();
+      delete res;
+    }
+    doNotOptimize(sunk);
+  }, BODY_SIZE);
+}
+
+static void smallResponse(const Request &req, Response &res) {
+  res.writeStatus(200, "OK");
+  res.writeHeader("content-type", "application/json");
+  res.writeBodyChunk("{\"result\":1}");
+}
+
+static void addDispatchBenchmarks() {
+  for (size_t size : {1, 8, 32}) {
+    std::string suffix = "/" + std::to_string(size);
+    auto run = [size](uint64_t iterations, bool hit) {
+      // Port 0 binds the local server to an unused port, since only fillResponse() is measured.
+      OpenThingsFramework otf(0);
+      for (size_t i = 0; i < size; i++) {
+        std::string path = "/route/" + std::to_string(i);
+        otf.on(strdup(path.c_str()), smallResponse, HTTP_GET);
+      }
+
+      // Route to the last registered path, which is the worst case for the linear lookup.
+      std::string text = "GET " + (hit ? "/route/" + std::to_string(size - 1) : std::string("/missing")) + " HTTP/1.1\r\n\r\n";
+      std::vector<char> buffer(text.begin(), text.end());
+      buffer.push_back('\0');
+      Request *request = BenchmarkAccess::newRequest(buffer.data(), text.size());
+      for (uint64_t i = 0; i < iterations; i++) {
+        Response *res = BenchmarkAccess::newResponse();
+        BenchmarkAccess::fillResponse(otf, *request, *res);
+        doNotOptimize(res->getLength());
+        delete res;
+      }
+      delete request;
+    };
+
+    add("dispatch_hit" + suffix, [run](uint64_t iterations) { run(iterations, true); });
+    add("dispatch_miss" + suffix, [run](uint64_t iterations) { run(iterations, false); });
+  }
+}
+
+/** Returns the time in seconds taken to run the benchmark the specified number of times. */
+static double measure(const Benchmark &benchmark, uint64_t iterations) {
+  double start = now();
+  benchmark.run(iterations);
+  return now() - start;
+}
+
+static Result runBenchmark(const Benchmark &benchmark, double minTime, int repetitions) {
+  // Find an iteration count that takes at least the minimum time.
+  uint64_t iterations = 1;
+  double elapsed = measure(benchmark, iterations);
+  while (elapsed < minTime) {
+    double factor = elapsed > 0 ? minTime * 1.2 / elapsed : 100;
+    iterations = (uint64_t) (iterations * std::min(std::max(factor, 2.0), 100.0));
+    elapsed = measure(benchmark, iterations);
+  }
+
+  std::vector<double> samples;
+  samples.push_back(elapsed * 1e9 / iterations);
+  for (int i = 1; i < repetitions; i++) {
+    samples.push_back(measure(benchmark, iterations) * 1e9 / iterations);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  return {benchmark.name, iterations, samples[samples.size() / 2], samples.front(), samples.back(), benchmark.bytesPerOp};
+}
+
+int main(int argc, char **argv) {
+  const char *filter = nullptr;
+  double minTime = 0.1;
+  int repetitions = 5;
+  bool text = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      minTime = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+      repetitions = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--text") == 0) {
+      text = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--filter text] [--min-time seconds] [--repetitions n] [--text]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  addParserBenchmarks();
+  addLinkedMapBenchmarks();
+  addStringBuilderBenchmarks();
+  addResponseBenchmarks();
+  addDispatchBenchmarks();
+
+  std::vector<Result> results;
+  for (const Benchmark &benchmark : benchmarks) {
+    if (filter == nullptr || benchmark.name.find(filter) != std::string::npos) {
+      results.push_back(runBenchmark(benchmark, minTime, repetitions));
+      if (text) {
+        const Result &result = results.back();
+        printf("%-36s %12.1f ns/op  (min %.1f, max %.1f)", result.name.c_str(), result.nsPerOp, result.minNsPerOp, result.maxNsPerOp);
+        if (result.bytesPerOp > 0) {
+          printf("  %8.1f MB/s", result.bytesPerOp * 1e3 / result.nsPerOp);
+        }
+        printf("\n");
+        fflush(stdout);
+      }
+    }
+  }
+
+  if (!text) {
+    printf("{\n  \"version\": \"%s\",\n  \"compiler\": \"%s\",\n  \"repetitions\": %d,\n  \"benchmarks\": [\n", OTF_BENCH_VERSION, __VERSION__, repetitions);
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &result = results[i];
+      printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, \"max_ns_per_op\": %.2f, \"bytes_per_op\": %zu}%s\n",
+             result.name.c_str(), (unsigned long long) result.iterations, result.nsPerOp, result.minNsPerOp, result.maxNsPerOp,
+             result.bytesPerOp, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+/* Measures the throughput of bulk transfers over a loopback TLS connection between EthernetServer and
+ * EthernetClientSsl, with and without kernel TLS offload, using both write() and sendFile().
+ *
+ * Build and run from the root of the library:
+ *   g++ -std=c++17 -O2 -I. extras/bench/tls_bulk.cpp etherport.cpp Resolver.cpp -o tls_bulk -lssl -lcrypto -lpthread
+ *   openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 365 -subj /CN=localhost
+ *   ./tls_bulk cert.pem key.pem [megabytes]
+ *
+ * Kernel TLS is only used if the tls kernel module is loaded (modprobe tls) and OpenSSL was built with kTLS support.
+ * The "ktls" column shows whether the connection was actually offloaded.
+ */
+#include "etherport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <thread>
+
+#define BENCH_PORT 18543
+#define BENCH_CHUNK_SIZE (16 * 1024)
+
+unsigned long millis() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (unsigned long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static double seconds() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/** Sends `size` bytes from the server to a client and returns the time the client took to receive them. */
+static double transfer(EthernetServer &server, int fd, size_t size, bool useSendFile, bool &offloaded) {
+  EthernetClient *serverClient = nullptr;
+  std::thread accepter([&]() {
+    while (serverClient == nullptr) {
+      serverClient = server.accept();
+    }
+  });
+
+  EthernetClientSsl client;
+  if (!client.connect("127.0.0.1", BENCH_PORT)) {
+    fprintf(stderr, "Could not connect to the server\n");
+    exit(1);
+  }
+  accepter.join();
+  offloaded = ((EthernetClientSsl *) serverClient)->ktlsSend();
+
+  double start = seconds();
+  std::thread sender([&]() {
+    if (useSendFile) {
+      serverClient->sendFile(fd, 0, size);
+    } else {
+      uint8_t chunk[BENCH_CHUNK_SIZE];
+      memset(chunk, 'x', sizeof(chunk));
+      for (size_t sent = 0; sent < size; sent += sizeof(chunk)) {
+        serverClient->write(chunk, size - sent < sizeof(chunk) ? size - sent : sizeof(chunk));
+      }
+    }
+  });
+
+  uint8_t buffer[BENCH_CHUNK_SIZE];
+  size_t received = 0;
+  while (received < size) {
+    int rc = client.read(buffer, sizeof(buffer));
+    if (rc <= 0) {
+      break;
+    }
+    received += rc;
+  }
+  double elapsed = seconds() - start;
+
+  sender.join();
+  serverClient->stop();
+  delete serverClient;
+  client.stop();
+  if (received < size) {
+    fprintf(stderr, "Transfer ended after %zu of %zu bytes\n", received, size);
+    exit(1);
+  }
+  return elapsed;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s cert.pem key.pem [megabytes]\n", argv[0]);
+    return 1;
+  }
+  size_t size = (argc > 3 ? atoi(argv[3]) : 256) * 1024UL * 1024UL;
+
+  // The file sent with sendFile().
+  char path[] = "/tmp/tls_bulk_XXXXXX";
+  int fd = mkstemp(path);
+  unlink(path);
+  if (fd < 0 || ftruncate(fd, size) != 0) {
+    fprintf(stderr, "Could not create the test file\n");
+    return 1;
+  }
+
+  EthernetServer server(BENCH_PORT);
+  if (!server.begin() || !server.enableTls(argv[1], argv[2])) {
+    fprintf(stderr, "Could not start the TLS server\n");
+    return 1;
+  }
+
+  printf("%-10s %-8s %-6s %10s\n", "method", "request", "ktls", "MB/s");
+  for (int useSendFile = 0; useSendFile < 2; useSendFile++) {
+    for (int ktls = 1; ktls >= 0; ktls--) {
+      EthernetClientSsl::setKtlsEnabled(ktls);
+      bool offloaded;
+      double elapsed = transfer(server, fd, size, useSendFile, offloaded);
+      printf("%-10s %-8s %-6s %10.1f\n", useSendFile ? "sendFile" : "write", ktls ? "ktls" : "user", offloaded ? "yes" : "no",
+             size / elapsed / (1024 * 1024));
+    }
+  }
+
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,644 @@
+/* Local stand-in for the OpenThings Cloud, for benchmarking and stressing the forwarded request path without the real
+ * server. It accepts a websocket connection from a device, forwards HTTP requests to it as "FWD:" messages (or binary
+ * request frames) at a configurable rate and concurrency, and measures round-trip latency and throughput from the
+ * responses.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 extras/cloudsim/cloud_relay.cpp -o cloud_relay -lcrypto
+ *
+ * Example, with a device configured to connect to ws://127.0.0.1:8081 (such as the load test example server started
+ * with --cloud 127.0.0.1 8081):
+ *   ./cloud_relay --port 8081 --concurrency 4 --duration 10 --request "8 GET /jc" --request "1 GET /jo"
+ *
+ * Options:
+ *   --port <port>          Port to accept the device connection on (default 8081)
+ *   --mode closed|open     Closed-loop or open-loop load (default closed)
+ *   --rate <req/s>         Request rate in open-loop mode (default 100)
+ *   --concurrency <n>      Maximum number of requests waiting for a response (default 1)
+ *   --duration <sec>       Measured duration (default 10)
+ *   --warmup <sec>         Duration before measuring (default 1)
+ *   --timeout <sec>        Time to wait for each response (default 5)
+ *   --framing text|binary  Forward requests as text or with the binary framing (default text). Binary framing is only
+ *                          used if the device asked for it when connecting.
+ *   --request "[weight] METHOD path[?query] [body]"
+ *                          Adds a request to the mix (default "GET /"). May be repeated.
+ *   --json                 Print the results as JSON
+ *
+ * Compressed (deflate) framing is not offered, so devices built with OTF_ENABLE_DEFLATE fall back to uncompressed
+ * binary frames.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define ID_LENGTH 4
+#define FRAME_REQUEST 0x01
+#define FRAME_DEFINE_PATH 0x02
+#define FRAME_RESPONSE 0x81
+// The number of paths a device can intern (CLOUD_MAX_PATHS in OpenThingsFramework.h).
+#define MAX_PATHS 32
+
+enum Opcode {
+  OP_CONTINUATION = 0x0,
+  OP_TEXT = 0x1,
+  OP_BINARY = 0x2,
+  OP_CLOSE = 0x8,
+  OP_PING = 0x9,
+  OP_PONG = 0xa
+};
+
+struct RequestSpec {
+  std::string method;
+  std::string path;
+  std::string query;
+  std::string body;
+  unsigned weight;
+  /** The ID the path was interned with for the binary framing, or 0 to send the path with each request. */
+  uint16_t pathId;
+};
+
+struct Options {
+  int port = 8081;
+  bool openLoop = false;
+  double rate = 100;
+  int concurrency = 1;
+  double duration = 10;
+  double warmup = 1;
+  double timeout = 5;
+  bool binary = false;
+  bool json = false;
+  std::vector<RequestSpec> requests;
+};
+
+struct Stats {
+  uint64_t sent = 0;
+  uint64_t completed = 0;
+  uint64_t timeouts = 0;
+  uint64_t unknown = 0;
+  uint64_t statusClasses[6] = {};
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  /** The latency of each completed request in microseconds. */
+  std::vector<uint32_t> latencies;
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [--port n] [--mode closed|open] [--rate n] [--concurrency n] [--duration sec] [--warmup sec]\n"
+                  "       [--timeout sec] [--framing text|binary] [--request \"[weight] METHOD path [body]\"]... [--json]\n", name);
+  exit(1);
+}
+
+static RequestSpec parseRequest(const char *spec) {
+  RequestSpec request;
+  request.weight = 1;
+  request.pathId = 0;
+
+  const char *cursor = spec;
+  char *end;
+  unsigned long weight = strtoul(cursor, &end, 10);
+  if (end != cursor && *end == ' ') {
+    request.weight = weight > 0 ? weight : 1;
+    cursor = end + 1;
+  }
+
+  std::string rest(cursor);
+  size_t methodEnd = rest.find(' ');
+  if (methodEnd == std::string::npos) {
+    fprintf(stderr, "Invalid request '%s'\n", spec);
+    exit(1);
+  }
+  request.method = rest.substr(0, methodEnd);
+  size_t targetEnd = rest.find(' ', methodEnd + 1);
+  std::string target = rest.substr(methodEnd + 1, targetEnd == std::string::npos ? std::string::npos : targetEnd - methodEnd - 1);
+  request.body = targetEnd == std::string::npos ? "" : rest.substr(targetEnd + 1);
+  size_t queryStart = target.find('?');
+  request.path = target.substr(0, queryStart);
+  request.query = queryStart == std::string::npos ? "" : target.substr(queryStart + 1);
+  return request;
+}
+
+static Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--port" && hasValue) {
+      options.port = atoi(argv[++i]);
+    } else if (arg == "--mode" && hasValue) {
+      std::string mode = argv[++i];
+      if (mode != "open" && mode != "closed") {
+        usage(argv[0]);
+      }
+      options.openLoop = mode == "open";
+    } else if (arg == "--rate" && hasValue) {
+      options.rate = atof(argv[++i]);
+    } else if (arg == "--concurrency" && hasValue) {
+      options.concurrency = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--duration" && hasValue) {
+      options.duration = atof(argv[++i]);
+    } else if (arg == "--warmup" && hasValue) {
+      options.warmup = atof(argv[++i]);
+    } else if (arg == "--timeout" && hasValue) {
+      options.timeout = atof(argv[++i]);
+    } else if (arg == "--framing" && hasValue) {
+      std::string framing = argv[++i];
+      if (framing != "text" && framing != "binary") {
+        usage(argv[0]);
+      }
+      options.binary = framing == "binary";
+    } else if (arg == "--request" && hasValue) {
+      options.requests.push_back(parseRequest(argv[++i]));
+    } else if (arg == "--json") {
+      options.json = true;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (options.requests.empty()) {
+    options.requests.push_back(parseRequest("GET /"));
+  }
+  if (options.openLoop && options.rate <= 0) {
+    usage(argv[0]);
+  }
+  return options;
+}
+
+/** Returns the value of the HTTPMethod enum of the library for a method name. */
+static uint8_t methodValue(const std::string &method) {
+  const char *methods[] = {"GET", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"};
+  for (uint8_t i = 0; i < 6; i++) {
+    if (method == methods[i]) {
+      return i + 1;
+    }
+  }
+  fprintf(stderr, "Method %s can't be sent with the binary framing\n", method.c_str());
+  exit(1);
+}
+
+static void appendInt(std::string &out, uint32_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) {
+    out += (char) (value >> (8 * i));
+  }
+}
+
+class Relay {
+private:
+  const Options &options;
+  std::vector<RequestSpec> requests;
+  int fd = -1;
+  std::string inbound;
+  /** The fragments of the message currently being received. */
+  std::string message;
+  uint8_t messageOpcode = 0;
+  bool binary = false;
+  std::map<std::string, double> outstanding;
+  std::deque<double> backlog;
+  std::vector<unsigned> cumulativeWeights;
+  std::mt19937 random;
+  uint32_t nextId = 0;
+  double measureStart;
+  double measureEnd;
+  double nextScheduled;
+  Stats stats;
+
+  void sendFrame(uint8_t opcode, const std::string &payload) {
+    std::string frame;
+    frame += (char) (0x80 | opcode);
+    if (payload.size() < 126) {
+      frame += (char) payload.size();
+    } else if (payload.size() < 65536) {
+      frame += (char) 126;
+      appendInt(frame, payload.size(), 2);
+    } else {
+      frame += (char) 127;
+      appendInt(frame, 0, 4);
+      appendInt(frame, payload.size(), 4);
+    }
+    frame += payload;
+
+    size_t written = 0;
+    while (written < frame.size()) {
+      ssize_t result = send(fd, &frame[written], frame.size() - written, MSG_NOSIGNAL);
+      if (result < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+          continue;
+        }
+        fprintf(stderr, "The device disconnected\n");
+        exit(1);
+      }
+      written += result;
+    }
+  }
+
+  /** Reads the upgrade request from the device and completes the websocket handshake. */
+  void handshake() {
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+      if (received <= 0) {
+        fprintf(stderr, "The device disconnected during the handshake\n");
+        exit(1);
+      }
+      request.append(buffer, received);
+    }
+
+    size_t headersEnd = request.find("\r\n\r\n");
+    inbound = request.substr(headersEnd + 4);
+    std::string firstLine = request.substr(0, request.find("\r\n"));
+    binary = options.binary && firstLine.find("framing=binary") != std::string::npos;
+
+    std::string key;
+    size_t lineStart = request.find("\r\n") + 2;
+    while (lineStart < headersEnd) {
+      size_t lineEnd = request.find("\r\n", lineStart);
+      if (strncasecmp(&request[lineStart], "sec-websocket-key:", 18) == 0) {
+        key = request.substr(lineStart + 18, lineEnd - lineStart - 18);
+        key.erase(0, key.find_first_not_of(' '));
+        key.erase(key.find_last_not_of(' ') + 1);
+      }
+      lineStart = lineEnd + 2;
+    }
+    if (key.empty()) {
+      fprintf(stderr, "The connection is not a websocket upgrade request\n");
+      exit(1);
+    }
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    std::string accept = key + WEBSOCKET_GUID;
+    SHA1((const unsigned char *) accept.data(), accept.size(), digest);
+    char encoded[64];
+    EVP_EncodeBlock((unsigned char *) encoded, digest, SHA_DIGEST_LENGTH);
+
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nupgrade: websocket\r\nconnection: Upgrade\r\n"
+                           "sec-websocket-accept: " + std::string(encoded) + "\r\n\r\n";
+    send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+    fprintf(stderr, "Device connected: %s (%s framing)\n", firstLine.c_str(), binary ? "binary" : "text");
+
+    if (binary) {
+      // Intern each distinct path so requests only carry a path ID. Paths beyond the device's limit are sent inline.
+      std::map<std::string, uint16_t> ids;
+      for (RequestSpec &spec : requests) {
+        if (ids.count(spec.path) == 0) {
+          if (ids.size() >= MAX_PATHS) {
+            spec.pathId = 0;
+            continue;
+          }
+          uint16_t id = ids.size() + 1;
+          ids[spec.path] = id;
+          std::string frame(1, (char) FRAME_DEFINE_PATH);
+          appendInt(frame, id, 2);
+          appendInt(frame, spec.path.size(), 2);
+          frame += spec.path;
+          sendFrame(OP_BINARY, frame);
+        }
+        spec.pathId = ids[spec.path];
+      }
+    }
+  }
+
+  const RequestSpec &pickRequest() {
+    unsigned value = random() % cumulativeWeights.back();
+    size_t index = std::upper_bound(cumulativeWeights.begin(), cumulativeWeights.end(), value) - cumulativeWeights.begin();
+    return requests[index];
+  }
+
+  void sendRequest(double start) {
+    char id[ID_LENGTH + 1];
+    snprintf(id, sizeof(id), "%04x", nextId++ & 0xffff);
+    outstanding[id] = start;
+    const RequestSpec &spec = pickRequest();
+
+    std::string payload;
+    if (binary) {
+      payload += (char) FRAME_REQUEST;
+      payload.append(id, ID_LENGTH);
+      payload += (char) methodValue(spec.method);
+      appendInt(payload, spec.pathId, 2);
+      if (spec.pathId == 0) {
+        appendInt(payload, spec.path.size(), 2);
+        payload += spec.path;
+      }
+      appendInt(payload, spec.query.size(), 2);
+      payload += spec.query;
+      payload += (char) (spec.body.empty() ? 0 : 1);
+      if (!spec.body.empty()) {
+        payload += (char) 12;
+        payload += "content-type";
+        appendInt(payload, 16, 2);
+        payload += "application/json";
+      }
+      appendInt(payload, spec.body.size(), 4);
+      payload += spec.body;
+      sendFrame(OP_BINARY, payload);
+    } else {
+      payload = std::string("FWD: ") + id + "\r\n" + spec.method + " " + spec.path + (spec.query.empty() ? "" : "?" + spec.query) + " HTTP/1.1\r\n";
+      if (!spec.body.empty()) {
+        payload += "content-type: application/json\r\ncontent-length: " + std::to_string(spec.body.size()) + "\r\n";
+      }
+      payload += "\r\n" + spec.body;
+      sendFrame(OP_TEXT, payload);
+    }
+
+    if (start >= measureStart && start < measureEnd) {
+      stats.sent++;
+      stats.bytesSent += payload.size();
+    }
+  }
+
+  void handleMessage(uint8_t opcode, const std::string &payload) {
+    std::string id;
+    size_t responseStart;
+    if (opcode == OP_TEXT && payload.compare(0, 5, "RES: ") == 0 && payload.size() >= 5 + ID_LENGTH + 2) {
+      id = payload.substr(5, ID_LENGTH);
+      responseStart = 5 + ID_LENGTH + 2;
+    } else if (opcode == OP_BINARY && payload.size() >= 1 + ID_LENGTH && (uint8_t) payload[0] == FRAME_RESPONSE) {
+      id = payload.substr(1, ID_LENGTH);
+      responseStart = 1 + ID_LENGTH;
+    } else {
+      stats.unknown++;
+      return;
+    }
+
+    auto it = outstanding.find(id);
+    if (it == outstanding.end()) {
+      // The request already timed out.
+      stats.unknown++;
+      return;
+    }
+    double start = it->second;
+    outstanding.erase(it);
+
+    if (start >= measureStart && start < measureEnd) {
+      stats.completed++;
+      stats.bytesReceived += payload.size();
+      stats.latencies.push_back((uint32_t) std::min((now() - start) * 1e6, 4e9));
+      int status = payload.size() > responseStart + 12 ? atoi(&payload[responseStart + 9]) : 0;
+      stats.statusClasses[status >= 100 && status < 600 ? status / 100 : 0]++;
+    }
+  }
+
+  /** Parses the complete frames in the inbound buffer. */
+  void processFrames() {
+    size_t offset = 0;
+    while (inbound.size() - offset >= 2) {
+      const uint8_t *header = (const uint8_t *) &inbound[offset];
+      bool fin = header[0] & 0x80;
+      uint8_t opcode = header[0] & 0x0f;
+      bool masked = header[1] & 0x80;
+      uint64_t length = header[1] & 0x7f;
+      size_t headerLength = 2;
+      if (length == 126) {
+        headerLength = 4;
+      } else if (length == 127) {
+        headerLength = 10;
+      }
+      if (masked) {
+        headerLength += 4;
+      }
+      if (inbound.size() - offset < headerLength) {
+        break;
+      }
+      if (length == 126) {
+        length = (header[2] << 8) | header[3];
+      } else if (length == 127) {
+        length = 0;
+        for (int i = 2; i < 10; i++) {
+          length = (length << 8) | header[i];
+        }
+      }
+      if (inbound.size() - offset - headerLength < length) {
+        break;
+      }
+
+      std::string payload = inbound.substr(offset + headerLength, length);
+      if (masked) {
+        const uint8_t *mask = &header[headerLength - 4];
+        for (size_t i = 0; i < payload.size(); i++) {
+          payload[i] ^= mask[i % 4];
+        }
+      }
+      offset += headerLength + length;
+
+      if (opcode == OP_PING) {
+        sendFrame(OP_PONG, payload);
+      } else if (opcode == OP_CLOSE) {
+        fprintf(stderr, "The device closed the connection\n");
+        exit(1);
+      } else if (opcode == OP_TEXT || opcode == OP_BINARY || opcode == OP_CONTINUATION) {
+        if (opcode != OP_CONTINUATION) {
+          messageOpcode = opcode;
+          message.clear();
+        }
+        message += payload;
+        if (fin) {
+          handleMessage(messageOpcode, message);
+        }
+      }
+    }
+    inbound.erase(0, offset);
+  }
+
+  void checkTimeouts(double time) {
+    for (auto it = outstanding.begin(); it != outstanding.end();) {
+      if (time - it->second > options.timeout) {
+        if (it->second >= measureStart && it->second < measureEnd) {
+          stats.timeouts++;
+        }
+        it = outstanding.erase(it);
+      } else {
+        it++;
+      }
+    }
+  }
+
+  void dispatch(double time, bool issuing) {
+    if (options.openLoop && issuing) {
+      while (nextScheduled <= time) {
+        backlog.push_back(nextScheduled);
+        nextScheduled += 1.0 / options.rate;
+      }
+    }
+
+    while (outstanding.size() < (size_t) options.concurrency) {
+      if (options.openLoop) {
+        if (backlog.empty()) {
+          break;
+        }
+        double start = backlog.front();
+        backlog.pop_front();
+        sendRequest(start);
+      } else if (issuing) {
+        sendRequest(time);
+      } else {
+        break;
+      }
+    }
+  }
+
+public:
+  Relay(const Options &options) : options(options), requests(options.requests), random(std::random_device()()) {
+    unsigned total = 0;
+    for (const RequestSpec &request : requests) {
+      total += request.weight;
+      cumulativeWeights.push_back(total);
+    }
+  }
+
+  void accept() {
+    int server = socket(AF_INET6, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in6 address;
+    memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_port = htons(options.port);
+    address.sin6_addr = in6addr_any;
+    if (bind(server, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(server, 1) < 0) {
+      fprintf(stderr, "Could not listen on port %d: %s\n", options.port, strerror(errno));
+      exit(1);
+    }
+
+    fprintf(stderr, "Waiting for a device on port %d\n", options.port);
+    fd = ::accept(server, nullptr, nullptr);
+    close(server);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    handshake();
+  }
+
+  const Stats &run() {
+    double begin = now();
+    measureStart = begin + options.warmup;
+    measureEnd = measureStart + options.duration;
+    nextScheduled = begin;
+
+    char buffer[16 * 1024];
+    while (true) {
+      double time = now();
+      bool issuing = time < measureEnd;
+      if (!issuing && outstanding.empty()) {
+        break;
+      }
+
+      checkTimeouts(time);
+      dispatch(time, issuing);
+
+      // Wake up in time for the next request of an open-loop schedule, so it isn't delayed by the poll timeout.
+      double wait = 0.01;
+      if (options.openLoop && issuing && outstanding.size() < (size_t) options.concurrency) {
+        wait = std::max(0.0, std::min(wait, nextScheduled - now()));
+      }
+      struct timespec timeout = {0, (long) (wait * 1e9)};
+      struct pollfd pfd = {fd, POLLIN, 0};
+      if (ppoll(&pfd, 1, &timeout, nullptr) > 0) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+          fprintf(stderr, "The device disconnected\n");
+          exit(1);
+        }
+        inbound.append(buffer, received);
+        processFrames();
+      }
+    }
+
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    return stats;
+  }
+};
+
+static double percentile(const std::vector<uint32_t> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t) ceil(fraction * sorted.size());
+  return sorted[index > 0 ? index - 1 : 0] / 1000.0;
+}
+
+static void report(const Options &options, const Stats &stats) {
+  double throughput = stats.completed / options.duration;
+  double mean = 0;
+  for (uint32_t latency : stats.latencies) {
+    mean += latency;
+  }
+  mean = stats.latencies.empty() ? 0 : mean / stats.latencies.size() / 1000.0;
+  double max = stats.latencies.empty() ? 0 : stats.latencies.back() / 1000.0;
+  const double fractions[] = {0.5, 0.9, 0.99, 0.999};
+  const char *labels[] = {"p50", "p90", "p99", "p99.9"};
+
+  if (options.json) {
+    printf("{\n  \"mode\": \"%s\",\n  \"concurrency\": %d,\n  \"duration\": %.3f,\n", options.openLoop ? "open" : "closed",
+           options.concurrency, options.duration);
+    if (options.openLoop) {
+      printf("  \"target_rate\": %.1f,\n", options.rate);
+    }
+    printf("  \"sent\": %llu,\n  \"completed\": %llu,\n  \"throughput\": %.1f,\n  \"timeouts\": %llu,\n  \"unknown\": %llu,\n",
+           (unsigned long long) stats.sent, (unsigned long long) stats.completed, throughput,
+           (unsigned long long) stats.timeouts, (unsigned long long) stats.unknown);
+    printf("  \"bytes_sent\": %llu,\n  \"bytes_received\": %llu,\n", (unsigned long long) stats.bytesSent,
+           (unsigned long long) stats.bytesReceived);
+    printf("  \"status\": {\"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu, \"other\": %llu},\n",
+           (unsigned long long) stats.statusClasses[2], (unsigned long long) stats.statusClasses[3],
+           (unsigned long long) stats.statusClasses[4], (unsigned long long) stats.statusClasses[5],
+           (unsigned long long) (stats.statusClasses[0] + stats.statusClasses[1]));
+    printf("  \"latency_ms\": {\"mean\": %.3f", mean);
+    for (int i = 0; i < 4; i++) {
+      printf(", \"%s\": %.3f", labels[i], percentile(stats.latencies, fractions[i]));
+    }
+    printf(", \"max\": %.3f}\n}\n", max);
+    return;
+  }
+
+  printf("%s loop, %d outstanding requests", options.openLoop ? "Open" : "Closed", options.concurrency);
+  if (options.openLoop) {
+    printf(", target %.1f req/s", options.rate);
+  }
+  printf("\n");
+  printf("  Completed:   %llu of %llu requests in %.1f s (%.1f req/s)\n", (unsigned long long) stats.completed,
+         (unsigned long long) stats.sent, options.duration, throughput);
+  printf("  Bytes:       %llu sent, %llu received\n", (unsigned long long) stats.bytesSent, (unsigned long long) stats.bytesReceived);
+  printf("  Errors:      %llu timeout, %llu unexpected messages\n", (unsigned long long) stats.timeouts, (unsigned long long) stats.unknown);
+  printf("  Status:      2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu, other %llu\n", (unsigned long long) stats.statusClasses[2],
+         (unsigned long long) stats.statusClasses[3], (unsigned long long) stats.statusClasses[4],
+         (unsigned long long) stats.statusClasses[5], (unsigned long long) (stats.statusClasses[0] + stats.statusClasses[1]));
+  printf("  Latency ms:  mean %.3f", mean);
+  for (int i = 0; i < 4; i++) {
+    printf(", %s %.3f", labels[i], percentile(stats.latencies, fractions[i]));
+  }
+  printf(", max %.3f\n", max);
+}
+
+int main(int argc, char **argv) {
+  signal(SIGPIPE, SIG_IGN);
+  Options options = parseOptions(argc, argv);
+  Relay relay(options);
+  relay.accept();
+  report(options, relay.run());
+  return 0;
+}
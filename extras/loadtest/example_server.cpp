@@ -0,0 +1,122 @@
+/* Example server for load testing, with routes representative of a controller: a small status document, a larger
+ * options document, a POST that changes state, a large streamed log and a slow handler.
+ *
+ * Build from the root of the library (the Linux build of the library requires tiny_websockets):
+ *   g++ -std=c++17 -O2 -I. extras/loadtest/example_server.cpp $(ls *.cpp) -o example_server \
+ *       -ltiny_websockets -lssl -lcrypto -lpthread
+ *   ./example_server [port] [--cache] [--cloud host port [deviceKey]]
+ *
+ * With --cache, GET /jc and GET /jo are served from the response cache for 1 second at a time. With --cloud, the server
+ * also connects to a cloud websocket, such as the stand-in relay in extras/cloudsim, and serves forwarded requests.
+ */
+#include "OpenThingsFramework.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace OTF;
+
+static int stationCount = 16;
+static unsigned long programChanges = 0;
+
+/** A small JSON status document, like the controller variables polled by apps. */
+static void getStatus(const Request &req, Response &res) {
+  res.writeStatus(200, "OK");
+  res.writeHeader("content-type", "application/json");
+  res.writeHeader("access-control-allow-origin", "*");
+  res.writeBodyChunk("{\"devt\":%lu,\"nbrd\":%d,\"en\":1,\"rd\":0,\"rs\":0,\"mm\":0,\"sunrise\":392,\"sunset\":1136,\"changes\":%lu}",
+                     millis() / 1000, stationCount / 8, programChanges);
+}
+
+/** A larger JSON document of about 2 KB. */
+static void getOptions(const Request &req, Response &res) {
+  res.writeStatus(200, "OK");
+  res.writeHeader("content-type", "application/json");
+  res.writeBodyChunk("{\"fwv\":220,\"tz\":48,\"hp0\":80,\"hp1\":0,\"dhcp\":1,\"ext\":%d,\"sdt\":0,\"mas\":0,\"mton\":0,\"mtof\":0,\"stations\":[",
+                     stationCount / 8 - 1);
+  for (int i = 0; i < stationCount; i++) {
+    res.writeBodyChunk("%s{\"sid\":%d,\"name\":\"Station %02d\",\"attrib\":{\"master\":0,\"ignore_rain\":0,\"disabled\":0,\"seq\":1}}",
+                       i > 0 ? "," : "", i, i + 1);
+  }
+  res.writeBodyChunk("]}");
+}
+
+/** Changes a program, reading the JSON body of the request. */
+static void changeProgram(const Request &req, Response &res) {
+  if (req.getBodyLength() == 0) {
+    res.writeStatus(400, "Bad request");
+    res.writeHeader("content-type", "application/json");
+    res.writeBodyChunk("{\"result\":16}");
+    return;
+  }
+
+  programChanges++;
+  res.writeStatus(200, "OK");
+  res.writeHeader("content-type", "application/json");
+  res.writeBodyChunk("{\"result\":1,\"received\":%d}", (int) req.getBodyLength());
+}
+
+/** A 64 KB log, which is larger than the response buffer and has to be streamed. */
+static void getLog(const Request &req, Response &res) {
+  res.writeStatus(200, "OK");
+  res.writeHeader("content-type", "text/plain");
+  for (int i = 0; i < 1024; i++) {
+    res.writeBodyChunk("%010d station %02d ran for %04d seconds.......\n", 1700000000 + i * 60, i % stationCount, i % 3600);
+  }
+}
+
+/** A handler that blocks for 5 ms, like one that reads a slow sensor. */
+static void getSlow(const Request &req, Response &res) {
+  usleep(5000);
+  res.writeStatus(200, "OK");
+  res.writeHeader("content-type", "application/json");
+  res.writeBodyChunk("{\"sensor\":42}");
+}
+
+int main(int argc, char **argv) {
+  int port = 8080;
+  bool cache = false;
+  const char *cloudHost = nullptr;
+  uint16_t cloudPort = 0;
+  const char *deviceKey = "loadtest";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--cache") == 0) {
+      cache = true;
+    } else if (strcmp(argv[i], "--cloud") == 0 && i + 2 < argc) {
+      cloudHost = argv[++i];
+      cloudPort = atoi(argv[++i]);
+      if (i + 1 < argc && argv[i + 1][0] != '-' && atoi(argv[i + 1]) == 0) {
+        deviceKey = argv[++i];
+      }
+    } else {
+      port = atoi(argv[i]);
+    }
+  }
+
+  OpenThingsFramework *framework;
+  if (cloudHost != nullptr) {
+    framework = new OpenThingsFramework(port, cloudHost, cloudPort, deviceKey, false);
+  } else {
+    framework = new OpenThingsFramework(port);
+  }
+  OpenThingsFramework &otf = *framework;
+  otf.on("/jc", getStatus, HTTP_GET);
+  otf.on("/jo", getOptions, HTTP_GET);
+  otf.on("/cp", changeProgram, HTTP_POST);
+  otf.on("/log", getLog, HTTP_GET);
+  otf.on("/slow", getSlow, HTTP_GET);
+  if (cache) {
+    otf.setCacheTtl("/jc", 1000);
+    otf.setCacheTtl("/jo", 1000);
+  }
+
+  printf("Listening on port %d%s\n", port, cache ? " with the response cache enabled" : "");
+  if (cloudHost != nullptr) {
+    printf("Connecting to the cloud at %s:%d\n", cloudHost, cloudPort);
+  }
+  fflush(stdout);
+  while (true) {
+    otf.loop();
+  }
+}
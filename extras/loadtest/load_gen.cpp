@@ -0,0 +1,555 @@
+/* HTTP load generator for the local server of the library (or any HTTP/1.1 server) on Linux.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 extras/loadtest/load_gen.cpp -o load_gen
+ *
+ * Examples:
+ *   # 8 connections sending requests back to back for 10 seconds.
+ *   ./load_gen --port 8080 --concurrency 8 --duration 10 --request "GET /jc"
+ *   # 2000 requests per second spread over up to 32 connections, with a weighted mix of requests.
+ *   ./load_gen --port 8080 --mode open --rate 2000 --concurrency 32 \
+ *       --request "8 GET /jc" --request "1 GET /jo" --request '1 POST /cp {"sid":1,"dur":60}'
+ *
+ * In closed-loop mode each connection sends its next request as soon as the previous response has been received, which
+ * measures the maximum throughput. In open-loop mode requests are issued on a fixed schedule regardless of how quickly
+ * the server responds, and latency is measured from the time each request was scheduled, so queueing delays are not
+ * hidden when the server falls behind.
+ *
+ * Responses without a content-length are read until the server closes the connection. With --keepalive, connections are
+ * reused for the next request whenever the server leaves them open.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+struct RequestSpec {
+  std::string name;
+  std::string data;
+  unsigned weight;
+};
+
+struct Options {
+  const char *host = "127.0.0.1";
+  int port = 8080;
+  bool openLoop = false;
+  bool poisson = false;
+  double rate = 1000;
+  int concurrency = 1;
+  double duration = 10;
+  double warmup = 1;
+  double timeout = 5;
+  bool keepAlive = false;
+  bool json = false;
+  std::vector<RequestSpec> requests;
+};
+
+struct Connection {
+  enum State {
+    IDLE,
+    CONNECTING,
+    WRITING,
+    READING
+  };
+
+  int fd = -1;
+  State state = IDLE;
+  const RequestSpec *request = nullptr;
+  size_t written = 0;
+  std::string response;
+  /** The time the current request was issued (closed loop) or scheduled (open loop). */
+  double start = 0;
+  /** Indicates if the current request is being sent on a connection that was reused. */
+  bool reused = false;
+};
+
+struct Stats {
+  uint64_t completed = 0;
+  uint64_t connectErrors = 0;
+  uint64_t resetErrors = 0;
+  uint64_t timeouts = 0;
+  uint64_t dropped = 0;
+  uint64_t connections = 0;
+  uint64_t statusClasses[6] = {};
+  uint64_t bytesReceived = 0;
+  /** The latency of each completed request in microseconds. */
+  std::vector<uint32_t> latencies;
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --host <addr>          Server address (default 127.0.0.1)\n"
+          "  --port <port>          Server port (default 8080)\n"
+          "  --mode closed|open     Closed-loop or open-loop load (default closed)\n"
+          "  --rate <req/s>         Request rate in open-loop mode (default 1000)\n"
+          "  --poisson              Use exponentially distributed gaps in open-loop mode instead of a fixed rate\n"
+          "  --concurrency <n>      Number of connections (default 1)\n"
+          "  --duration <sec>       Measured duration (default 10)\n"
+          "  --warmup <sec>         Duration before measuring (default 1)\n"
+          "  --timeout <sec>        Time to wait for each response (default 5)\n"
+          "  --keepalive            Reuse connections the server leaves open\n"
+          "  --request \"[weight] METHOD path [body]\"\n"
+          "                         Adds a request to the mix (default \"GET /\"). May be repeated.\n"
+          "  --json                 Print the results as JSON\n",
+          name);
+  exit(1);
+}
+
+/** Parses a request specification into the raw request that is sent. */
+static RequestSpec parseRequest(const char *spec, const Options &options) {
+  RequestSpec request;
+  request.weight = 1;
+
+  const char *cursor = spec;
+  char *end;
+  unsigned long weight = strtoul(cursor, &end, 10);
+  if (end != cursor && *end == ' ') {
+    request.weight = weight > 0 ? weight : 1;
+    cursor = end + 1;
+  }
+
+  std::string rest(cursor);
+  size_t methodEnd = rest.find(' ');
+  if (methodEnd == std::string::npos) {
+    fprintf(stderr, "Invalid request '%s'\n", spec);
+    exit(1);
+  }
+  std::string method = rest.substr(0, methodEnd);
+  size_t pathEnd = rest.find(' ', methodEnd + 1);
+  std::string path = rest.substr(methodEnd + 1, pathEnd == std::string::npos ? std::string::npos : pathEnd - methodEnd - 1);
+  std::string body = pathEnd == std::string::npos ? "" : rest.substr(pathEnd + 1);
+
+  request.name = method + " " + path;
+  request.data = method + " " + path + " HTTP/1.1\r\n";
+  request.data += std::string("host: ") + options.host + "\r\n";
+  request.data += "user-agent: otf-load-gen\r\n";
+  request.data += options.keepAlive ? "connection: keep-alive\r\n" : "connection: close\r\n";
+  if (!body.empty()) {
+    request.data += "content-type: application/json\r\n";
+    request.data += "content-length: " + std::to_string(body.size()) + "\r\n";
+  }
+  request.data += "\r\n" + body;
+  return request;
+}
+
+static Options parseOptions(int argc, char **argv) {
+  Options options;
+  std::vector<const char *> specs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--host" && hasValue) {
+      options.host = argv[++i];
+    } else if (arg == "--port" && hasValue) {
+      options.port = atoi(argv[++i]);
+    } else if (arg == "--mode" && hasValue) {
+      std::string mode = argv[++i];
+      if (mode != "open" && mode != "closed") {
+        usage(argv[0]);
+      }
+      options.openLoop = mode == "open";
+    } else if (arg == "--rate" && hasValue) {
+      options.rate = atof(argv[++i]);
+    } else if (arg == "--poisson") {
+      options.poisson = true;
+    } else if (arg == "--concurrency" && hasValue) {
+      options.concurrency = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--duration" && hasValue) {
+      options.duration = atof(argv[++i]);
+    } else if (arg == "--warmup" && hasValue) {
+      options.warmup = atof(argv[++i]);
+    } else if (arg == "--timeout" && hasValue) {
+      options.timeout = atof(argv[++i]);
+    } else if (arg == "--keepalive") {
+      options.keepAlive = true;
+    } else if (arg == "--request" && hasValue) {
+      specs.push_back(argv[++i]);
+    } else if (arg == "--json") {
+      options.json = true;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (specs.empty()) {
+    specs.push_back("GET /");
+  }
+  // Requests are built after all options are parsed since they depend on the host and keep-alive settings.
+  for (const char *spec : specs) {
+    options.requests.push_back(parseRequest(spec, options));
+  }
+  if (options.openLoop && options.rate <= 0) {
+    usage(argv[0]);
+  }
+  return options;
+}
+
+class LoadGenerator {
+private:
+  const Options &options;
+  struct sockaddr_storage address;
+  socklen_t addressLength;
+  int epoll;
+  std::vector<Connection> connections;
+  /** The scheduled start times of open-loop requests that are waiting for a free connection. */
+  std::deque<double> backlog;
+  std::vector<unsigned> cumulativeWeights;
+  std::mt19937 random;
+  double measureStart;
+  double measureEnd;
+  double nextScheduled;
+  Stats stats;
+
+  const RequestSpec *pickRequest() {
+    unsigned value = random() % cumulativeWeights.back();
+    size_t index = std::upper_bound(cumulativeWeights.begin(), cumulativeWeights.end(), value) - cumulativeWeights.begin();
+    return &options.requests[index];
+  }
+
+  void watch(Connection &connection, uint32_t events, int operation) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = &connection;
+    epoll_ctl(epoll, operation, connection.fd, &event);
+  }
+
+  void closeConnection(Connection &connection) {
+    if (connection.fd >= 0) {
+      close(connection.fd);
+      connection.fd = -1;
+    }
+    connection.state = Connection::IDLE;
+  }
+
+  bool isMeasured(double start) const {
+    return start >= measureStart && start < measureEnd;
+  }
+
+  void fail(Connection &connection, uint64_t &counter) {
+    if (isMeasured(connection.start)) {
+      counter++;
+    }
+    closeConnection(connection);
+  }
+
+  void startRequest(Connection &connection, double start) {
+    connection.request = pickRequest();
+    connection.written = 0;
+    connection.response.clear();
+    connection.start = start;
+    connection.reused = connection.fd >= 0;
+
+    if (connection.fd >= 0) {
+      connection.state = Connection::WRITING;
+      watch(connection, EPOLLOUT, EPOLL_CTL_MOD);
+      return;
+    }
+
+    connection.fd = socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int on = 1;
+    setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    stats.connections++;
+    if (connect(connection.fd, (struct sockaddr *) &address, addressLength) < 0 && errno != EINPROGRESS) {
+      fail(connection, stats.connectErrors);
+      return;
+    }
+    connection.state = Connection::CONNECTING;
+    watch(connection, EPOLLOUT, EPOLL_CTL_ADD);
+  }
+
+  /** Returns the length of the response if it is complete, or 0 if more data is needed. */
+  static size_t responseLength(const std::string &response, bool closed, bool &hasLength) {
+    size_t headersEnd = response.find("\r\n\r\n");
+    hasLength = false;
+    if (headersEnd == std::string::npos) {
+      return 0;
+    }
+
+    size_t lineStart = response.find("\r\n") + 2;
+    while (lineStart < headersEnd) {
+      size_t lineEnd = response.find("\r\n", lineStart);
+      if (strncasecmp(&response[lineStart], "content-length:", 15) == 0) {
+        hasLength = true;
+        size_t length = headersEnd + 4 + strtoul(&response[lineStart + 15], nullptr, 10);
+        return response.size() >= length ? length : 0;
+      }
+      lineStart = lineEnd + 2;
+    }
+    return closed ? response.size() : 0;
+  }
+
+  void complete(Connection &connection, size_t length, bool closed, bool hasLength) {
+    if (isMeasured(connection.start)) {
+      double latency = now() - connection.start;
+      stats.completed++;
+      stats.bytesReceived += length;
+      stats.latencies.push_back((uint32_t) std::min(latency * 1e6, 4e9));
+      int status = connection.response.size() > 12 ? atoi(&connection.response[9]) : 0;
+      stats.statusClasses[status >= 100 && status < 600 ? status / 100 : 0]++;
+    }
+
+    bool reusable = options.keepAlive && !closed && hasLength &&
+                    strcasestr(connection.response.substr(0, connection.response.find("\r\n\r\n")).c_str(), "connection: close") == nullptr;
+    if (reusable) {
+      connection.state = Connection::IDLE;
+      watch(connection, 0, EPOLL_CTL_MOD);
+    } else {
+      closeConnection(connection);
+    }
+  }
+
+  void handleEvent(Connection &connection, uint32_t events) {
+    if (connection.state == Connection::CONNECTING) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+      if (error != 0) {
+        fail(connection, stats.connectErrors);
+        return;
+      }
+      connection.state = Connection::WRITING;
+    }
+
+    if (connection.state == Connection::WRITING) {
+      const std::string &data = connection.request->data;
+      ssize_t written = send(connection.fd, &data[connection.written], data.size() - connection.written, MSG_NOSIGNAL);
+      if (written < 0 && errno != EAGAIN) {
+        fail(connection, stats.resetErrors);
+        return;
+      }
+      connection.written += written > 0 ? written : 0;
+      if (connection.written == data.size()) {
+        connection.state = Connection::READING;
+        watch(connection, EPOLLIN, EPOLL_CTL_MOD);
+      }
+      return;
+    }
+
+    if (connection.state == Connection::READING) {
+      char buffer[16 * 1024];
+      bool closed = false;
+      while (true) {
+        ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+          connection.response.append(buffer, received);
+        } else if (received == 0) {
+          closed = true;
+          break;
+        } else if (errno == EAGAIN) {
+          break;
+        } else {
+          // A reset after the response was sent still completes a response that is delimited by the connection.
+          closed = true;
+          break;
+        }
+      }
+
+      bool hasLength;
+      size_t length = responseLength(connection.response, closed, hasLength);
+      if (length > 0) {
+        complete(connection, length, closed, hasLength);
+      } else if (closed) {
+        fail(connection, stats.resetErrors);
+      }
+    }
+  }
+
+  void checkTimeouts(double time) {
+    for (Connection &connection : connections) {
+      if (connection.state != Connection::IDLE && time - connection.start > options.timeout) {
+        fail(connection, stats.timeouts);
+      }
+    }
+  }
+
+  double nextGap() {
+    if (options.poisson) {
+      std::exponential_distribution<double> distribution(options.rate);
+      return distribution(random);
+    }
+    return 1.0 / options.rate;
+  }
+
+  /** Schedules open-loop requests that are due and starts requests on idle connections. */
+  void dispatch(double time, bool issuing) {
+    if (options.openLoop && issuing) {
+      while (nextScheduled <= time) {
+        // Bound the backlog so a server that stops responding doesn't exhaust memory.
+        if (backlog.size() < 1000000) {
+          backlog.push_back(nextScheduled);
+        } else if (isMeasured(nextScheduled)) {
+          stats.dropped++;
+        }
+        nextScheduled += nextGap();
+      }
+    }
+
+    for (Connection &connection : connections) {
+      if (connection.state != Connection::IDLE) {
+        continue;
+      }
+      if (options.openLoop) {
+        if (backlog.empty()) {
+          break;
+        }
+        double start = backlog.front();
+        backlog.pop_front();
+        startRequest(connection, start);
+      } else if (issuing) {
+        startRequest(connection, time);
+      }
+    }
+  }
+
+public:
+  LoadGenerator(const Options &options) : options(options), connections(options.concurrency), random(std::random_device()()) {
+    unsigned total = 0;
+    for (const RequestSpec &request : options.requests) {
+      total += request.weight;
+      cumulativeWeights.push_back(total);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *info;
+    if (getaddrinfo(options.host, std::to_string(options.port).c_str(), &hints, &info) != 0) {
+      fprintf(stderr, "Could not resolve %s\n", options.host);
+      exit(1);
+    }
+    memcpy(&address, info->ai_addr, info->ai_addrlen);
+    addressLength = info->ai_addrlen;
+    freeaddrinfo(info);
+
+    epoll = epoll_create1(0);
+  }
+
+  const Stats &run() {
+    double begin = now();
+    measureStart = begin + options.warmup;
+    measureEnd = measureStart + options.duration;
+    nextScheduled = begin;
+
+    std::vector<struct epoll_event> events(connections.size());
+    while (true) {
+      double time = now();
+      bool issuing = time < measureEnd;
+      bool busy = false;
+      for (const Connection &connection : connections) {
+        busy = busy || connection.state != Connection::IDLE;
+      }
+      if (!issuing && !busy) {
+        break;
+      }
+
+      checkTimeouts(time);
+      dispatch(time, issuing);
+
+      // Open-loop requests must be issued on time, so don't sleep past the next one.
+      int timeout = options.openLoop ? 1 : 10;
+      int count = epoll_wait(epoll, events.data(), events.size(), timeout);
+      for (int i = 0; i < count; i++) {
+        handleEvent(*(Connection *) events[i].data.ptr, events[i].events);
+      }
+    }
+
+    for (Connection &connection : connections) {
+      closeConnection(connection);
+    }
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    return stats;
+  }
+};
+
+static double percentile(const std::vector<uint32_t> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t) ceil(fraction * sorted.size());
+  return sorted[index > 0 ? index - 1 : 0] / 1000.0;
+}
+
+static void report(const Options &options, const Stats &stats) {
+  double throughput = stats.completed / options.duration;
+  double mean = 0;
+  for (uint32_t latency : stats.latencies) {
+    mean += latency;
+  }
+  mean = stats.latencies.empty() ? 0 : mean / stats.latencies.size() / 1000.0;
+  double max = stats.latencies.empty() ? 0 : stats.latencies.back() / 1000.0;
+  const double fractions[] = {0.5, 0.9, 0.99, 0.999};
+  const char *labels[] = {"p50", "p90", "p99", "p99.9"};
+
+  if (options.json) {
+    printf("{\n  \"mode\": \"%s\",\n  \"concurrency\": %d,\n  \"keepalive\": %s,\n  \"duration\": %.3f,\n",
+           options.openLoop ? "open" : "closed", options.concurrency, options.keepAlive ? "true" : "false", options.duration);
+    if (options.openLoop) {
+      printf("  \"target_rate\": %.1f,\n", options.rate);
+    }
+    printf("  \"completed\": %llu,\n  \"throughput\": %.1f,\n  \"connections\": %llu,\n", (unsigned long long) stats.completed,
+           throughput, (unsigned long long) stats.connections);
+    printf("  \"errors\": {\"connect\": %llu, \"reset\": %llu, \"timeout\": %llu, \"dropped\": %llu},\n",
+           (unsigned long long) stats.connectErrors, (unsigned long long) stats.resetErrors, (unsigned long long) stats.timeouts,
+           (unsigned long long) stats.dropped);
+    printf("  \"status\": {\"1xx\": %llu, \"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu, \"other\": %llu},\n",
+           (unsigned long long) stats.statusClasses[1], (unsigned long long) stats.statusClasses[2],
+           (unsigned long long) stats.statusClasses[3], (unsigned long long) stats.statusClasses[4],
+           (unsigned long long) stats.statusClasses[5], (unsigned long long) stats.statusClasses[0]);
+    printf("  \"latency_ms\": {\"mean\": %.3f", mean);
+    for (int i = 0; i < 4; i++) {
+      printf(", \"%s\": %.3f", labels[i], percentile(stats.latencies, fractions[i]));
+    }
+    printf(", \"max\": %.3f}\n}\n", max);
+    return;
+  }
+
+  printf("%s loop, %d connections, keep-alive %s", options.openLoop ? "Open" : "Closed", options.concurrency, options.keepAlive ? "on" : "off");
+  if (options.openLoop) {
+    printf(", target %.1f req/s", options.rate);
+  }
+  printf("\n");
+  printf("  Completed:   %llu requests in %.1f s (%.1f req/s), %llu connections\n", (unsigned long long) stats.completed,
+         options.duration, throughput, (unsigned long long) stats.connections);
+  printf("  Errors:      %llu connect, %llu reset, %llu timeout, %llu dropped\n", (unsigned long long) stats.connectErrors,
+         (unsigned long long) stats.resetErrors, (unsigned long long) stats.timeouts, (unsigned long long) stats.dropped);
+  printf("  Status:      2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu, other %llu\n", (unsigned long long) stats.statusClasses[2],
+         (unsigned long long) stats.statusClasses[3], (unsigned long long) stats.statusClasses[4],
+         (unsigned long long) stats.statusClasses[5], (unsigned long long) (stats.statusClasses[0] + stats.statusClasses[1]));
+  printf("  Latency ms:  mean %.3f", mean);
+  for (int i = 0; i < 4; i++) {
+    printf(", %s %.3f", labels[i], percentile(stats.latencies, fractions[i]));
+  }
+  printf(", max %.3f\n", max);
+}
+
+int main(int argc, char **argv) {
+  signal(SIGPIPE, SIG_IGN);
+  Options options = parseOptions(argc, argv);
+  LoadGenerator generator(options);
+  report(options, generator.run());
+  return 0;
+}
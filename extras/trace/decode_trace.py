@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Decodes a dump of the OpenThings Framework trace buffer.
+
+Usage:
+    curl -s http://<device>/trace > trace.bin
+    python3 decode_trace.py trace.bin
+
+The event names and argument descriptions are read from OTF_TRACE_EVENTS in Trace.h, so the decoder should be run
+against the version of the library the dump was taken with.
+"""
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = b"OTFT"
+HEADER = struct.Struct("<4sBBHII")
+RECORD = struct.Struct("<IIII")
+
+
+def load_events(header_path):
+    with open(header_path) as f:
+        source = f.read()
+    block = re.search(r"#define OTF_TRACE_EVENTS\(X\)(.*?)\n\n", source, re.S)
+    if block is None:
+        sys.exit("Could not find OTF_TRACE_EVENTS in %s" % header_path)
+    return re.findall(r'X\((\w+),\s*"([^"]*)",\s*"([^"]*)"\)', block.group(1))
+
+
+def main():
+    default_header = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "Trace.h")
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", nargs="?", default="-", help="dump file, or - to read standard input")
+    parser.add_argument("--header", default=default_header, help="path of Trace.h")
+    args = parser.parse_args()
+
+    events = load_events(args.header)
+    data = sys.stdin.buffer.read() if args.dump == "-" else open(args.dump, "rb").read()
+    if len(data) < HEADER.size:
+        sys.exit("The dump is too short")
+
+    magic, version, record_size, count, overwritten, dumped_at = HEADER.unpack_from(data)
+    if magic != MAGIC or version != 1 or record_size != RECORD.size:
+        sys.exit("Unsupported dump (magic %r, version %d, record size %d)" % (magic, version, record_size))
+    if len(data) < HEADER.size + count * RECORD.size:
+        sys.exit("The dump is truncated")
+
+    print("%d events, %d overwritten" % (count, overwritten))
+    records = [RECORD.unpack_from(data, HEADER.size + i * RECORD.size) for i in range(count)]
+    if not records:
+        return
+
+    # Timestamps are 32-bit microsecond counters, so only differences modulo 2^32 are meaningful.
+    first = records[0][0]
+    previous = first
+    for timestamp, event, arg0, arg1 in records:
+        since_start = (timestamp - first) & 0xFFFFFFFF
+        since_previous = (timestamp - previous) & 0xFFFFFFFF
+        previous = timestamp
+        if event < len(events):
+            name, arg0_name, arg1_name = events[event]
+        else:
+            name, arg0_name, arg1_name = "EVENT_%d" % event, "arg0", "arg1"
+        fields = ["%s=%d" % (label, value) for label, value in ((arg0_name, arg0), (arg1_name, arg1)) if label]
+        print("%12.3f ms  +%9.3f ms  %-30s %s" % (since_start / 1000.0, since_previous / 1000.0, name, " ".join(fields)))
+
+    print("dumped %.3f ms after the last event" % (((dumped_at - previous) & 0xFFFFFFFF) / 1000.0))
+
+
+if __name__ == "__main__":
+    main()